@@ -9,7 +9,9 @@
 #include "events.hxx"
 #include "widgets.hxx"
 #include "sound_controller.hxx"
-#include "kinect.hxx"
+#include "sensors.hxx"
+#include "latency.hxx"
+#include "interaction_volumes.hxx"
 
 int main(int argc, char** argv)
 {
@@ -66,21 +68,47 @@ int main(int argc, char** argv)
     auto sound_controller = std::make_shared<HDMSoundController>();
     EventManager::instance().register_listener(sound_controller);
 
-    // Create the kinect sensor.
-    KinectSensor k;
+    // Create the kinect sensor (or the replay sensor, see open_sensor()).
+    auto sensor = open_sensor(argc, argv);
+    auto & k = *sensor;
     if (opts.kinect_game_depth_)
         k.use_y_click();
     else
         k.use_z_click();
-    bool clicked_left = false;
-    bool clicked_right = false;
-    k.handle_click_left() = [&](){
-        clicked_left = true;
-    };
-    k.handle_click_right() = [&](){
-        clicked_right = true;
+
+    // The clicks and the entering and leaving players reach the game as events. The capture thread
+    // queues them for every sensor frame, so no click is lost if the game runs slower than the sensor.
+    EventManager::instance().attach_input(k.open_input_queue());
+
+    // The mole holes are interaction volumes in the normalized hand coordinates: three columns across
+    // the screen and three rows, either by the distance of the hand in front of the body or by its
+    // height. The outer volumes reach far beyond the usual hand positions.
+    auto const mole_board = [](bool depth){
+        float const reach = 3.0f;
+        std::vector<float> const columns = {0.0f, 1.0f/3.5f, 2.5f/3.5f, 1.0f};
+        if (depth)
+            return InteractionVolumes(board_boxes(columns, {reach, 1.25f, 1.05f, 0.0f}, 2, 0.0f, 1.0f));
+        else
+            return InteractionVolumes(board_boxes(columns, {0.0f, 0.25f, 0.45f, 1.0f}, 1, 0.0f, reach));
     };
-    bool use_right = true;
+    bool depth_board = opts.kinect_game_depth_;
+    auto interaction = std::make_shared<InteractionEngine>(mole_board(depth_board));
+    EventManager::instance().register_listener(interaction);
+
+    // Measure the latency from the sensor to the screen. Press L to show it, pass --latency <file> to dump it at the end.
+    std::string latency_file;
+    for (int i = 1; i+1 < argc; ++i)
+        if (std::string(argv[i]) == "--latency")
+            latency_file = argv[i+1];
+    LatencyProfile latency;
+    float latency_overlay_time = 0;
+    auto latency_overlay = std::make_shared<TextWidget>("", 1000);
+    latency_overlay->overwrite_render_rectangle({10, 10, 600, 240});
+    latency_overlay->hoverable_ = false;
+    latency_overlay->font_size_ = 14;
+    latency_overlay->bg_color_ = sf::Color(0, 0, 0, 180);
+    latency_overlay->hide();
+    game.add_widget(latency_overlay);
 
     while (window.isOpen())
     {
@@ -97,6 +125,20 @@ int main(int argc, char** argv)
             {
                 if (event.key.code == sf::Keyboard::Escape)
                     window.close();
+                else if (event.key.code == sf::Keyboard::L)
+                {
+                    if (latency_overlay->visible())
+                        latency_overlay->hide();
+                    else
+                        latency_overlay->show();
+                }
+                else if (event.key.code == sf::Keyboard::S)
+                {
+                    if (game.silhouette()->visible())
+                        game.silhouette()->hide();
+                    else
+                        game.silhouette()->show();
+                }
             }
         }
 
@@ -105,89 +147,97 @@ int main(int argc, char** argv)
             k.use_y_click();
         else
             k.use_z_click();
-        clicked_left = false;
-        clicked_right = false;
         auto fps = fps_measure.update();
         auto elapsed_time = fps_measure.elapsed_time();
         auto updates = k.update(elapsed_time);
 
-        // Get the hand positions.
-        float mouse_x;
-        float mouse_y;
-        float mouse_z;
-        auto hand_left = k.hand_left();
-        auto hand_right = k.hand_right();
-        bool hand_left_visible = k.hand_left_visible() && hand_left.Z >= 0.0;
-        bool hand_right_visible = k.hand_right_visible() && hand_right.Z >= 0.0;
-        bool hand_visible = hand_left_visible || hand_right_visible;
-        if (hand_visible)
+        // Follow the latest sensor frame through the game loop.
+        bool const new_frame = updates.depth_ || updates.user_;
+        FrameTiming timing;
+        if (new_frame)
+            timing = k.frame().timing_;
+
+        // Show the silhouette of the first player. It is converted and uploaded only for new label frames.
+        if (updates.user_ && game.silhouette()->visible())
         {
-            bool both_visible = hand_left_visible && hand_right_visible;
-            if (!hand_right_visible || (both_visible && hand_left.Z > hand_right.Z))
-            {
-                use_right = false;
-                mouse_x = hand_left.X * WIDTH;
-                mouse_y = hand_left.Y * HEIGHT;
-                mouse_z = (1.5 - hand_left.Z) * HEIGHT;
-            }
+            auto const & cursors = k.cursors();
+            if (cursors.empty())
+                game.silhouette()->clear_silhouette();
             else
+                game.silhouette()->set_silhouette(k.user_data(), k.depth_data(), static_cast<XnLabel>(cursors.front().id_), k.roi());
+        }
+
+        // Every player points with the hand that is further in front. The first player also moves the mouse.
+        // The pointing hands move through the mole holes, their clicks strike the hole they are in.
+        if (opts.kinect_game_depth_ != depth_board)
+        {
+            depth_board = opts.kinect_game_depth_;
+            interaction->set_volumes(mole_board(depth_board));
+        }
+        auto const timestamp = k.frame().timestamp_;
+        bool first_player = true;
+        for (auto const & c : k.cursors())
+        {
+            bool hand_left_visible = c.left_visible_ && c.left_.Z >= 0.0;
+            bool hand_right_visible = c.right_visible_ && c.right_.Z >= 0.0;
+            bool both_visible = hand_left_visible && hand_right_visible;
+            bool use_right = hand_right_visible && !(both_visible && c.left_.Z > c.right_.Z);
+            auto const pointing = use_right ? InputSample::RightHand : InputSample::LeftHand;
+            interaction->release_hand(c.id_, use_right ? InputSample::LeftHand : InputSample::RightHand, timestamp);
+            if (!hand_left_visible && !hand_right_visible)
             {
-                use_right = true;
-                mouse_x = hand_right.X * WIDTH;
-                mouse_y = hand_right.Y * HEIGHT;
-                mouse_z = (1.5 - hand_right.Z) * HEIGHT;
+                interaction->release_hand(c.id_, pointing, timestamp);
+                continue;
             }
+            auto const & hand = use_right ? c.right_ : c.left_;
+            float mouse_x = hand.X * WIDTH;
+            float mouse_y = hand.Y * HEIGHT;
 
             // Check that the mouse is actually visible.
             if (mouse_x < 0 || mouse_x >= WIDTH || mouse_y < 0 || mouse_y >= HEIGHT)
-                hand_visible = false;
-        }
-        if (!hand_visible)
-        {
-            mouse_x = -1;
-            mouse_y = -1;
-            mouse_z = -1;
-        }
+            {
+                interaction->release_hand(c.id_, pointing, timestamp);
+                continue;
+            }
 
-        if (mouse_x != -1 && mouse_y != -1 && mouse_z != -1)
-        {
-            game.hover(mouse_x, mouse_y);
-
-            if (!opts.kinect_game_depth_)
-                mouse_z = mouse_y;
-
-            // Find the currently hovered field.
-            int fx = -1;
-            int fy = -1;
-            if (mouse_x < WIDTH/3.5)
-                fx = 0;
-            else if (mouse_x < 2.5*WIDTH/3.5)
-                fx = 1;
-            else
-                fx = 2;
-            if (mouse_z < HEIGHT/4.0)
-                fy = 0;
-            else if (mouse_z < 1.8*HEIGHT/4.0)
-                fy = 1;
-            else
-                fy = 2;
+            if (first_player)
+            {
+                game.hover(mouse_x, mouse_y);
+                first_player = false;
+            }
 
-            game.hover_field(fx, fy);
+            interaction->move_hand(c.id_, pointing, timestamp, hand);
+            timing.mark(MarkHovered);
         }
 
-        if (clicked_left && !use_right)
-            opts.mouse_clicked_ = true;
-        if (clicked_right && use_right)
-            opts.mouse_clicked_ = true;
-
         // Update the widgets.
         game.update(elapsed_time);
+        timing.mark(MarkUpdated);
 
         // Draw everything.
         window.clear();
         game.render(window);
+        timing.mark(MarkRendered);
         window.display();
+        timing.mark(MarkDisplayed);
+
+        // Collect the latencies and refresh the overlay twice per second.
+        if (new_frame)
+            latency.add(timing);
+        latency_overlay_time += elapsed_time;
+        if (latency_overlay->visible() && latency_overlay_time > 0.5f)
+        {
+            auto const & stats = k.frame_stats();
+            latency_overlay->text_ = latency.summary() + "\n" +
+                    to_string(stats.published_) + " frame sets, " + to_string(stats.skipped_) + " skipped, " +
+                    to_string(stats.duplicated_) + " repeated, " + to_string(stats.unsynchronized_) + " unsynchronized, " +
+                    to_string(stats.dropped_) + " dropped";
+            latency_overlay_time = 0;
+        }
 
         opts.mouse_clicked_ = false;
     }
+
+    if (!latency_file.empty())
+        latency.dump(latency_file);
 }
@@ -0,0 +1,342 @@
+#ifndef DEPTH_CODEC_HXX
+#define DEPTH_CODEC_HXX
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+
+#include "ndarray.hxx"
+#include "utility.hxx"
+
+namespace kin
+{
+
+/**
+ * @brief Lossless streaming codec for depth and label frames.
+ *
+ * Depth frames are predicted pixel by pixel, either spatially from the left, upper and upper left
+ * neighbours (keyframes, median edge predictor as in LOCO-I) or temporally from the same pixel of
+ * the previous frame (delta frames). The residuals are zigzag mapped and written as variable
+ * length integers. Runs of zero residuals, which are typical for holes and for the static
+ * background, are collapsed into a single token. Label frames are run length encoded.
+ *
+ * Token layout: A zero byte starts a run of zero residuals and is followed by the run length
+ * minus one as variable length integer. Any other byte starts a variable length integer with the
+ * zigzag mapped residual (7 bits per byte, least significant first, high bit set if more bytes follow).
+ */
+namespace codec
+{
+
+/**
+ * @brief Map a signed residual to an unsigned number (0, -1, 1, -2, 2, ... -> 0, 1, 2, 3, 4, ...).
+ */
+inline uint32_t zigzag(int32_t v)
+{
+    return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+}
+
+/**
+ * @brief Invert zigzag().
+ */
+inline int32_t unzigzag(uint32_t v)
+{
+    return static_cast<int32_t>(v >> 1) ^ -static_cast<int32_t>(v & 1);
+}
+
+/**
+ * @brief Write v as variable length integer and return the advanced pointer.
+ */
+inline uint8_t * put_varint(uint8_t * p, uint32_t v)
+{
+    while (v >= 0x80)
+    {
+        *p++ = static_cast<uint8_t>(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = static_cast<uint8_t>(v);
+    return p;
+}
+
+/**
+ * @brief Read a variable length integer and return the advanced pointer.
+ */
+inline uint8_t const * get_varint(uint8_t const * p, uint8_t const * end, uint32_t & v)
+{
+    v = 0;
+    for (unsigned int shift = 0; shift < 35; shift += 7)
+    {
+        if (p == end)
+            throw std::runtime_error("codec::get_varint(): Unexpected end of data.");
+        uint32_t const b = *p++;
+        v |= (b & 0x7F) << shift;
+        if ((b & 0x80) == 0)
+            return p;
+    }
+    throw std::runtime_error("codec::get_varint(): Corrupt data.");
+}
+
+/**
+ * @brief Median edge predictor (LOCO-I).
+ */
+inline int32_t predict_med(int32_t a, int32_t b, int32_t c)
+{
+    auto const mn = std::min(a, b);
+    auto const mx = std::max(a, b);
+    if (c >= mx)
+        return mn;
+    else if (c <= mn)
+        return mx;
+    else
+        return a + b - c;
+}
+
+/**
+ * @brief Encode the residuals of a frame. pred(i) returns the prediction of pixel i.
+ */
+template <typename PIXELS, typename PRED>
+void encode_residuals(PIXELS const * pixels, size_t n, PRED pred, std::vector<uint8_t> & out)
+{
+    // Worst case: three bytes per pixel.
+    auto const offset = out.size();
+    out.resize(offset + 3*n + 8);
+    uint8_t * p = &out[offset];
+    size_t zeros = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        auto const r = static_cast<int32_t>(pixels[i]) - pred(i);
+        if (r == 0)
+        {
+            ++zeros;
+            continue;
+        }
+        if (zeros > 0)
+        {
+            *p++ = 0;
+            p = put_varint(p, static_cast<uint32_t>(zeros-1));
+            zeros = 0;
+        }
+        p = put_varint(p, zigzag(r));
+    }
+    if (zeros > 0)
+    {
+        *p++ = 0;
+        p = put_varint(p, static_cast<uint32_t>(zeros-1));
+    }
+    out.resize(p - out.data());
+}
+
+} // namespace codec
+
+/**
+ * @brief Streaming encoder for depth frames. Every keyframe_interval-th frame is a keyframe that can be decoded on its own.
+ */
+class DepthEncoder
+{
+public:
+
+    explicit DepthEncoder(size_t keyframe_interval = 30)
+        :
+          keyframe_interval_(std::max<size_t>(1, keyframe_interval)),
+          count_(0)
+    {}
+
+    /**
+     * @brief Append the encoded frame to out and return whether it is a keyframe.
+     */
+    template <typename DEPTHARRAY>
+    bool encode(DEPTHARRAY const & depth, std::vector<uint8_t> & out);
+
+    /**
+     * @brief Start a new stream (the next frame is a keyframe).
+     */
+    void reset()
+    {
+        count_ = 0;
+    }
+
+private:
+
+    size_t keyframe_interval_; // distance between two keyframes
+    size_t count_; // number of frames since the last reset
+    Array2D<XnDepthPixel> prev_; // the previous frame
+
+};
+
+template <typename DEPTHARRAY>
+bool DepthEncoder::encode(DEPTHARRAY const & depth, std::vector<uint8_t> & out)
+{
+    auto const w = depth.width();
+    auto const h = depth.height();
+    auto const n = w*h;
+    XnDepthPixel const * pixels = &depth(0, 0);
+    bool const keyframe = count_ % keyframe_interval_ == 0 || prev_.width() != w || prev_.height() != h;
+    ++count_;
+
+    if (keyframe)
+    {
+        codec::encode_residuals(pixels, n, [pixels, w](size_t i) -> int32_t {
+            auto const x = i % w;
+            if (i < w)
+                return x == 0 ? 0 : pixels[i-1];
+            if (x == 0)
+                return pixels[i-w];
+            return codec::predict_med(pixels[i-1], pixels[i-w], pixels[i-w-1]);
+        }, out);
+        prev_.resize(w, h);
+    }
+    else
+    {
+        XnDepthPixel const * prev = prev_.data();
+        codec::encode_residuals(pixels, n, [prev](size_t i) -> int32_t {
+            return prev[i];
+        }, out);
+    }
+    std::copy(pixels, pixels + n, prev_.data());
+    return keyframe;
+}
+
+/**
+ * @brief Streaming decoder for depth frames that were created by a DepthEncoder.
+ */
+class DepthDecoder
+{
+public:
+
+    DepthDecoder()
+        :
+          has_prev_(false)
+    {}
+
+    /**
+     * @brief Decode the given frame into out (which must already have the correct shape).
+     * @note A delta frame can only be decoded directly after its predecessor.
+     */
+    void decode(uint8_t const * data, size_t size, bool keyframe, Array2D<XnDepthPixel> & out);
+
+    /**
+     * @brief Forget the previous frame (the next frame must be a keyframe).
+     */
+    void reset()
+    {
+        has_prev_ = false;
+    }
+
+private:
+
+    Array2D<XnDepthPixel> prev_; // the previous frame
+    bool has_prev_; // whether prev_ holds the previous frame
+
+};
+
+void DepthDecoder::decode(uint8_t const * data, size_t size, bool keyframe, Array2D<XnDepthPixel> & out)
+{
+    auto const w = out.width();
+    auto const n = out.width() * out.height();
+    if (!keyframe && (!has_prev_ || prev_.width() != out.width() || prev_.height() != out.height()))
+        throw std::runtime_error("DepthDecoder::decode(): Delta frame without predecessor.");
+    XnDepthPixel * pixels = out.data();
+    XnDepthPixel const * prev = prev_.data();
+
+    uint8_t const * p = data;
+    uint8_t const * end = data + size;
+    size_t i = 0;
+    while (i < n)
+    {
+        if (p == end)
+            throw std::runtime_error("DepthDecoder::decode(): Unexpected end of data.");
+
+        // Read the next token: either a run of zero residuals or a single residual.
+        size_t run = 1;
+        int32_t r = 0;
+        uint32_t v;
+        if (*p == 0)
+        {
+            p = codec::get_varint(p+1, end, v);
+            run = static_cast<size_t>(v) + 1;
+            if (run > n - i)
+                throw std::runtime_error("DepthDecoder::decode(): Corrupt data.");
+        }
+        else
+        {
+            p = codec::get_varint(p, end, v);
+            r = codec::unzigzag(v);
+        }
+
+        for (size_t k = 0; k < run; ++k, ++i)
+        {
+            int32_t pred;
+            if (!keyframe)
+                pred = prev[i];
+            else
+            {
+                auto const x = i % w;
+                if (i < w)
+                    pred = x == 0 ? 0 : pixels[i-1];
+                else if (x == 0)
+                    pred = pixels[i-w];
+                else
+                    pred = codec::predict_med(pixels[i-1], pixels[i-w], pixels[i-w-1]);
+            }
+            pixels[i] = static_cast<XnDepthPixel>(pred + r);
+        }
+    }
+
+    prev_.resize(out.width(), out.height());
+    std::copy(pixels, pixels + n, prev_.data());
+    has_prev_ = true;
+}
+
+/**
+ * @brief Append the run length encoded labels to out. Each run is stored as label and run length minus one (both variable length integers).
+ */
+template <typename USERARRAY>
+void encode_labels(USERARRAY const & labels, std::vector<uint8_t> & out)
+{
+    auto const n = labels.width() * labels.height();
+    if (n == 0)
+        return;
+    XnLabel const * pixels = &labels(0, 0);
+    auto const offset = out.size();
+    out.resize(offset + 8*n + 8);
+    uint8_t * p = &out[offset];
+    size_t i = 0;
+    while (i < n)
+    {
+        auto const label = pixels[i];
+        size_t j = i+1;
+        while (j < n && pixels[j] == label)
+            ++j;
+        p = codec::put_varint(p, label);
+        p = codec::put_varint(p, static_cast<uint32_t>(j-i-1));
+        i = j;
+    }
+    out.resize(p - out.data());
+}
+
+/**
+ * @brief Decode labels that were created by encode_labels() into out (which must already have the correct shape).
+ */
+void decode_labels(uint8_t const * data, size_t size, Array2D<XnLabel> & out)
+{
+    auto const n = out.width() * out.height();
+    XnLabel * pixels = out.data();
+    uint8_t const * p = data;
+    uint8_t const * end = data + size;
+    size_t i = 0;
+    while (i < n)
+    {
+        uint32_t label, run;
+        p = codec::get_varint(p, end, label);
+        p = codec::get_varint(p, end, run);
+        if (run >= n - i)
+            throw std::runtime_error("decode_labels(): Corrupt data.");
+        std::fill(pixels + i, pixels + i + run + 1, static_cast<XnLabel>(label));
+        i += run + 1;
+    }
+}
+
+} // namespace kin
+
+#endif
@@ -0,0 +1,449 @@
+#ifndef DEPTH_FILTER_HXX
+#define DEPTH_FILTER_HXX
+
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "platform_support.hxx"
+#ifdef OPENNI_FOUND
+#include <XnCppWrapper.h>
+#endif
+
+#include "ndarray.hxx"
+#include "utility.hxx"
+#include "thread_pool.hxx"
+
+namespace kin
+{
+
+/**
+ * @brief The DepthFilterOptions struct selects the temporal filter and the hole filling of the DepthFilter.
+ */
+struct DepthFilterOptions
+{
+    /**
+     * @brief How the depth of a pixel is combined with its previous frames.
+     */
+    enum Temporal
+    {
+        None, // no temporal filter
+        Exponential, // exponential smoothing that follows jumps at once and bridges short holes
+        Median // median of the valid depths of the last three frames
+    };
+
+    explicit DepthFilterOptions(Temporal temporal = None, size_t hole_passes = 0)
+        :
+          temporal_(temporal),
+          alpha_(0.5f),
+          jump_(100),
+          hold_frames_(3),
+          hole_passes_(hole_passes)
+    {}
+
+    /**
+     * @brief Return whether the filter changes the depth at all.
+     */
+    bool enabled() const
+    {
+        return temporal_ != None || hole_passes_ > 0;
+    }
+
+    Temporal temporal_; // the temporal filter
+    float alpha_; // weight of the new depth in the exponential smoothing (0 < alpha <= 1)
+    XnDepthPixel jump_; // depth changes above this (mm) are taken at once instead of being smoothed (at most 16383)
+    size_t hold_frames_; // the exponential smoothing keeps the previous depth for this many frames without depth
+    size_t hole_passes_; // number of hole filling passes, each fills holes up to one pixel further from the valid depth
+};
+
+namespace denoise
+{
+
+/**
+ * @brief Exponential smoothing of n pixels: state = state + alpha * (depth - state).
+ *
+ * coef is alpha * 32768. New depth without previous depth or more than jump away from it is taken
+ * at once. A pixel without depth keeps its state for hold frames, age counts its frames without
+ * depth. The SSE2 path computes exactly the same as the scalar one.
+ */
+inline void exponential_row(
+        XnDepthPixel const * depth,
+        XnDepthPixel * state,
+        XnDepthPixel * age,
+        size_t n,
+        short coef,
+        XnDepthPixel jump,
+        XnDepthPixel hold
+){
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const one = _mm_set1_epi16(1);
+    __m128i const c = _mm_set1_epi16(coef);
+    __m128i const j = _mm_set1_epi16(static_cast<short>(jump));
+    __m128i const h = _mm_set1_epi16(static_cast<short>(hold));
+    for (; i+8 <= n; i += 8)
+    {
+        auto const v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(depth+i));
+        auto const p = _mm_loadu_si128(reinterpret_cast<__m128i const *>(state+i));
+        auto const a = _mm_loadu_si128(reinterpret_cast<__m128i const *>(age+i));
+        auto const missing = _mm_cmpeq_epi16(v, zero);
+
+        // Pixels without depth: count the age and keep the state while it is young enough.
+        auto const older = _mm_adds_epu16(a, one);
+        auto const held = _mm_and_si128(_mm_cmpeq_epi16(_mm_subs_epu16(older, h), zero), p);
+
+        // Pixels with depth: smooth, unless there is no state or the depth jumped.
+        auto const diff = _mm_or_si128(_mm_subs_epu16(v, p), _mm_subs_epu16(p, v));
+        auto const small = _mm_cmpeq_epi16(_mm_subs_epu16(diff, j), zero);
+        auto const take = _mm_or_si128(_mm_cmpeq_epi16(p, zero), _mm_andnot_si128(small, _mm_set1_epi16(-1)));
+        auto const delta = _mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(v, p), 1), c);
+        auto const smooth = _mm_add_epi16(p, delta);
+        auto const filtered = _mm_or_si128(_mm_and_si128(take, v), _mm_andnot_si128(take, smooth));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(state+i), _mm_or_si128(_mm_and_si128(missing, held), _mm_andnot_si128(missing, filtered)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(age+i), _mm_and_si128(missing, older));
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        auto const v = depth[i];
+        auto const p = state[i];
+        if (v == 0)
+        {
+            age[i] = age[i] == 0xFFFF ? age[i] : static_cast<XnDepthPixel>(age[i] + 1);
+            state[i] = age[i] <= hold ? p : 0;
+        }
+        else
+        {
+            age[i] = 0;
+            auto const d = static_cast<int>(v) - static_cast<int>(p);
+            if (p == 0 || std::abs(d) > jump)
+                state[i] = v;
+            else
+                state[i] = static_cast<XnDepthPixel>(p + ((2 * d * coef) >> 16));
+        }
+    }
+}
+
+/**
+ * @brief Write the median of the valid depths of a, b and c to out. Of two valid depths, the farther one is taken.
+ *
+ * The depths are shifted by -1, so 0 wraps to the largest value and invalid pixels sort last.
+ */
+inline void median_row(
+        XnDepthPixel const * a,
+        XnDepthPixel const * b,
+        XnDepthPixel const * c,
+        size_t n,
+        XnDepthPixel * out
+){
+    size_t i = 0;
+#ifdef __SSE2__
+    // SSE2 only compares signed 16 bit values, flipping the sign bit keeps the unsigned order.
+    __m128i const one = _mm_set1_epi16(1);
+    __m128i const sign = _mm_set1_epi16(static_cast<short>(0x8000));
+    __m128i const invalid = _mm_set1_epi16(0x7FFF);
+    for (; i+8 <= n; i += 8)
+    {
+        auto const sa = _mm_xor_si128(_mm_sub_epi16(_mm_loadu_si128(reinterpret_cast<__m128i const *>(a+i)), one), sign);
+        auto const sb = _mm_xor_si128(_mm_sub_epi16(_mm_loadu_si128(reinterpret_cast<__m128i const *>(b+i)), one), sign);
+        auto const sc = _mm_xor_si128(_mm_sub_epi16(_mm_loadu_si128(reinterpret_cast<__m128i const *>(c+i)), one), sign);
+        auto const lo = _mm_min_epi16(sa, sb);
+        auto const hi = _mm_max_epi16(sa, sb);
+        auto const med = _mm_max_epi16(lo, _mm_min_epi16(hi, sc));
+        auto const low = _mm_min_epi16(lo, sc);
+        auto const use_low = _mm_cmpeq_epi16(med, invalid);
+        auto const r = _mm_or_si128(_mm_and_si128(use_low, low), _mm_andnot_si128(use_low, med));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out+i), _mm_add_epi16(_mm_xor_si128(r, sign), one));
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        XnDepthPixel const sa = a[i] - 1;
+        XnDepthPixel const sb = b[i] - 1;
+        XnDepthPixel const sc = c[i] - 1;
+        auto const lo = std::min(sa, sb);
+        auto const hi = std::max(sa, sb);
+        auto const med = std::max(lo, std::min(hi, sc));
+        auto const r = med == 0xFFFF ? std::min(lo, sc) : med;
+        out[i] = static_cast<XnDepthPixel>(r + 1);
+    }
+}
+
+/**
+ * @brief Fill the holes of a row: Pixels without depth get the farthest depth of their 3x3 neighborhood.
+ *
+ * Holes are mostly shadows of the foreground on the background, so the farthest neighbor is taken.
+ * above and below are the neighboring rows (the row itself at the borders).
+ */
+inline void fill_row(
+        XnDepthPixel const * above,
+        XnDepthPixel const * row,
+        XnDepthPixel const * below,
+        size_t n,
+        XnDepthPixel * out
+){
+    auto const column_max = [&](size_t x){
+        return std::max(row[x], std::max(above[x], below[x]));
+    };
+    auto const fill = [&](size_t x){
+        if (row[x] != 0)
+            return row[x];
+        auto const x0 = x == 0 ? 0 : x-1;
+        auto const x1 = x+1 == n ? x : x+1;
+        return std::max(column_max(x0), std::max(column_max(x), column_max(x1)));
+    };
+    if (n == 0)
+        return;
+    out[0] = fill(0);
+    size_t i = 1;
+#ifdef __SSE2__
+    // The unsigned maximum is max(a, b) = (a -sat b) + b.
+    auto const max16 = [](__m128i a, __m128i b){ return _mm_adds_epu16(_mm_subs_epu16(a, b), b); };
+    auto const load = [](XnDepthPixel const * p){ return _mm_loadu_si128(reinterpret_cast<__m128i const *>(p)); };
+    __m128i const zero = _mm_setzero_si128();
+    for (; i+9 <= n; i += 8)
+    {
+        auto const left = max16(load(row+i-1), max16(load(above+i-1), load(below+i-1)));
+        auto const center = load(row+i);
+        auto const middle = max16(center, max16(load(above+i), load(below+i)));
+        auto const right = max16(load(row+i+1), max16(load(above+i+1), load(below+i+1)));
+        auto const neighbors = max16(left, max16(middle, right));
+        auto const hole = _mm_cmpeq_epi16(center, zero);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out+i), _mm_or_si128(_mm_and_si128(hole, neighbors), center));
+    }
+#endif
+    for (; i < n; ++i)
+        out[i] = fill(i);
+}
+
+} // namespace denoise
+
+/**
+ * @brief The DepthFilter class reduces the flicker and fills the holes of consecutive depth frames.
+ *
+ * A temporal filter (see DepthFilterOptions::Temporal) combines each pixel with its previous frames,
+ * then a number of passes fill holes from their neighbors. The temporal state is kept without the
+ * filled holes, so filled depth does not linger. All stages work on bands of rows that are split
+ * among the threads of a pool, the rows are processed with SSE2. The pool belongs to the owner of
+ * the filter (e. g. the Sensor, which shares it with the user segmentation).
+ */
+class DepthFilter
+{
+public:
+
+    explicit DepthFilter(DepthFilterOptions const & options = DepthFilterOptions(), ThreadPool * pool = nullptr)
+        :
+          options_(options),
+          pool_(pool),
+          num_frames_(0)
+    {
+        set_options(options);
+    }
+
+    /**
+     * @brief Select other options. The temporal state is reset.
+     */
+    void set_options(DepthFilterOptions const & options);
+
+    DepthFilterOptions const & options() const
+    {
+        return options_;
+    }
+
+    /**
+     * @brief Split the rows among the threads of the given pool (nullptr: the calling thread filters alone).
+     *
+     * The pool is not owned, it must live until it is replaced or the filter is destroyed.
+     */
+    void set_pool(ThreadPool * pool)
+    {
+        pool_ = pool;
+    }
+
+    /**
+     * @brief Filter the depth in place.
+     *
+     * If new_depth is false, the depth is not a new frame, e. g. if only the labels were updated.
+     * It is then replaced by the filtered depth of the previous frame.
+     */
+    void apply(Array2D<XnDepthPixel> & depth, bool new_depth = true);
+
+    /**
+     * @brief Reset the temporal state, e. g. when the sensor restarts.
+     */
+    void reset()
+    {
+        num_frames_ = 0;
+    }
+
+private:
+
+    /**
+     * @brief Call f(row_begin, row_end) on bands of rows, using the pool if there is one.
+     */
+    void for_rows(size_t height, ThreadPool::Task const & f);
+
+    /**
+     * @brief Combine the new depth with the previous frames into temporal_.
+     */
+    void filter_temporal(Array2D<XnDepthPixel> const & depth);
+
+    /**
+     * @brief Fill the holes of temporal_ and write the result to depth.
+     */
+    void fill_holes(Array2D<XnDepthPixel> & depth);
+
+    static size_t const band_rows = 16; // rows per task of the pool
+
+    DepthFilterOptions options_; // the options
+    ThreadPool * pool_; // the threads that share the rows (not owned, nullptr: the calling thread only)
+    size_t num_frames_; // number of filtered frames since the last reset
+    Array2D<XnDepthPixel> temporal_; // the temporally filtered depth without filled holes
+    Array2D<XnDepthPixel> age_; // frames without depth per pixel (exponential)
+    Array2D<XnDepthPixel> history_[3]; // the last three frames (median)
+    Array2D<XnDepthPixel> scratch_; // the intermediate result of the hole filling passes
+
+};
+
+void DepthFilter::set_options(DepthFilterOptions const & options)
+{
+    if (options.alpha_ <= 0.0f || options.alpha_ > 1.0f)
+        throw std::runtime_error("DepthFilter::set_options(): alpha must be in (0, 1].");
+    if (options.jump_ > 16383)
+        throw std::runtime_error("DepthFilter::set_options(): The jump must not exceed 16383 mm.");
+    options_ = options;
+    num_frames_ = 0;
+}
+
+void DepthFilter::for_rows(size_t height, ThreadPool::Task const & f)
+{
+    if (pool_)
+        pool_->parallel_for(0, height, band_rows, f);
+    else
+        f(0, height);
+}
+
+void DepthFilter::apply(Array2D<XnDepthPixel> & depth, bool new_depth)
+{
+    if (!options_.enabled())
+        return;
+    auto const w = depth.width();
+    auto const h = depth.height();
+    if (temporal_.width() != w || temporal_.height() != h)
+    {
+        temporal_.resize(w, h);
+        num_frames_ = 0;
+    }
+    if (new_depth || num_frames_ == 0)
+    {
+        filter_temporal(depth);
+        ++num_frames_;
+    }
+    fill_holes(depth);
+}
+
+void DepthFilter::filter_temporal(Array2D<XnDepthPixel> const & depth)
+{
+    auto const w = depth.width();
+    auto const h = depth.height();
+    if (options_.temporal_ == DepthFilterOptions::Exponential)
+    {
+        if (num_frames_ == 0)
+        {
+            age_.resize(w, h);
+            std::fill(age_.begin(), age_.end(), 0);
+            std::fill(temporal_.begin(), temporal_.end(), 0);
+        }
+        auto const coef = static_cast<short>(std::min(32767.0f, std::round(options_.alpha_ * 32768.0f)));
+        auto const hold = static_cast<XnDepthPixel>(std::min<size_t>(options_.hold_frames_, 0xFFFF));
+        for_rows(h, [&](size_t row_begin, size_t row_end){
+            for (size_t y = row_begin; y < row_end; ++y)
+                denoise::exponential_row(&depth(0, y), &temporal_(0, y), &age_(0, y), w, coef, options_.jump_, hold);
+        });
+    }
+    else if (options_.temporal_ == DepthFilterOptions::Median)
+    {
+        // The first frame fills the whole history, so the median starts with it.
+        auto const slot = num_frames_ % 3;
+        for (size_t k = 0; k < 3; ++k)
+        {
+            if (num_frames_ == 0 || k == slot)
+            {
+                history_[k].resize(w, h);
+                std::copy(depth.begin(), depth.end(), history_[k].begin());
+            }
+        }
+        for_rows(h, [&](size_t row_begin, size_t row_end){
+            for (size_t y = row_begin; y < row_end; ++y)
+                denoise::median_row(&history_[0](0, y), &history_[1](0, y), &history_[2](0, y), w, &temporal_(0, y));
+        });
+    }
+    else
+    {
+        std::copy(depth.begin(), depth.end(), temporal_.begin());
+    }
+}
+
+void DepthFilter::fill_holes(Array2D<XnDepthPixel> & depth)
+{
+    auto const w = depth.width();
+    auto const h = depth.height();
+    auto const passes = options_.hole_passes_;
+    if (passes == 0)
+    {
+        std::copy(temporal_.begin(), temporal_.end(), depth.begin());
+        return;
+    }
+    if (passes > 1 && (scratch_.width() != w || scratch_.height() != h))
+        scratch_.resize(w, h);
+
+    // The passes alternate between depth and scratch_, so that the last one writes to depth.
+    // Each pass reads the result of the previous one, so the passes are split among the threads one after another.
+    Array2D<XnDepthPixel> const * in = &temporal_;
+    for (size_t i = 0; i < passes; ++i)
+    {
+        auto & out = (passes - 1 - i) % 2 == 0 ? depth : scratch_;
+        auto const & src = *in;
+        for_rows(h, [&](size_t row_begin, size_t row_end){
+            for (size_t y = row_begin; y < row_end; ++y)
+                denoise::fill_row(&src(0, y == 0 ? 0 : y-1), &src(0, y), &src(0, y+1 == h ? y : y+1), w, &out(0, y));
+        });
+        in = &out;
+    }
+}
+
+/**
+ * @brief Parse a depth filter of the form "temporal[,passes]", where temporal is none, median, exp or exp:alpha (see DepthFilterOptions).
+ */
+DepthFilterOptions parse_depth_filter(std::string const & spec)
+{
+    auto const comma = spec.find(',');
+    auto const temporal = spec.substr(0, comma);
+    DepthFilterOptions options;
+    if (temporal == "none")
+        options.temporal_ = DepthFilterOptions::None;
+    else if (temporal == "median")
+        options.temporal_ = DepthFilterOptions::Median;
+    else if (temporal == "exp" || temporal.compare(0, 4, "exp:") == 0)
+    {
+        options.temporal_ = DepthFilterOptions::Exponential;
+        if (temporal.size() > 4)
+            options.alpha_ = std::stof(temporal.substr(4));
+    }
+    else
+        throw std::runtime_error("parse_depth_filter(): Unknown temporal filter: " + temporal);
+    if (comma != std::string::npos)
+        options.hole_passes_ = std::stoul(spec.substr(comma+1));
+    return options;
+}
+
+} // namespace kin
+
+#endif
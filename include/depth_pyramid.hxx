@@ -0,0 +1,195 @@
+#ifndef DEPTH_PYRAMID_HXX
+#define DEPTH_PYRAMID_HXX
+
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+#include <utility>
+
+#include "platform_support.hxx"
+#ifdef OPENNI_FOUND
+#include <XnCppWrapper.h>
+#endif
+
+#include "ndarray.hxx"
+#include "utility.hxx"
+
+namespace kin
+{
+
+/**
+ * @brief The DepthPyramidOptions struct selects the levels of the DepthPyramid and how 2x2 blocks are reduced.
+ */
+struct DepthPyramidOptions
+{
+    /**
+     * @brief How the valid (non-zero) depths of a 2x2 block are combined. A block without valid depth stays 0.
+     */
+    enum Reduction
+    {
+        Min, // the nearest depth: keeps thin objects such as arms, good for presence and hit checks
+        Median // the (lower) median depth: less noisy, good for previews
+    };
+
+    explicit DepthPyramidOptions(size_t levels = 3, Reduction reduction = Min)
+        :
+          levels_(levels),
+          reduction_(reduction)
+    {}
+
+    size_t levels_; // number of reduced levels (0: no pyramid)
+    Reduction reduction_; // the reduction of the 2x2 blocks
+};
+
+/**
+ * @brief The DepthPyramid class holds downsampled versions of a depth image.
+ *
+ * Level i is reduced by 2^i in both directions and is computed from level i-1, so a 640x480 image
+ * yields 320x240, 160x120 and 80x60 with the default options. Invalid pixels (depth 0) are ignored
+ * by the reduction. The level arrays are kept, so building a pyramid of the same shape again does
+ * not allocate.
+ */
+class DepthPyramid
+{
+public:
+
+    DepthPyramid()
+        :
+          num_levels_(0)
+    {}
+
+    /**
+     * @brief Build the levels from the given depth image.
+     */
+    void build(Array2D<XnDepthPixel> const & depth, DepthPyramidOptions const & options);
+
+    /**
+     * @brief Return the number of reduced levels.
+     */
+    size_t levels() const
+    {
+        return num_levels_;
+    }
+
+    /**
+     * @brief Return the level i (1 <= i <= levels()), which is reduced by 2^i.
+     */
+    Array2D<XnDepthPixel> const & level(size_t i) const
+    {
+        if (i == 0 || i > num_levels_)
+            throw std::runtime_error("DepthPyramid::level(): Level not available.");
+        return levels_[i-1];
+    }
+
+private:
+
+    /**
+     * @brief Reduce each 2x2 block of in to one pixel of out. Odd borders repeat the last row or column.
+     */
+    template <typename REDUCE>
+    static void reduce(Array2D<XnDepthPixel> const & in, Array2D<XnDepthPixel> & out, REDUCE reduce_block);
+
+    std::vector<Array2D<XnDepthPixel> > levels_; // the reduced levels (capacity may exceed num_levels_)
+    size_t num_levels_; // number of valid levels
+
+};
+
+namespace pyramid
+{
+
+/**
+ * @brief Return the nearest valid depth of the block or 0 if no depth is valid.
+ *
+ * Subtracting 1 maps the invalid 0 to the largest value, so a plain minimum skips it.
+ */
+inline XnDepthPixel reduce_min(XnDepthPixel a, XnDepthPixel b, XnDepthPixel c, XnDepthPixel d)
+{
+    XnDepthPixel const m = std::min(std::min(XnDepthPixel(a-1), XnDepthPixel(b-1)),
+                                    std::min(XnDepthPixel(c-1), XnDepthPixel(d-1)));
+    return XnDepthPixel(m+1);
+}
+
+/**
+ * @brief Return the lower median of the valid depths of the block or 0 if no depth is valid.
+ */
+inline XnDepthPixel reduce_median(XnDepthPixel a, XnDepthPixel b, XnDepthPixel c, XnDepthPixel d)
+{
+    // Sort with a network of five compare-exchanges. The invalid zeros end up in front.
+    XnDepthPixel s[4] = {a, b, c, d};
+    auto const cmp_swap = [&s](int i, int j){
+        if (s[j] < s[i])
+            std::swap(s[i], s[j]);
+    };
+    cmp_swap(0, 1);
+    cmp_swap(2, 3);
+    cmp_swap(0, 2);
+    cmp_swap(1, 3);
+    cmp_swap(1, 2);
+    int const invalid = (a == 0) + (b == 0) + (c == 0) + (d == 0);
+    if (invalid == 4)
+        return 0;
+    return s[invalid + (3 - invalid) / 2];
+}
+
+} // namespace pyramid
+
+template <typename REDUCE>
+void DepthPyramid::reduce(Array2D<XnDepthPixel> const & in, Array2D<XnDepthPixel> & out, REDUCE reduce_block)
+{
+    auto const w = in.width();
+    auto const h = in.height();
+    auto const ow = (w+1) / 2;
+    auto const oh = (h+1) / 2;
+    if (out.width() != ow || out.height() != oh)
+        out.resize(ow, oh);
+    for (size_t y = 0; y < oh; ++y)
+    {
+        auto const r0 = &in(0, 2*y);
+        auto const r1 = &in(0, std::min(2*y+1, h-1));
+        auto const o = &out(0, y);
+        for (size_t x = 0; x < w/2; ++x)
+            o[x] = reduce_block(r0[2*x], r0[2*x+1], r1[2*x], r1[2*x+1]);
+        if (w % 2 != 0)
+            o[ow-1] = reduce_block(r0[w-1], r0[w-1], r1[w-1], r1[w-1]);
+    }
+}
+
+void DepthPyramid::build(Array2D<XnDepthPixel> const & depth, DepthPyramidOptions const & options)
+{
+    if (levels_.size() < options.levels_)
+        levels_.resize(options.levels_);
+    num_levels_ = options.levels_;
+    for (size_t i = 0; i < num_levels_; ++i)
+    {
+        auto const & in = i == 0 ? depth : levels_[i-1];
+        if (options.reduction_ == DepthPyramidOptions::Median)
+            reduce(in, levels_[i], pyramid::reduce_median);
+        else
+            reduce(in, levels_[i], pyramid::reduce_min);
+    }
+}
+
+/**
+ * @brief Parse a pyramid of the form "levels[,min|median]" (see DepthPyramidOptions).
+ */
+DepthPyramidOptions parse_depth_pyramid(std::string const & spec)
+{
+    auto const comma = spec.find(',');
+    DepthPyramidOptions options(std::stoul(spec.substr(0, comma)));
+    if (comma != std::string::npos)
+    {
+        auto const reduction = spec.substr(comma+1);
+        if (reduction == "min")
+            options.reduction_ = DepthPyramidOptions::Min;
+        else if (reduction == "median")
+            options.reduction_ = DepthPyramidOptions::Median;
+        else
+            throw std::runtime_error("parse_depth_pyramid(): Unknown reduction: " + reduction);
+    }
+    return options;
+}
+
+} // namespace kin
+
+#endif
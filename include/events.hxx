@@ -7,6 +7,7 @@
 #include <functional>
 
 #include "utility.hxx"
+#include "input_queue.hxx"
 
 namespace kin
 {
@@ -55,10 +56,65 @@ public:
         float elapsed_time_;
     };
 
-    struct FieldHoverEvent
+    /**
+     * @brief An input sample of a player (see InputSample), used by KinectClick, HandMoved, UserEntered and UserLeft.
+     */
+    struct InputEvent
+    {
+        int player_; // the user id
+        int hand_; // the hand (see InputSample::Hand)
+        float x_; // the normalized hand position
+        float y_;
+        float z_;
+        XnUInt64 timestamp_; // the sensor timestamp in microseconds
+    };
+
+    /**
+     * @brief A gesture of a hand that was recognized by the GestureEngine.
+     */
+    struct GestureEvent
     {
-        int x_;
-        int y_;
+        enum Type
+        {
+            SwipeLeft,
+            SwipeRight,
+            SwipeUp,
+            SwipeDown,
+            Push, // the hand moved towards the sensor
+            Hold, // the hand rested at one place
+            Circle // the hand drew a circle
+        };
+
+        Type gesture_; // the recognized gesture
+        int player_; // the user id
+        int hand_; // the hand (see InputSample::Hand)
+        float x_; // the normalized hand position when the gesture was recognized
+        float y_;
+        float z_;
+        float value_; // swipes and push: speed in units per second, hold: duration in seconds, circle: +1 clockwise, -1 counterclockwise (on the screen)
+        XnUInt64 timestamp_; // the sensor timestamp in microseconds
+    };
+
+    /**
+     * @brief A hand that entered, left or struck an interaction volume (see InteractionEngine).
+     */
+    struct InteractionEvent
+    {
+        enum Type
+        {
+            Enter, // the hand moved into the volume
+            Leave, // the hand moved out of the volume or is not followed anymore
+            Strike // the hand clicked inside of the volume
+        };
+
+        Type interaction_; // what happened
+        int volume_; // the index of the volume
+        int player_; // the user id
+        int hand_; // the hand (see InputSample::Hand)
+        float x_; // the normalized hand position
+        float y_;
+        float z_;
+        XnUInt64 timestamp_; // the sensor timestamp in microseconds
     };
 
     enum EventType
@@ -68,8 +124,12 @@ public:
         Close,
         MoleHit,
         KinectClick,
-        FieldHover,
-        ToggleSound
+        ToggleSound,
+        HandMoved,
+        UserEntered,
+        UserLeft,
+        Gesture,
+        Interaction
     };
 
     Event(EventType type)
@@ -89,7 +149,9 @@ public:
     {
         ChangeScreenEvent change_screen_;
         TickEvent tick_;
-        FieldHoverEvent field_hover_;
+        InputEvent input_;
+        GestureEvent gesture_;
+        InteractionEvent interaction_;
     };
 
 };
@@ -149,6 +211,16 @@ public:
 //            listeners_.erase(it);
 //    }
 
+    /**
+     * @brief Drain the given input queue at the start of each tick and post its samples as events (KinectClick, HandMoved, UserEntered, UserLeft).
+     *
+     * The event manager is the only consumer of the queue. Pass nullptr to detach it.
+     */
+    void attach_input(std::shared_ptr<InputQueue> queue)
+    {
+        input_ = queue;
+    }
+
     void add_delayed_call(float delay, std::function<void()> f)
     {
         delayed_calls_.emplace_back(delay, f);
@@ -158,6 +230,10 @@ public:
     {
         if (event.type_ == Event::Tick)
         {
+            // Queue the inputs that arrived since the last tick before the other events are passed on.
+            if (input_)
+                drain_input();
+
             // Check if a delayed event should be fired.
             for (auto & e : delayed_calls_)
             {
@@ -202,9 +278,35 @@ public:
 
 private:
 
+    /**
+     * @brief Move the samples of the input queue into the event queue.
+     */
+    void drain_input()
+    {
+        static Event::EventType const types[] = {
+            Event::HandMoved, // InputSample::HandMoved
+            Event::KinectClick, // InputSample::Click
+            Event::UserEntered, // InputSample::UserEntered
+            Event::UserLeft // InputSample::UserLeft
+        };
+        InputSample sample;
+        while (input_->pop(sample))
+        {
+            Event ev(types[sample.type_]);
+            ev.input_.player_ = sample.user_;
+            ev.input_.hand_ = sample.hand_;
+            ev.input_.x_ = sample.position_.X;
+            ev.input_.y_ = sample.position_.Y;
+            ev.input_.z_ = sample.position_.Z;
+            ev.input_.timestamp_ = sample.timestamp_;
+            queue_.push(ev);
+        }
+    }
+
     std::vector<ListenerPointer> listeners_;
     std::queue<Event> queue_;
     std::vector<DelayedCall> delayed_calls_;
+    std::shared_ptr<InputQueue> input_; // the input samples of the sensor
 
 };
 
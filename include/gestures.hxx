@@ -0,0 +1,632 @@
+#ifndef GESTURES_HXX
+#define GESTURES_HXX
+
+#include <array>
+#include <vector>
+#include <cmath>
+#include <functional>
+#include <algorithm>
+
+#include "platform_support.hxx"
+#ifdef OPENNI_FOUND
+#include <XnCppWrapper.h>
+#endif
+
+#include "events.hxx"
+#include "input_queue.hxx"
+
+namespace kin
+{
+
+/**
+ * @brief The GestureOptions struct holds the thresholds of the gesture recognizers.
+ *
+ * The distances are in the normalized hand coordinates of the cursors (the screen is 1 wide and 1 high).
+ */
+struct GestureOptions
+{
+    GestureOptions()
+        :
+          swipe_distance_(0.3f),
+          swipe_duration_(0.5f),
+          swipe_ratio_(0.5f),
+          push_distance_(0.25f),
+          push_duration_(0.4f),
+          cooldown_(0.4f),
+          hold_radius_(0.04f),
+          hold_duration_(1.0f),
+          circle_radius_(0.06f),
+          circle_duration_(2.0f),
+          max_gap_(0.3f)
+    {}
+
+    float swipe_distance_; // minimum distance of a swipe
+    float swipe_duration_; // maximum duration of a swipe in seconds
+    float swipe_ratio_; // maximum sideways movement of a swipe or push relative to its distance
+    float push_distance_; // minimum distance of a push towards the sensor
+    float push_duration_; // maximum duration of a push in seconds
+    float cooldown_; // time after a swipe or push in which the hand does not swipe or push again (ignores the way back)
+    float hold_radius_; // the hand must stay inside of this radius to hold
+    float hold_duration_; // time in seconds until a hold is recognized
+    float circle_radius_; // minimum mean radius of a circle
+    float circle_duration_; // maximum duration of a circle in seconds
+    float max_gap_; // the hand is tracked anew if no sample arrived for this many seconds
+};
+
+/**
+ * @brief The GestureSample struct is a hand position at a point in time.
+ */
+struct GestureSample
+{
+    double t_; // the time in seconds
+    float p_[3]; // the normalized hand position (x, y, z)
+};
+
+/**
+ * @brief The GestureTrail class keeps the last N samples of a hand in a ring buffer.
+ *
+ * Each sample gets a sequence number. The samples with the numbers newest()-N+1 to newest() are available.
+ */
+template <size_t N>
+class GestureTrail
+{
+public:
+
+    GestureTrail()
+        :
+          count_(0)
+    {}
+
+    static size_t capacity()
+    {
+        return N;
+    }
+
+    void push(GestureSample const & s)
+    {
+        samples_[count_ % N] = s;
+        ++count_;
+    }
+
+    bool empty() const
+    {
+        return count_ == 0;
+    }
+
+    /**
+     * @brief Return the sequence number of the newest sample.
+     */
+    size_t newest() const
+    {
+        return count_-1;
+    }
+
+    GestureSample const & back() const
+    {
+        return samples_[(count_-1) % N];
+    }
+
+    GestureSample const & operator[](size_t seq) const
+    {
+        return samples_[seq % N];
+    }
+
+    void clear()
+    {
+        count_ = 0;
+    }
+
+private:
+
+    std::array<GestureSample, N> samples_; // the ring buffer
+    size_t count_; // number of pushed samples
+
+};
+
+size_t const hand_trail_size = 64; // number of samples that are kept per hand (2 seconds at 30 fps)
+
+typedef GestureTrail<hand_trail_size> HandTrail;
+
+/**
+ * @brief The SwipeRecognizer class recognizes a fast movement along one axis.
+ *
+ * The movement is measured from the oldest sample that is not older than the maximum duration. The
+ * window only moves forward, so each sample is passed over once: the cost per sample is O(1).
+ */
+class SwipeRecognizer
+{
+public:
+
+    SwipeRecognizer(int axis, float direction, float distance, float duration, float ratio)
+        :
+          axis_(axis),
+          direction_(direction),
+          distance_(distance),
+          duration_(duration),
+          ratio_(ratio),
+          start_(0)
+    {}
+
+    /**
+     * @brief Start a new window at the given sample.
+     */
+    void reset(size_t seq)
+    {
+        start_ = seq;
+    }
+
+    /**
+     * @brief Check the newest sample of the trail. If it completes a swipe, store its speed in value and return true.
+     */
+    bool add(HandTrail const & trail, float & value);
+
+private:
+
+    int axis_; // the axis of the movement (0: x, 1: y, 2: z)
+    float direction_; // +1 or -1
+    float distance_; // minimum distance
+    float duration_; // maximum duration
+    float ratio_; // maximum sideways movement relative to the distance
+    size_t start_; // the first sample of the window
+
+};
+
+bool SwipeRecognizer::add(HandTrail const & trail, float & value)
+{
+    auto const seq = trail.newest();
+    auto const & cur = trail.back();
+    while (start_ < seq && (seq - start_ + 1 >= trail.capacity() || cur.t_ - trail[start_].t_ > duration_))
+        ++start_;
+
+    auto const & first = trail[start_];
+    float d[3];
+    for (int i = 0; i < 3; ++i)
+        d[i] = cur.p_[i] - first.p_[i];
+    auto const along = direction_ * d[axis_];
+    if (along < distance_)
+        return false;
+
+    // A swipe is judged on the screen, a push towards the sensor may not move sideways in either direction.
+    float sideways = 0.0f;
+    if (axis_ == 0)
+        sideways = std::abs(d[1]);
+    else if (axis_ == 1)
+        sideways = std::abs(d[0]);
+    else
+        sideways = std::max(std::abs(d[0]), std::abs(d[1]));
+    if (sideways > ratio_ * along)
+        return false;
+
+    value = along / static_cast<float>(std::max(cur.t_ - first.t_, 1e-3));
+    start_ = seq;
+    return true;
+}
+
+/**
+ * @brief The HoldRecognizer class recognizes a hand that rests at one place.
+ *
+ * The place is the first sample after the hand left the previous place. A hold is reported once per place.
+ */
+class HoldRecognizer
+{
+public:
+
+    HoldRecognizer(float radius, float duration)
+        :
+          radius_(radius),
+          duration_(duration),
+          anchor_(),
+          started_(false),
+          fired_(false)
+    {}
+
+    void reset()
+    {
+        started_ = false;
+    }
+
+    /**
+     * @brief Check the newest sample of the trail. If the hand was held long enough, store the duration in value and return true.
+     */
+    bool add(HandTrail const & trail, float & value);
+
+private:
+
+    float radius_; // the hand must stay inside of this radius
+    float duration_; // the time until a hold is recognized
+    GestureSample anchor_; // the place of the hand
+    bool started_; // whether anchor_ is set
+    bool fired_; // whether the hold at anchor_ was reported
+
+};
+
+bool HoldRecognizer::add(HandTrail const & trail, float & value)
+{
+    auto const & cur = trail.back();
+    auto const dx = cur.p_[0] - anchor_.p_[0];
+    auto const dy = cur.p_[1] - anchor_.p_[1];
+    if (!started_ || dx*dx + dy*dy > radius_*radius_)
+    {
+        anchor_ = cur;
+        started_ = true;
+        fired_ = false;
+        return false;
+    }
+    if (fired_ || cur.t_ - anchor_.t_ < duration_)
+        return false;
+    value = static_cast<float>(cur.t_ - anchor_.t_);
+    fired_ = true;
+    return true;
+}
+
+/**
+ * @brief The CircleRecognizer class recognizes a hand that draws a full circle on the screen.
+ *
+ * The direction of a hand that goes once around a circle turns by 360 degrees, wherever the center
+ * is. The window keeps running sums of the turned angles and of the positions and their squares
+ * (for the radius). A new sample adds its terms and the expired samples subtract theirs, so the
+ * cost per sample is O(1). A circle turns smoothly: A sharp turn (like a swipe and its way back,
+ * which turns by 180 degrees) is no part of a circle and starts a new window.
+ */
+class CircleRecognizer
+{
+public:
+
+    CircleRecognizer(float radius, float duration)
+        :
+          radius_(radius),
+          duration_(duration),
+          has_direction_(false)
+    {
+        reset(0);
+    }
+
+    /**
+     * @brief Start a new window at the given sample.
+     */
+    void reset(size_t seq);
+
+    /**
+     * @brief Check the newest sample of the trail. If it completes a circle, store the direction in value and return true.
+     */
+    bool add(HandTrail const & trail, float & value);
+
+private:
+
+    /**
+     * @brief Subtract the terms of the first sample of the window.
+     */
+    void pop_front(HandTrail const & trail);
+
+    float radius_; // minimum radius
+    float duration_; // maximum duration
+    size_t start_; // the first sample of the window
+    size_t end_; // one past the last sample of the window
+    double sum_x_; // sum of the positions in the window
+    double sum_y_;
+    double sum_xx_; // sum of the squared positions in the window
+    double sum_yy_;
+    double sum_angle_; // sum of the turned angles in the window
+    std::array<float, hand_trail_size> angles_; // the turned angle at each sample (ring buffer like the trail)
+    bool has_direction_; // whether the hand moved far enough to have a direction
+    float last_x_; // the position where the direction was measured last
+    float last_y_;
+    float direction_x_; // the last direction of the hand
+    float direction_y_;
+
+};
+
+void CircleRecognizer::reset(size_t seq)
+{
+    start_ = seq;
+    end_ = seq;
+    sum_x_ = 0.0;
+    sum_y_ = 0.0;
+    sum_xx_ = 0.0;
+    sum_yy_ = 0.0;
+    sum_angle_ = 0.0;
+}
+
+void CircleRecognizer::pop_front(HandTrail const & trail)
+{
+    auto const & s = trail[start_];
+    sum_x_ -= s.p_[0];
+    sum_y_ -= s.p_[1];
+    sum_xx_ -= s.p_[0] * s.p_[0];
+    sum_yy_ -= s.p_[1] * s.p_[1];
+    sum_angle_ -= angles_[start_ % hand_trail_size];
+    ++start_;
+}
+
+bool CircleRecognizer::add(HandTrail const & trail, float & value)
+{
+    auto const seq = trail.newest();
+    auto const & cur = trail.back();
+    if (end_ != seq)
+    {
+        reset(seq);
+        has_direction_ = false;
+    }
+    while (start_ < end_ && (seq - start_ + 1 >= trail.capacity() || cur.t_ - trail[start_].t_ > duration_))
+        pop_front(trail);
+
+    // Measure how far the direction turned. Small steps are skipped, their direction is mostly noise.
+    float angle = 0.0f;
+    if (!has_direction_)
+    {
+        last_x_ = cur.p_[0];
+        last_y_ = cur.p_[1];
+        direction_x_ = 0.0f;
+        direction_y_ = 0.0f;
+        has_direction_ = true;
+    }
+    auto const dx = cur.p_[0] - last_x_;
+    auto const dy = cur.p_[1] - last_y_;
+    auto const min_step = 0.25f * radius_;
+    auto const max_turn = 0.5f * 3.14159265f; // a sharper turn between two steps starts a new window (90 degrees)
+    if (dx*dx + dy*dy >= min_step*min_step)
+    {
+        if (direction_x_ != 0.0f || direction_y_ != 0.0f)
+            angle = std::atan2(direction_x_*dy - direction_y_*dx, direction_x_*dx + direction_y_*dy);
+        if (std::abs(angle) > max_turn)
+        {
+            reset(seq);
+            angle = 0.0f;
+        }
+        direction_x_ = dx;
+        direction_y_ = dy;
+        last_x_ = cur.p_[0];
+        last_y_ = cur.p_[1];
+    }
+    angles_[seq % hand_trail_size] = angle;
+    sum_x_ += cur.p_[0];
+    sum_y_ += cur.p_[1];
+    sum_xx_ += cur.p_[0] * cur.p_[0];
+    sum_yy_ += cur.p_[1] * cur.p_[1];
+    sum_angle_ += angle;
+    end_ = seq+1;
+
+    double const full_turn = 2.0 * 3.14159265358979323846;
+    if (std::abs(sum_angle_) < full_turn)
+        return false;
+
+    // The root mean square distance to the center is the radius of a circle.
+    double const n = end_ - start_;
+    auto const mean_x = sum_x_ / n;
+    auto const mean_y = sum_y_ / n;
+    auto const variance = sum_xx_ / n - mean_x*mean_x + sum_yy_ / n - mean_y*mean_y;
+    if (variance < radius_*radius_)
+        return false;
+
+    // The y axis of the screen points down, so a positive angle is clockwise on the screen.
+    value = sum_angle_ > 0 ? 1.0f : -1.0f;
+    reset(end_);
+    return true;
+}
+
+/**
+ * @brief The HandGestures class runs all recognizers on the samples of one hand.
+ */
+class HandGestures
+{
+public:
+
+    typedef Event::GestureEvent::Type Type;
+
+    explicit HandGestures(GestureOptions const & options = GestureOptions());
+
+    /**
+     * @brief Forget the samples of the hand.
+     */
+    void reset();
+
+    /**
+     * @brief Add a sample and call emit(type, value) for each recognized gesture.
+     */
+    template <typename EMIT>
+    void add(GestureSample const & sample, EMIT emit);
+
+private:
+
+    static size_t const num_swipes = 5;
+
+    HandTrail trail_; // the last samples
+    std::array<SwipeRecognizer, num_swipes> swipes_; // the swipes and the push
+    std::array<Type, num_swipes> swipe_types_; // the gesture of each swipe recognizer
+    HoldRecognizer hold_; // the hold
+    CircleRecognizer circle_; // the circle
+    float cooldown_; // see GestureOptions::cooldown_
+    float max_gap_; // see GestureOptions::max_gap_
+    double blocked_until_; // no swipe or push is recognized before this time
+
+};
+
+HandGestures::HandGestures(GestureOptions const & o)
+    :
+      swipes_{{
+          SwipeRecognizer(0, -1.0f, o.swipe_distance_, o.swipe_duration_, o.swipe_ratio_),
+          SwipeRecognizer(0, 1.0f, o.swipe_distance_, o.swipe_duration_, o.swipe_ratio_),
+          SwipeRecognizer(1, -1.0f, o.swipe_distance_, o.swipe_duration_, o.swipe_ratio_),
+          SwipeRecognizer(1, 1.0f, o.swipe_distance_, o.swipe_duration_, o.swipe_ratio_),
+          SwipeRecognizer(2, 1.0f, o.push_distance_, o.push_duration_, o.swipe_ratio_)
+      }},
+      swipe_types_{{
+          Event::GestureEvent::SwipeLeft,
+          Event::GestureEvent::SwipeRight,
+          Event::GestureEvent::SwipeUp,
+          Event::GestureEvent::SwipeDown,
+          Event::GestureEvent::Push
+      }},
+      hold_(o.hold_radius_, o.hold_duration_),
+      circle_(o.circle_radius_, o.circle_duration_),
+      cooldown_(o.cooldown_),
+      max_gap_(o.max_gap_),
+      blocked_until_(0.0)
+{}
+
+void HandGestures::reset()
+{
+    trail_.clear();
+    hold_.reset();
+    blocked_until_ = 0.0;
+}
+
+template <typename EMIT>
+void HandGestures::add(GestureSample const & sample, EMIT emit)
+{
+    // Start anew if the hand was lost for a while.
+    if (!trail_.empty() && (sample.t_ < trail_.back().t_ || sample.t_ - trail_.back().t_ > max_gap_))
+        reset();
+    bool const first = trail_.empty();
+    trail_.push(sample);
+    auto const seq = trail_.newest();
+    if (first)
+    {
+        for (auto & s : swipes_)
+            s.reset(seq);
+        circle_.reset(seq);
+    }
+
+    // After a swipe, the hand usually moves back. The windows follow the hand until the cooldown is over,
+    // so the way back is not reported as a swipe into the opposite direction.
+    float value = 0.0f;
+    if (sample.t_ < blocked_until_)
+    {
+        for (auto & s : swipes_)
+            s.reset(seq);
+    }
+    else
+    {
+        for (size_t i = 0; i < num_swipes; ++i)
+        {
+            if (swipes_[i].add(trail_, value))
+            {
+                emit(swipe_types_[i], value);
+                blocked_until_ = sample.t_ + cooldown_;
+                for (auto & s : swipes_)
+                    s.reset(seq);
+                hold_.reset();
+                break;
+            }
+        }
+    }
+    if (hold_.add(trail_, value))
+        emit(Event::GestureEvent::Hold, value);
+    if (circle_.add(trail_, value))
+        emit(Event::GestureEvent::Circle, value);
+}
+
+/**
+ * @brief The GestureEngine class recognizes the gestures of all hands of all users and emits them as Gesture events.
+ *
+ * The samples come from the HandMoved events (register the engine at the EventManager) or are added
+ * directly with add(), e.g. from an input queue of a sensor. Each hand runs its recognizers on a
+ * fixed ring buffer of its last samples; adding a sample costs O(1) and does not allocate, except
+ * when a user id is seen for the first time.
+ */
+class GestureEngine : public Listener
+{
+public:
+
+    explicit GestureEngine(GestureOptions const & options = GestureOptions())
+        :
+          handle_gesture_(),
+          options_(options)
+    {}
+
+    /**
+     * @brief Add an input sample. HandMoved samples are passed to the recognizers, UserLeft forgets the user.
+     */
+    void add(InputSample const & sample);
+
+    /**
+     * @brief Forget all hands.
+     */
+    void reset()
+    {
+        hands_.clear();
+    }
+
+    std::function<void(Event const &)> handle_gesture_; // receives the gestures (if empty, they are posted to the EventManager)
+
+protected:
+
+    void notify_impl(Event const & event);
+
+private:
+
+    /**
+     * @brief Pass a hand position to the recognizers of the hand.
+     */
+    void add_hand(int player, int hand, XnUInt64 timestamp, float x, float y, float z);
+
+    /**
+     * @brief Forget the hands of the given user.
+     */
+    void remove_user(int player);
+
+    GestureOptions options_; // the thresholds
+    std::vector<HandGestures> hands_; // the hands, the hand h of user u is at 2*u+h
+
+};
+
+void GestureEngine::add(InputSample const & sample)
+{
+    if (sample.type_ == InputSample::HandMoved)
+        add_hand(sample.user_, sample.hand_, sample.timestamp_, sample.position_.X, sample.position_.Y, sample.position_.Z);
+    else if (sample.type_ == InputSample::UserLeft)
+        remove_user(sample.user_);
+}
+
+void GestureEngine::notify_impl(Event const & event)
+{
+    auto const & in = event.input_;
+    if (event.type_ == Event::HandMoved)
+        add_hand(in.player_, in.hand_, in.timestamp_, in.x_, in.y_, in.z_);
+    else if (event.type_ == Event::UserLeft)
+        remove_user(in.player_);
+}
+
+void GestureEngine::add_hand(int player, int hand, XnUInt64 timestamp, float x, float y, float z)
+{
+    if (player < 0 || (hand != InputSample::LeftHand && hand != InputSample::RightHand))
+        return;
+    auto const index = 2 * static_cast<size_t>(player) + hand;
+    if (index >= hands_.size())
+        hands_.resize(index+1, HandGestures(options_));
+
+    GestureSample sample;
+    sample.t_ = timestamp / 1e6;
+    sample.p_[0] = x;
+    sample.p_[1] = y;
+    sample.p_[2] = z;
+    hands_[index].add(sample, [&](Event::GestureEvent::Type type, float value){
+        Event ev(Event::Gesture);
+        ev.gesture_.gesture_ = type;
+        ev.gesture_.player_ = player;
+        ev.gesture_.hand_ = hand;
+        ev.gesture_.x_ = x;
+        ev.gesture_.y_ = y;
+        ev.gesture_.z_ = z;
+        ev.gesture_.value_ = value;
+        ev.gesture_.timestamp_ = timestamp;
+        if (handle_gesture_)
+            handle_gesture_(ev);
+        else
+            EventManager::instance().post(ev);
+    });
+}
+
+void GestureEngine::remove_user(int player)
+{
+    auto const index = 2 * static_cast<size_t>(player);
+    if (player < 0 || index >= hands_.size())
+        return;
+    hands_[index].reset();
+    if (index+1 < hands_.size())
+        hands_[index+1].reset();
+}
+
+} // namespace kin
+
+#endif
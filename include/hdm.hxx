@@ -25,7 +25,13 @@ public:
 
     HDMGame();
 
-    void hover_field(int x, int y);
+    /**
+     * @brief Return the widget that shows the silhouette of the active player over the background.
+     */
+    std::shared_ptr<SilhouetteWidget> silhouette() const
+    {
+        return silhouette_;
+    }
 
     std::function<void()> handle_close_;
 
@@ -42,19 +48,16 @@ private:
     void load_screen(Event::ScreenID id); // the load function for the screens
 
     std::shared_ptr<Widget> container_; // the main container
+    std::shared_ptr<SilhouetteWidget> silhouette_; // the silhouette of the active player
     std::shared_ptr<Listener> listener_; // the main listener
 
-    int hov_x_;
-    int hov_y_;
     Event::ScreenID current_screen_;
 
 };
 
 HDMGame::HDMGame()
     :
-      handle_close_(),
-      hov_x_(-1),
-      hov_y_(-1)
+      handle_close_()
 {
     handle_hover_ = [&](DiffType x, DiffType y)
     {
@@ -69,6 +72,10 @@ HDMGame::HDMGame()
     auto bg_im = std::make_shared<ImageWidget>("images/bg_grass.jpg");
     add_widget(bg_im);
 
+    // Add the silhouette between the background and the screens.
+    silhouette_ = std::make_shared<SilhouetteWidget>(sf::Color(255, 255, 255, 110));
+    add_widget(silhouette_);
+
     // Create the container.
     container_ = std::make_shared<Widget>();
     add_widget(container_);
@@ -85,24 +92,11 @@ HDMGame::HDMGame()
     load_screen(Event::SplashScreen);
 }
 
-void HDMGame::hover_field(int x, int y)
-{
-    hov_x_ = x;
-    hov_y_ = y;
-}
-
 void HDMGame::update_impl(float elapsed_time)
 {
-    Event hov(Event::FieldHover);
-    hov.field_hover_.x_ = hov_x_;
-    hov.field_hover_.y_ = hov_y_;
-    EventManager::instance().post(hov);
-
     Event tick(Event::Tick);
     tick.tick_.elapsed_time_ = elapsed_time;
     EventManager::instance().post(tick);
-    hov_x_ = -1;
-    hov_y_ = -1;
 }
 
 /**
@@ -0,0 +1,58 @@
+#ifndef INPUT_QUEUE_HXX
+#define INPUT_QUEUE_HXX
+
+#include "platform_support.hxx"
+#ifdef OPENNI_FOUND
+#include <XnCppWrapper.h>
+#endif
+
+#include "utility.hxx"
+#include "spsc_queue.hxx"
+
+namespace kin
+{
+
+/**
+ * @brief The InputSample struct is one input of a player that the sensor hands to the game.
+ */
+struct InputSample
+{
+    enum Type
+    {
+        HandMoved, // a hand of the user has a new position
+        Click, // a hand of the user clicked
+        UserEntered, // the user is tracked now
+        UserLeft // the user is not tracked anymore
+    };
+
+    enum Hand
+    {
+        NoHand = -1,
+        LeftHand = 0,
+        RightHand = 1
+    };
+
+    InputSample()
+        :
+          type_(HandMoved),
+          timestamp_(0),
+          user_(0),
+          hand_(NoHand),
+          position_({0, 0, 0})
+    {}
+
+    Type type_; // the kind of input
+    XnUInt64 timestamp_; // the sensor timestamp in microseconds
+    XnLabel user_; // the user id
+    Hand hand_; // the hand (NoHand for UserEntered and UserLeft)
+    XnVector3D position_; // the normalized predicted hand position (see Cursor)
+};
+
+/**
+ * @brief The queue that carries the input samples from the capture thread of a sensor to the EventManager.
+ */
+typedef SpscQueue<InputSample, 1024> InputQueue;
+
+} // namespace kin
+
+#endif
@@ -0,0 +1,477 @@
+#ifndef INTERACTION_VOLUMES_HXX
+#define INTERACTION_VOLUMES_HXX
+
+#include <array>
+#include <vector>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+
+#include "platform_support.hxx"
+#ifdef OPENNI_FOUND
+#include <XnCppWrapper.h>
+#endif
+
+#include "vecmath.hxx"
+#include "events.hxx"
+#include "input_queue.hxx"
+
+namespace kin
+{
+
+/**
+ * @brief The InteractionBox struct is an oriented box in the normalized hand coordinates of the cursors.
+ */
+struct InteractionBox
+{
+    /**
+     * @brief Create the box with the given center and half sizes along its axes.
+     *
+     * The columns of axes are the axes of the box, they must be orthonormal. The identity gives an
+     * axis aligned box.
+     */
+    InteractionBox(Vec3 const & center, Vec3 const & half_size, Mat3 const & axes = Mat3())
+        :
+          center_(center),
+          half_size_(half_size),
+          axes_(axes)
+    {}
+
+    /**
+     * @brief Create the axis aligned box between the corners a and b.
+     */
+    static InteractionBox between(Vec3 const & a, Vec3 const & b)
+    {
+        return InteractionBox((a + b) * 0.5f, Vec3(std::abs(b.x_ - a.x_), std::abs(b.y_ - a.y_), std::abs(b.z_ - a.z_)) * 0.5f);
+    }
+
+    /**
+     * @brief Return whether p is inside of the box grown by margin on every side.
+     */
+    bool contains(Vec3 const & p, float margin = 0.0f) const
+    {
+        auto const d = p - center_;
+        return std::abs(dot(axes_.c0_, d)) <= half_size_.x_ + margin &&
+               std::abs(dot(axes_.c1_, d)) <= half_size_.y_ + margin &&
+               std::abs(dot(axes_.c2_, d)) <= half_size_.z_ + margin;
+    }
+
+    /**
+     * @brief Return the half sizes of the axis aligned bounding box.
+     */
+    Vec3 half_extent() const
+    {
+        auto const & a = axes_;
+        auto const & h = half_size_;
+        return Vec3(std::abs(a.c0_.x_) * h.x_ + std::abs(a.c1_.x_) * h.y_ + std::abs(a.c2_.x_) * h.z_,
+                    std::abs(a.c0_.y_) * h.x_ + std::abs(a.c1_.y_) * h.y_ + std::abs(a.c2_.y_) * h.z_,
+                    std::abs(a.c0_.z_) * h.x_ + std::abs(a.c1_.z_) * h.y_ + std::abs(a.c2_.z_) * h.z_);
+    }
+
+    Vec3 center_; // the center
+    Vec3 half_size_; // the half sizes along the axes
+    Mat3 axes_; // the axes (columns)
+};
+
+/**
+ * @brief The InteractionVolumes class finds the box that contains a hand position.
+ *
+ * The bounding box of all boxes is divided into a uniform grid of cells, each cell lists the boxes
+ * that overlap it. The cells are at most half as large as the smallest box, so a lookup computes
+ * the cell of the point and tests the few boxes of that cell, no matter how many boxes there are.
+ */
+class InteractionVolumes
+{
+public:
+
+    InteractionVolumes()
+        :
+          cells_{{0, 0, 0}}
+    {}
+
+    /**
+     * @brief Build the lookup grid of the given boxes, with at most max_cells cells per axis.
+     */
+    explicit InteractionVolumes(std::vector<InteractionBox> boxes, size_t max_cells = 64);
+
+    size_t size() const
+    {
+        return boxes_.size();
+    }
+
+    bool empty() const
+    {
+        return boxes_.empty();
+    }
+
+    InteractionBox const & operator[](size_t i) const
+    {
+        return boxes_[i];
+    }
+
+    /**
+     * @brief Return the index of the first box that contains p, or -1 if no box contains it.
+     */
+    int find(Vec3 const & p) const;
+
+    /**
+     * @brief Return the number of cells of the lookup grid.
+     */
+    size_t num_cells() const
+    {
+        return cells_[0] * cells_[1] * cells_[2];
+    }
+
+private:
+
+    std::vector<InteractionBox> boxes_; // the boxes
+    Vec3 min_; // the lower corner of the grid
+    Vec3 max_; // the upper corner of the grid
+    Vec3 inv_cell_size_; // cells per unit along each axis
+    std::array<size_t, 3> cells_; // number of cells along each axis
+    std::vector<uint32_t> cell_begin_; // the boxes of cell c are cell_boxes_[cell_begin_[c]] to cell_boxes_[cell_begin_[c+1]-1]
+    std::vector<uint32_t> cell_boxes_; // the box indices of all cells
+
+};
+
+InteractionVolumes::InteractionVolumes(std::vector<InteractionBox> boxes, size_t max_cells)
+    :
+      boxes_(std::move(boxes)),
+      cells_{{0, 0, 0}}
+{
+    if (boxes_.empty())
+        return;
+    if (max_cells == 0)
+        throw std::runtime_error("InteractionVolumes::InteractionVolumes(): The grid needs at least one cell per axis.");
+
+    // The bounding box of all boxes and the smallest extent along each axis. The extents are padded,
+    // so rounding cannot put a point that a box contains into a cell that does not list the box.
+    auto const padded_extent = [](InteractionBox const & b){
+        return b.half_extent() * 1.0001f + Vec3(1e-6f, 1e-6f, 1e-6f);
+    };
+    float lo[3], hi[3], smallest[3];
+    for (size_t a = 0; a < 3; ++a)
+    {
+        lo[a] = std::numeric_limits<float>::max();
+        hi[a] = std::numeric_limits<float>::lowest();
+        smallest[a] = std::numeric_limits<float>::max();
+    }
+    for (auto const & b : boxes_)
+    {
+        auto const e = padded_extent(b);
+        for (size_t a = 0; a < 3; ++a)
+        {
+            lo[a] = std::min(lo[a], b.center_[a] - e[a]);
+            hi[a] = std::max(hi[a], b.center_[a] + e[a]);
+            smallest[a] = std::min(smallest[a], 2.0f * e[a]);
+        }
+    }
+
+    float inv[3];
+    for (size_t a = 0; a < 3; ++a)
+    {
+        auto const range = hi[a] - lo[a];
+        auto const n = smallest[a] > 0.0f ? std::ceil(2.0f * range / smallest[a]) : static_cast<float>(max_cells);
+        cells_[a] = static_cast<size_t>(std::max(1.0f, std::min(n, static_cast<float>(max_cells))));
+        inv[a] = range > 0.0f ? cells_[a] / range : 0.0f;
+    }
+    min_ = Vec3(lo[0], lo[1], lo[2]);
+    max_ = Vec3(hi[0], hi[1], hi[2]);
+    inv_cell_size_ = Vec3(inv[0], inv[1], inv[2]);
+
+    // Count the boxes of each cell, then fill them in (compressed rows, so the lookup reads one array).
+    auto const cell_range = [&](InteractionBox const & b, size_t a, size_t & first, size_t & last){
+        auto const e = padded_extent(b);
+        auto const to_cell = [&](float v){
+            return std::min(static_cast<size_t>(std::max(0.0f, (v - lo[a]) * inv[a])), cells_[a]-1);
+        };
+        first = to_cell(b.center_[a] - e[a]);
+        last = to_cell(b.center_[a] + e[a]);
+    };
+    auto const for_cells = [&](InteractionBox const & b, std::function<void(size_t)> const & f){
+        size_t x0, x1, y0, y1, z0, z1;
+        cell_range(b, 0, x0, x1);
+        cell_range(b, 1, y0, y1);
+        cell_range(b, 2, z0, z1);
+        for (size_t z = z0; z <= z1; ++z)
+            for (size_t y = y0; y <= y1; ++y)
+                for (size_t x = x0; x <= x1; ++x)
+                    f((z * cells_[1] + y) * cells_[0] + x);
+    };
+    cell_begin_.assign(num_cells()+1, 0);
+    for (auto const & b : boxes_)
+        for_cells(b, [&](size_t c){ ++cell_begin_[c+1]; });
+    for (size_t c = 0; c < num_cells(); ++c)
+        cell_begin_[c+1] += cell_begin_[c];
+    cell_boxes_.resize(cell_begin_.back());
+    std::vector<uint32_t> fill(cell_begin_.begin(), cell_begin_.end()-1);
+    for (size_t i = 0; i < boxes_.size(); ++i)
+        for_cells(boxes_[i], [&](size_t c){ cell_boxes_[fill[c]++] = static_cast<uint32_t>(i); });
+}
+
+int InteractionVolumes::find(Vec3 const & p) const
+{
+    if (boxes_.empty())
+        return -1;
+    size_t cell[3];
+    for (size_t a = 0; a < 3; ++a)
+    {
+        if (!(p[a] >= min_[a] && p[a] <= max_[a]))
+            return -1;
+        cell[a] = std::min(static_cast<size_t>((p[a] - min_[a]) * inv_cell_size_[a]), cells_[a]-1);
+    }
+    auto const c = (cell[2] * cells_[1] + cell[1]) * cells_[0] + cell[0];
+    for (auto k = cell_begin_[c]; k < cell_begin_[c+1]; ++k)
+        if (boxes_[cell_boxes_[k]].contains(p))
+            return static_cast<int>(cell_boxes_[k]);
+    return -1;
+}
+
+/**
+ * @brief Create the boxes of a board of holes, the hole (x, y) is box y * columns + x.
+ *
+ * The columns are split along the x axis at the given edges, the rows along row_axis (1: height,
+ * 2: depth). The edges may decrease. The third axis spans [depth_min, depth_max] (or [height_min,
+ * height_max] if the rows are split by depth).
+ */
+inline std::vector<InteractionBox> board_boxes(
+        std::vector<float> const & column_edges,
+        std::vector<float> const & row_edges,
+        size_t row_axis,
+        float other_min,
+        float other_max
+){
+    if (column_edges.size() < 2 || row_edges.size() < 2)
+        throw std::runtime_error("board_boxes(): A board needs at least two edges per axis.");
+    if (row_axis != 1 && row_axis != 2)
+        throw std::runtime_error("board_boxes(): The rows must be split by height (1) or depth (2).");
+    std::vector<InteractionBox> boxes;
+    for (size_t y = 0; y+1 < row_edges.size(); ++y)
+    {
+        for (size_t x = 0; x+1 < column_edges.size(); ++x)
+        {
+            auto const a = row_axis == 1 ? Vec3(column_edges[x], row_edges[y], other_min) : Vec3(column_edges[x], other_min, row_edges[y]);
+            auto const b = row_axis == 1 ? Vec3(column_edges[x+1], row_edges[y+1], other_max) : Vec3(column_edges[x+1], other_max, row_edges[y+1]);
+            boxes.push_back(InteractionBox::between(a, b));
+        }
+    }
+    return boxes;
+}
+
+/**
+ * @brief The InteractionEngine class follows the hands through the interaction volumes and emits Interaction events.
+ *
+ * A hand enters the volume that contains it and leaves it when it is no longer inside of it grown
+ * by the margin, so a hand that rests on the border between two volumes does not flicker between
+ * them. A click of a hand inside of a volume strikes that volume.
+ *
+ * The positions are passed with move_hand() (or add() with HandMoved samples), so the caller
+ * chooses which hands interact. The clicks and the leaving users come from the KinectClick and
+ * UserLeft events (register the engine at the EventManager) or from add(). A new screen starts
+ * without hovered volumes, so on ChangeScreen the hands forget their volumes and enter anew.
+ */
+class InteractionEngine : public Listener
+{
+public:
+
+    explicit InteractionEngine(InteractionVolumes const & volumes = InteractionVolumes(), float margin = 0.02f)
+        :
+          handle_interaction_(),
+          volumes_(volumes),
+          margin_(margin)
+    {}
+
+    /**
+     * @brief Replace the volumes. The hands leave their volumes and enter the new ones with the next position.
+     */
+    void set_volumes(InteractionVolumes const & volumes);
+
+    InteractionVolumes const & volumes() const
+    {
+        return volumes_;
+    }
+
+    /**
+     * @brief Move a hand to the given position and emit Leave and Enter if it changed its volume.
+     */
+    void move_hand(int player, int hand, XnUInt64 timestamp, XnVector3D const & position);
+
+    /**
+     * @brief Stop following a hand, it leaves its volume.
+     */
+    void release_hand(int player, int hand, XnUInt64 timestamp);
+
+    /**
+     * @brief Strike the volume of the hand, if it is inside of one.
+     */
+    void strike(int player, int hand, XnUInt64 timestamp);
+
+    /**
+     * @brief Return the volume of the given hand, or -1.
+     */
+    int volume(int player, int hand) const;
+
+    /**
+     * @brief Add an input sample: HandMoved moves the hand, Click strikes, UserLeft releases both hands.
+     */
+    void add(InputSample const & sample);
+
+    /**
+     * @brief Forget all hands without emitting events.
+     */
+    void reset()
+    {
+        hands_.clear();
+    }
+
+    std::function<void(Event const &)> handle_interaction_; // receives the events (if empty, they are posted to the EventManager)
+
+protected:
+
+    void notify_impl(Event const & event);
+
+private:
+
+    /**
+     * @brief The state of a hand.
+     */
+    struct HandState
+    {
+        HandState()
+            :
+              volume_(-1),
+              position_(0, 0, 0)
+        {}
+
+        int volume_; // the volume that contains the hand, or -1
+        Vec3 position_; // the last position
+    };
+
+    /**
+     * @brief Return the state of the given hand, or nullptr if the ids are invalid.
+     */
+    HandState * hand_state(int player, int hand);
+
+    void emit(Event::InteractionEvent::Type type, int volume, int player, int hand, XnUInt64 timestamp, Vec3 const & p);
+
+    InteractionVolumes volumes_; // the volumes
+    float margin_; // the hysteresis of leaving a volume
+    std::vector<HandState> hands_; // the hands, the hand h of user u is at 2*u+h
+
+};
+
+void InteractionEngine::set_volumes(InteractionVolumes const & volumes)
+{
+    for (size_t i = 0; i < hands_.size(); ++i)
+        if (hands_[i].volume_ >= 0)
+            release_hand(static_cast<int>(i / 2), static_cast<int>(i % 2), 0);
+    volumes_ = volumes;
+}
+
+void InteractionEngine::move_hand(int player, int hand, XnUInt64 timestamp, XnVector3D const & position)
+{
+    auto const state = hand_state(player, hand);
+    if (!state)
+        return;
+    auto const p = to_vec3(position);
+    state->position_ = p;
+
+    // Stay in the current volume while the hand is close to it, else look the volume up.
+    auto const current = state->volume_;
+    if (current >= 0 && volumes_[current].contains(p, margin_))
+        return;
+    auto const next = volumes_.find(p);
+    if (next == current)
+        return;
+    state->volume_ = next;
+    if (current >= 0)
+        emit(Event::InteractionEvent::Leave, current, player, hand, timestamp, p);
+    if (next >= 0)
+        emit(Event::InteractionEvent::Enter, next, player, hand, timestamp, p);
+}
+
+void InteractionEngine::release_hand(int player, int hand, XnUInt64 timestamp)
+{
+    auto const state = hand_state(player, hand);
+    if (!state || state->volume_ < 0)
+        return;
+    auto const current = state->volume_;
+    state->volume_ = -1;
+    emit(Event::InteractionEvent::Leave, current, player, hand, timestamp, state->position_);
+}
+
+void InteractionEngine::strike(int player, int hand, XnUInt64 timestamp)
+{
+    auto const state = hand_state(player, hand);
+    if (state && state->volume_ >= 0)
+        emit(Event::InteractionEvent::Strike, state->volume_, player, hand, timestamp, state->position_);
+}
+
+int InteractionEngine::volume(int player, int hand) const
+{
+    auto const index = 2 * static_cast<size_t>(player) + hand;
+    if (player < 0 || (hand != InputSample::LeftHand && hand != InputSample::RightHand) || index >= hands_.size())
+        return -1;
+    return hands_[index].volume_;
+}
+
+void InteractionEngine::add(InputSample const & sample)
+{
+    if (sample.type_ == InputSample::HandMoved)
+        move_hand(sample.user_, sample.hand_, sample.timestamp_, sample.position_);
+    else if (sample.type_ == InputSample::Click)
+        strike(sample.user_, sample.hand_, sample.timestamp_);
+    else if (sample.type_ == InputSample::UserLeft)
+    {
+        release_hand(sample.user_, InputSample::LeftHand, sample.timestamp_);
+        release_hand(sample.user_, InputSample::RightHand, sample.timestamp_);
+    }
+}
+
+void InteractionEngine::notify_impl(Event const & event)
+{
+    auto const & in = event.input_;
+    if (event.type_ == Event::KinectClick)
+        strike(in.player_, in.hand_, in.timestamp_);
+    else if (event.type_ == Event::UserLeft)
+    {
+        release_hand(in.player_, InputSample::LeftHand, in.timestamp_);
+        release_hand(in.player_, InputSample::RightHand, in.timestamp_);
+    }
+    else if (event.type_ == Event::ChangeScreen)
+        reset();
+}
+
+InteractionEngine::HandState * InteractionEngine::hand_state(int player, int hand)
+{
+    if (player < 0 || (hand != InputSample::LeftHand && hand != InputSample::RightHand))
+        return nullptr;
+    auto const index = 2 * static_cast<size_t>(player) + hand;
+    if (index >= hands_.size())
+        hands_.resize(index+1);
+    return &hands_[index];
+}
+
+void InteractionEngine::emit(Event::InteractionEvent::Type type, int volume, int player, int hand, XnUInt64 timestamp, Vec3 const & p)
+{
+    Event ev(Event::Interaction);
+    ev.interaction_.interaction_ = type;
+    ev.interaction_.volume_ = volume;
+    ev.interaction_.player_ = player;
+    ev.interaction_.hand_ = hand;
+    ev.interaction_.x_ = p.x_;
+    ev.interaction_.y_ = p.y_;
+    ev.interaction_.z_ = p.z_;
+    ev.interaction_.timestamp_ = timestamp;
+    if (handle_interaction_)
+        handle_interaction_(ev);
+    else
+        EventManager::instance().post(ev);
+}
+
+} // namespace kin
+
+#endif
@@ -0,0 +1,548 @@
+#ifndef JOINT_FILTER_HXX
+#define JOINT_FILTER_HXX
+
+#include <array>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+
+#include "utility.hxx"
+#include "skeleton.hxx"
+
+namespace kin
+{
+
+/**
+ * @brief Maximum window size of the moving average filter.
+ */
+static size_t const max_joint_filter_window = 32;
+
+/**
+ * @brief The JointFilterOptions struct selects a joint filter and its parameters.
+ *
+ * Positions are in the units of the joints (millimeters for real world positions), times in seconds.
+ */
+struct JointFilterOptions
+{
+    enum Type
+    {
+        None, // pass the samples through
+        Average, // moving average over the last window_ samples
+        OneEuro, // One Euro filter: adaptive low pass, little lag when moving fast, smooth when moving slowly
+        Kalman // constant velocity Kalman filter
+    };
+
+    explicit JointFilterOptions(Type type = OneEuro)
+        :
+          type_(type),
+          window_(10),
+          min_cutoff_(1.0f),
+          beta_(0.007f),
+          d_cutoff_(1.0f),
+          process_noise_(20000.0f),
+          measurement_noise_(10.0f)
+    {}
+
+    Type type_; // the filter type
+    size_t window_; // Average: number of averaged samples (at most max_joint_filter_window)
+    float min_cutoff_; // OneEuro: cutoff frequency at rest in Hz
+    float beta_; // OneEuro: increase of the cutoff frequency per unit of speed
+    float d_cutoff_; // OneEuro: cutoff frequency of the speed estimate in Hz
+    float process_noise_; // Kalman: standard deviation of the acceleration in units per s^2
+    float measurement_noise_; // Kalman: standard deviation of the measurements in units
+};
+
+/**
+ * @brief Parse a filter description of the form "type[:p0,p1,...]".
+ *
+ * none
+ * average[:window]
+ * one-euro[:min_cutoff,beta,d_cutoff]
+ * kalman[:process_noise,measurement_noise]
+ */
+JointFilterOptions parse_joint_filter(std::string const & spec)
+{
+    auto const pos = spec.find(':');
+    auto const name = spec.substr(0, pos);
+    std::vector<float> params;
+    if (pos != std::string::npos)
+    {
+        std::string rest = spec.substr(pos+1);
+        while (!rest.empty())
+        {
+            auto const comma = rest.find(',');
+            params.push_back(std::stof(rest.substr(0, comma)));
+            rest = comma == std::string::npos ? "" : rest.substr(comma+1);
+        }
+    }
+
+    JointFilterOptions options;
+    size_t max_params = 0;
+    if (name == "none")
+    {
+        options.type_ = JointFilterOptions::None;
+    }
+    else if (name == "average")
+    {
+        options.type_ = JointFilterOptions::Average;
+        max_params = 1;
+        if (params.size() > 0)
+            options.window_ = static_cast<size_t>(params[0]);
+        if (options.window_ < 1 || options.window_ > max_joint_filter_window)
+            throw std::runtime_error("parse_joint_filter(): Invalid window size.");
+    }
+    else if (name == "one-euro")
+    {
+        options.type_ = JointFilterOptions::OneEuro;
+        max_params = 3;
+        if (params.size() > 0)
+            options.min_cutoff_ = params[0];
+        if (params.size() > 1)
+            options.beta_ = params[1];
+        if (params.size() > 2)
+            options.d_cutoff_ = params[2];
+    }
+    else if (name == "kalman")
+    {
+        options.type_ = JointFilterOptions::Kalman;
+        max_params = 2;
+        if (params.size() > 0)
+            options.process_noise_ = params[0];
+        if (params.size() > 1)
+            options.measurement_noise_ = params[1];
+    }
+    else
+    {
+        throw std::runtime_error("parse_joint_filter(): Unknown filter: " + name);
+    }
+    if (params.size() > max_params)
+        throw std::runtime_error("parse_joint_filter(): Too many parameters: " + spec);
+    return options;
+}
+
+/**
+ * @brief The JointFilter class filters the positions of a single joint.
+ *
+ * All filter states are stored inline, so filters can be kept in arrays and reset without touching the heap.
+ */
+class JointFilter
+{
+public:
+
+    explicit JointFilter(JointFilterOptions const & options = JointFilterOptions())
+        :
+          options_(options)
+    {
+        reset();
+    }
+
+    /**
+     * @brief Filter the sample x that was measured at time t (in seconds) and return the estimate.
+     */
+    XnVector3D operator()(XnVector3D const & x, double t);
+
+    /**
+     * @brief Forget all samples, e. g. when the joint was lost.
+     */
+    void reset()
+    {
+        count_ = 0;
+        last_t_ = 0;
+        sum_ = {0, 0, 0};
+    }
+
+private:
+
+    /**
+     * @brief Smoothing factor of an exponential low pass with the given cutoff frequency.
+     */
+    static float alpha(float cutoff, float dt)
+    {
+        auto const tau = 1.0f / (2.0f * 3.14159265f * cutoff);
+        return 1.0f / (1.0f + tau / dt);
+    }
+
+    /**
+     * @brief One step of the constant velocity Kalman filter for one axis.
+     */
+    void kalman_step(size_t axis, float z, float dt);
+
+    JointFilterOptions options_; // the filter options
+    size_t count_; // number of samples since the last reset
+    double last_t_; // time of the last sample
+
+    std::array<XnVector3D, max_joint_filter_window> window_; // Average: ring buffer of the last samples
+    XnVector3D sum_; // Average: sum of the samples in the window
+
+    XnVector3D x_; // OneEuro: last estimate
+    XnVector3D dx_; // OneEuro: last speed estimate
+
+    float pos_[3]; // Kalman: position estimate
+    float vel_[3]; // Kalman: velocity estimate
+    float cov_[3][3]; // Kalman: covariance (pp, pv, vv) per axis
+
+};
+
+XnVector3D JointFilter::operator()(XnVector3D const & x, double t)
+{
+    // Use the nominal frame time if the timestamps are missing or out of order.
+    auto dt = static_cast<float>(t - last_t_);
+    if (count_ == 0 || !(dt > 0.0f))
+        dt = 1.0f / 30.0f;
+    last_t_ = t;
+    ++count_;
+
+    switch (options_.type_)
+    {
+    case JointFilterOptions::None:
+        return x;
+
+    case JointFilterOptions::Average:
+    {
+        auto const n = std::min(options_.window_, max_joint_filter_window);
+        auto & slot = window_[(count_-1) % n];
+        if (count_ > n)
+            sum_ = sum_ - slot;
+        slot = x;
+        sum_ = sum_ + x;
+        return sum_ / static_cast<float>(std::min(count_, n));
+    }
+
+    case JointFilterOptions::OneEuro:
+    {
+        if (count_ == 1)
+        {
+            x_ = x;
+            dx_ = {0, 0, 0};
+            return x;
+        }
+        auto const dx = (x - x_) / dt;
+        dx_ = dx_ + alpha(options_.d_cutoff_, dt) * (dx - dx_);
+        auto const cutoff = options_.min_cutoff_ + options_.beta_ * length(dx_);
+        x_ = x_ + alpha(cutoff, dt) * (x - x_);
+        return x_;
+    }
+
+    case JointFilterOptions::Kalman:
+    {
+        if (count_ == 1)
+        {
+            float const z[3] = {x.X, x.Y, x.Z};
+            float const r = options_.measurement_noise_;
+            for (size_t i = 0; i < 3; ++i)
+            {
+                pos_[i] = z[i];
+                vel_[i] = 0;
+                cov_[i][0] = r*r;
+                cov_[i][1] = 0;
+                cov_[i][2] = 1e6f; // unknown initial velocity
+            }
+            return x;
+        }
+        kalman_step(0, x.X, dt);
+        kalman_step(1, x.Y, dt);
+        kalman_step(2, x.Z, dt);
+        XnVector3D ret = {pos_[0], pos_[1], pos_[2]};
+        return ret;
+    }
+    }
+    return x;
+}
+
+void JointFilter::kalman_step(size_t axis, float z, float dt)
+{
+    auto & p = pos_[axis];
+    auto & v = vel_[axis];
+    auto & pp = cov_[axis][0];
+    auto & pv = cov_[axis][1];
+    auto & vv = cov_[axis][2];
+
+    // Predict with constant velocity. The acceleration is modeled as white noise.
+    auto const q = options_.process_noise_ * options_.process_noise_;
+    auto const dt2 = dt*dt;
+    p += v * dt;
+    pp += dt * (2*pv + dt*vv) + q * dt2*dt2 / 4;
+    pv += dt * vv + q * dt2*dt / 2;
+    vv += q * dt2;
+
+    // Correct with the measured position.
+    auto const r = options_.measurement_noise_ * options_.measurement_noise_;
+    auto const s = pp + r;
+    auto const kp = pp / s;
+    auto const kv = pv / s;
+    auto const y = z - p;
+    p += kp * y;
+    v += kv * y;
+    vv -= kv * pv;
+    pv -= kp * pv;
+    pp -= kp * pp;
+}
+
+/**
+ * @brief Maximum number of samples the motion predictor fits.
+ */
+static size_t const max_prediction_window = 16;
+
+/**
+ * @brief The PredictionOptions struct configures the MotionPredictor.
+ */
+struct PredictionOptions
+{
+    explicit PredictionOptions(float horizon = 0.05f)
+        :
+          horizon_(horizon),
+          window_(6),
+          acceleration_(0.5f),
+          max_offset_(0.25f)
+    {}
+
+    float horizon_; // how far to extrapolate in seconds (0: no prediction)
+    size_t window_; // number of fitted samples (3 to max_prediction_window)
+    float acceleration_; // weight of the acceleration term (0: linear extrapolation, 1: full quadratic)
+    float max_offset_; // maximum distance between the last sample and the prediction
+};
+
+/**
+ * @brief The MotionPredictor class extrapolates a trajectory into the future.
+ *
+ * Velocity and acceleration come from a least squares fit of a quadratic polynomial to the last
+ * samples, which is far less noisy than finite differences. The acceleration can be damped and the
+ * prediction is clamped to a maximum distance, so the predictor does not overshoot on sudden stops.
+ */
+class MotionPredictor
+{
+public:
+
+    explicit MotionPredictor(PredictionOptions const & options = PredictionOptions())
+        :
+          options_(options),
+          count_(0)
+    {
+        options_.window_ = std::max<size_t>(3, std::min(options_.window_, max_prediction_window));
+    }
+
+    /**
+     * @brief Add the sample x that was measured at time t (in seconds).
+     */
+    void push(XnVector3D const & x, double t)
+    {
+        if (count_ > 0 && !(t > t_[(count_-1) % options_.window_]))
+            return; // ignore samples without time progress
+        x_[count_ % options_.window_] = x;
+        t_[count_ % options_.window_] = t;
+        ++count_;
+    }
+
+    /**
+     * @brief Return the position that is expected horizon_ seconds after the last sample.
+     */
+    XnVector3D predict() const;
+
+    /**
+     * @brief Forget all samples.
+     */
+    void reset()
+    {
+        count_ = 0;
+    }
+
+private:
+
+    PredictionOptions options_; // the options
+    std::array<XnVector3D, max_prediction_window> x_; // ring buffer with the last samples
+    std::array<double, max_prediction_window> t_; // the times of the samples
+    size_t count_; // number of samples since the last reset
+
+};
+
+XnVector3D MotionPredictor::predict() const
+{
+    if (count_ == 0)
+        return XnVector3D({0, 0, 0});
+    auto const n = std::min(count_, options_.window_);
+    auto const last = (count_-1) % options_.window_;
+    auto const & x0 = x_[last];
+    if (n < 2 || options_.horizon_ <= 0)
+        return x0;
+
+    // Fit x(s) = c0 + c1 s + c2 s^2 with s = t - t_last (normal equations, solved with Cramer's rule).
+    double S[5] = {0, 0, 0, 0, 0}; // sums of s^k
+    double B[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}}; // sums of x s^k per axis
+    for (size_t k = 0; k < n; ++k)
+    {
+        auto const i = (count_-1-k) % options_.window_;
+        auto const s = t_[i] - t_[last];
+        double const v[3] = {x_[i].X, x_[i].Y, x_[i].Z};
+        double p = 1;
+        for (size_t e = 0; e < 5; ++e)
+        {
+            if (e < 3)
+                for (size_t a = 0; a < 3; ++a)
+                    B[a][e] += v[a] * p;
+            S[e] += p;
+            p *= s;
+        }
+    }
+
+    double vel[3] = {0, 0, 0};
+    double acc[3] = {0, 0, 0};
+    auto const det3 = S[0]*(S[2]*S[4] - S[3]*S[3]) - S[1]*(S[1]*S[4] - S[3]*S[2]) + S[2]*(S[1]*S[3] - S[2]*S[2]);
+    auto const det2 = S[0]*S[2] - S[1]*S[1];
+    if (n >= 3 && std::abs(det3) > 1e-18)
+    {
+        for (size_t a = 0; a < 3; ++a)
+        {
+            auto const b0 = B[a][0];
+            auto const b1 = B[a][1];
+            auto const b2 = B[a][2];
+            vel[a] = (S[0]*(b1*S[4] - S[3]*b2) - b0*(S[1]*S[4] - S[3]*S[2]) + S[2]*(S[1]*b2 - b1*S[2])) / det3;
+            acc[a] = 2 * (S[0]*(S[2]*b2 - b1*S[3]) - S[1]*(S[1]*b2 - b1*S[2]) + b0*(S[1]*S[3] - S[2]*S[2])) / det3;
+        }
+    }
+    else if (std::abs(det2) > 1e-18)
+    {
+        for (size_t a = 0; a < 3; ++a)
+            vel[a] = (S[0]*B[a][1] - S[1]*B[a][0]) / det2;
+    }
+
+    // Extrapolate from the last sample and clamp the offset.
+    auto const h = options_.horizon_;
+    XnVector3D offset;
+    offset.X = static_cast<float>(vel[0]*h + 0.5*options_.acceleration_*acc[0]*h*h);
+    offset.Y = static_cast<float>(vel[1]*h + 0.5*options_.acceleration_*acc[1]*h*h);
+    offset.Z = static_cast<float>(vel[2]*h + 0.5*options_.acceleration_*acc[2]*h*h);
+    auto const len = length(offset);
+    if (len > options_.max_offset_)
+        offset *= static_cast<float>(options_.max_offset_ / len);
+    return x0 + offset;
+}
+
+/**
+ * @brief The SkeletonFilter class applies a JointFilter to each joint of each tracked user.
+ *
+ * Users are identified by their id. The filters of a joint are reset when the joint or the user
+ * is lost, so a reappearing joint does not drag its old position along.
+ */
+class SkeletonFilter
+{
+public:
+
+    explicit SkeletonFilter(JointFilterOptions const & options = JointFilterOptions())
+        :
+          options_(options)
+    {}
+
+    /**
+     * @brief Use the given filter for all joints. This resets all filters.
+     */
+    void set_options(JointFilterOptions const & options)
+    {
+        options_ = options;
+        entries_.clear();
+    }
+
+    JointFilterOptions const & options() const
+    {
+        return options_;
+    }
+
+    /**
+     * @brief Replace the joint positions of the given users by the filtered positions.
+     * @param timestamp the sensor timestamp of the users in microseconds
+     */
+    void apply(std::vector<User> & users, XnUInt64 timestamp);
+
+private:
+
+    /**
+     * @brief The filters of a single user.
+     */
+    struct Entry
+    {
+        explicit Entry(XnLabel id, JointFilterOptions const & options)
+            :
+              id_(id),
+              seen_(false)
+        {
+            real_.fill(JointFilter(options));
+            proj_.fill(JointFilter(options));
+            active_.fill(false);
+        }
+
+        XnLabel id_; // the user id
+        bool seen_; // whether the user was seen in the current frame
+        std::array<JointFilter, num_joints> real_; // filters for the real world positions
+        std::array<JointFilter, num_joints> proj_; // filters for the projective positions
+        std::array<bool, num_joints> active_; // whether the filters hold samples of the joint
+    };
+
+    JointFilterOptions options_; // the filter options
+    std::vector<Entry> entries_; // the filters of the known users
+
+};
+
+void SkeletonFilter::apply(std::vector<User> & users, XnUInt64 timestamp)
+{
+    if (options_.type_ == JointFilterOptions::None)
+        return;
+    auto const t = timestamp / 1e6;
+
+    for (auto & e : entries_)
+        e.seen_ = false;
+    for (auto & u : users)
+    {
+        // Find the filters of the user. New users only allocate once, the entries are kept afterwards.
+        Entry* entry = nullptr;
+        for (auto & e : entries_)
+            if (e.id_ == u.id_)
+                entry = &e;
+        if (entry == nullptr)
+        {
+            entries_.emplace_back(u.id_, options_);
+            entry = &entries_.back();
+        }
+        entry->seen_ = true;
+
+        for (size_t i = 0; i < num_joints; ++i)
+        {
+            auto const j = skeleton_joints[i];
+            if (!u.joints_.has(j))
+            {
+                if (entry->active_[i])
+                {
+                    entry->real_[i].reset();
+                    entry->proj_[i].reset();
+                    entry->active_[i] = false;
+                }
+                continue;
+            }
+            auto info = u.joints_.at(j);
+            info.real_position_ = entry->real_[i](info.real_position_, t);
+            info.proj_position_ = entry->proj_[i](info.proj_position_, t);
+            entry->active_[i] = true;
+            u.joints_.set(info);
+        }
+    }
+
+    // Reset the filters of lost users.
+    for (auto & e : entries_)
+    {
+        if (e.seen_)
+            continue;
+        for (size_t i = 0; i < num_joints; ++i)
+        {
+            if (e.active_[i])
+            {
+                e.real_[i].reset();
+                e.proj_[i].reset();
+                e.active_[i] = false;
+            }
+        }
+    }
+}
+
+} // namespace kin
+
+#endif
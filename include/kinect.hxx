@@ -5,295 +5,55 @@
 #include <string>
 #include <vector>
 #include <ostream>
-#include <map>
-#include <array>
+#include <algorithm>
 
 #include "platform_support.hxx"
 #include <XnCppWrapper.h>
 
 #include "ndarray.hxx"
 #include "utility.hxx"
+#include "sensor.hxx"
+#include "logger.hxx"
 
 
 namespace kin
 {
 
 /**
- * @brief Static constant array with all possible joints.
- */
-static std::array<XnSkeletonJoint, 24> const skeleton_joints = {
-    XN_SKEL_HEAD,
-    XN_SKEL_NECK,
-    XN_SKEL_TORSO,
-    XN_SKEL_WAIST,
-    XN_SKEL_LEFT_COLLAR,
-    XN_SKEL_LEFT_SHOULDER,
-    XN_SKEL_LEFT_ELBOW,
-    XN_SKEL_LEFT_WRIST,
-    XN_SKEL_LEFT_HAND,
-    XN_SKEL_LEFT_FINGERTIP,
-    XN_SKEL_RIGHT_COLLAR,
-    XN_SKEL_RIGHT_SHOULDER,
-    XN_SKEL_RIGHT_ELBOW,
-    XN_SKEL_RIGHT_WRIST,
-    XN_SKEL_RIGHT_HAND,
-    XN_SKEL_RIGHT_FINGERTIP,
-    XN_SKEL_LEFT_HIP,
-    XN_SKEL_LEFT_KNEE,
-    XN_SKEL_LEFT_ANKLE,
-    XN_SKEL_LEFT_FOOT,
-    XN_SKEL_RIGHT_HIP,
-    XN_SKEL_RIGHT_KNEE,
-    XN_SKEL_RIGHT_ANKLE,
-    XN_SKEL_RIGHT_FOOT
-};
-
-/**
- * @brief The JointInfo struct contains position and confidence values about a single joint.
- */
-struct JointInfo
-{
-    XnSkeletonJoint joint_;
-    XnConfidence confidence_;
-    XnPoint3D real_position_;
-    XnPoint3D proj_position_;
-
-    explicit JointInfo(XnSkeletonJoint joint = XnSkeletonJoint(),
-                       XnConfidence confidence = 0,
-                       XnPoint3D const & real_position = XnPoint3D(),
-                       XnPoint3D const & proj_position = XnPoint3D())
-        :
-          joint_(joint),
-          confidence_(confidence),
-          real_position_(real_position),
-          proj_position_(proj_position)
-    {}
-};
-
-/**
- * @brief The User class stores user information, e. g. whether the user left the scene.
+ * @brief The KinectSensor class runs a thread to gather data from a kinect sensor.
+ *
+ * The capture thread waits for the sensor and reads the depth map, the user labels and the
+ * skeletons into the published frames (see Sensor).
  */
-struct User
+class KinectSensor : public Sensor
 {
 public:
 
-    XnLabel id_;
-    bool visible_;
-    std::map<XnSkeletonJoint, JointInfo> joints_;
-
-    explicit User(XnLabel id = 0, bool visible = true)
-        :
-          id_(id),
-          visible_(visible)
-    {
-        base_change_ = sf::Transform::Identity;
-    }
-
     /**
-     * @brief Compute the base change matrix (real coordinates -> user plane coordinates).
+     * @brief How the capture thread waits for the generators.
      */
-    void compute_base_change()
+    enum Acquisition
     {
-        if (joints_.count(XN_SKEL_LEFT_SHOULDER) > 0 &&
-            joints_.count(XN_SKEL_RIGHT_SHOULDER) > 0)
-        {
-            auto s0 = joints_.at(XN_SKEL_LEFT_SHOULDER).real_position_;
-            auto s1 = joints_.at(XN_SKEL_RIGHT_SHOULDER).real_position_;
-            auto len = length(s1 - s0);
-
-            sf::Transform base(s1.X - s0.X, 0, s1.Z - s0.Z, 0, 1, 0, s1.Z - s0.Z, 0, s0.X - s1.X);
-            base_change_ = base.getInverse();
-            if (len > 0)
-            {
-                auto s = 1 / len;
-                sf::Transform scale(0, s, 0, 0, s, 0, 0, s, 0); // this may need to be transposed
-                base_change_ *= scale;
-                //base_change_(1, 0) /= len;
-                //base_change_(1, 1) /= len;
-                //base_change_(1, 2) /= len;
-            }
-        }
-    }
+        Synchronized, // wait for the user generator and update all generators together, so depth and labels belong to the same sensor frame
+        AnyUpdate // publish a frame as soon as any generator has new data (depth may come without labels and vice versa)
+    };
 
     /**
-     * @brief Transform the given vector from real coordinates to user plane coordinates.
+     * @brief Initialize the kinect components of the given device and start the thread that generates the depth data.
      */
-    XnVector3D transform_vector(XnVector3D const & v) const
-    {
-        XnVector3D ret;
-        ret.X = base_change_(0, 0) * v.X + base_change_(0, 1) * v.Y + base_change_(0, 2) * v.Z;
-        ret.Y = base_change_(1, 0) * v.X + base_change_(1, 1) * v.Y + base_change_(1, 2) * v.Z;
-        ret.Z = base_change_(2, 0) * v.X + base_change_(2, 1) * v.Y + base_change_(2, 2) * v.Z;
-        return ret;
-    }
-
-private:
-
-    sf::Transform base_change_; // the base change matrix
-
-};
-
-/**
- * @brief The UpdateDetails struct can be used to see which generators where updated in a kinect update step.
- */
-struct UpdateDetails
-{
-    explicit UpdateDetails(bool depth = false, bool user = false)
-        :
-          depth_(depth),
-          user_(user)
-    {}
-    bool depth_;
-    bool user_;
-};
-
-/**
- * @brief The KinectSensor class runs a thread to gather data from a kinect sensor.
- */
-class KinectSensor
-{
-public:
-
-    /**
-     * @brief Initialize the kinect components and start the thread that generates the depth data.
-     */
-    KinectSensor();
+    explicit KinectSensor(size_t device = 0, Acquisition acquisition = Synchronized);
 
     /**
      * @brief Release the kinect components and join the thread.
      */
     ~KinectSensor();
 
-    /**
-     * @brief Disable copy constructor to avoid duplicate kinect access.
-     */
-    KinectSensor(KinectSensor const & other) = delete;
-
-    /**
-     * @brief Disable assignment operator to avoid duplicate kinect access.
-     */
-    KinectSensor & operator=(KinectSensor const & other) = delete;
+protected:
 
     /**
-     * @brief Return the x resolution of the depth generator.
-     * @return the x resolution
+     * @brief Wait for the kinect and read the updated generators into the given frame.
      */
-    XnUInt32 x_res() const;
-
-    /**
-     * @brief Return the y resolution of the depth generator.
-     * @return the y resolution
-     */
-    XnUInt32 y_res() const;
-
-    /**
-     * @brief Return the z resolution of the depth generator.
-     * @return the z resolution
-     */
-    XnUInt32 z_res() const;
-
-    /**
-     * @brief The update method checks if the generators have produced new data. It should be called once per frame.
-     */
-    UpdateDetails update(float elapsed_time);
-
-    /**
-     * @brief Return the depth data.
-     */
-    Array2D<XnDepthPixel> const & depth_data() const
-    {
-        return depth_data_;
-    }
-
-    /**
-     * @brief Return the user pixel data.
-     */
-    Array2D<XnLabel> const & user_data() const
-    {
-        return user_data_;
-    }
-
-    /**
-     * @brief Return the users.
-     */
-    std::vector<User> const & users() const
-    {
-        return users_;
-    }
-    
-    /**
-     * @brief Return the position of the left hand.
-     */
-    XnVector3D hand_left() const
-    {
-        auto p = hand_left_.mean();
-        p.X = (p.X + 1.5) / 1.75;
-        p.Y = (p.Y - 0.7) / 1.5;
-//        p.Z = (p.Z + 1.0);
-        return p;
-    }
-    
-    /**
-     * @brief Return the position of the right hand.
-     */
-    XnVector3D hand_right() const
-    {
-        auto p = hand_right_.mean();
-        p.X = (p.X + 0.25) / 1.75;
-        p.Y = (p.Y - 0.7) / 1.5;
-//        p.Z = (p.Z + 1.0);
-        return p;
-    }
-
-    /**
-     * @brief Return whether the left hand is visible.
-     */
-    bool hand_left_visible() const
-    {
-        return hand_left_visible_;
-    }
-
-    /**
-     * @brief Return whether the right hand is visible.
-     */
-    bool hand_right_visible() const
-    {
-        return hand_right_visible_;
-    }
-
-    /**
-     * @brief Callback for clicks with the left hand.
-     */
-    std::function<void()> & handle_click_left()
-    {
-        return click_detector_left_.handle_click_;
-    }
-
-    /**
-     * @brief Callback for clicks with the right hand.
-     */
-    std::function<void()> & handle_click_right()
-    {
-        return click_detector_right_.handle_click_;
-    }
-
-    /**
-     * @brief Use depth for click detection.
-     */
-    void use_y_click()
-    {
-        click_detector_left_.use_y_ = true;
-        click_detector_right_.use_y_ = true;
-    }
-
-    /**
-     * @brief Use height for click detection.
-     */
-    void use_z_click()
-    {
-        click_detector_left_.use_y_ = false;
-        click_detector_right_.use_y_ = false;
-    }
+    UpdateDetails capture_impl(SensorFrame & frame);
 
 private:
 
@@ -301,16 +61,6 @@ private:
      * @brief Check if the status is OK and throw an exception if it is not.
      */
     void check_error(XnStatus status);
-    
-    /**
-     * @brief Compute the hand positions.
-     */
-    void compute_hand_positions();
-
-    /**
-     * @brief Check if the user made a click gesture.
-     */
-    void check_for_clicks(float elapsed_time);
 
     /**
      * @brief Callback for the "new user" event. Starts the calibration.
@@ -352,48 +102,57 @@ private:
 
 //    static void XN_CALLBACK_TYPE gesture_progress(xn::GestureGenerator &generator, const XnChar *strGesture, const XnPoint3D *pPosition, XnFloat fProgress, void *pCookie);
 
+    Acquisition acquisition_; // how the generators are updated
     xn::Context context_; // the kinect context
+    xn::Device device_; // the kinect device
 
     xn::DepthGenerator depth_generator_; // the depth generator
     xn::DepthMetaData depth_meta_; // the depth meta data
-    Array2D<XnDepthPixel> depth_data_; // the actual depth data
 
     xn::UserGenerator user_generator_; // the user generator
     xn::SceneMetaData user_meta_; // the user meta data
+    bool has_user_meta_; // whether the user generator delivered data yet
     bool need_pose_; // required pose for calibration
     std::string pose_name_;
     char* pose_name_ptr_;
-    Array2D<XnLabel> user_data_; // the combined pixel data of all users
-    std::vector<User> users_; // the current users
+    std::vector<User> users_; // the current users (capture thread)
+    std::vector<XnUserID> user_ids_; // buffer for the user ids of the user generator
+    std::vector<JointInfo> joint_buffer_; // the tracked joints of all users (without projective positions)
+    std::vector<size_t> joint_users_; // index of the user of each joint in joint_buffer_
+    std::vector<XnPoint3D> real_points_; // the real world positions of the joints in joint_buffer_
+    std::vector<XnPoint3D> proj_points_; // the projective positions of the joints in joint_buffer_
     std::vector<bool> user_visible_; // keeps track of the visibility of the users
 
 //    xn::GestureGenerator gesture_generator_; // the gesture generator
 //    XnBoundingBox3D* bounding_box_; // the gesture bounding box
 
-    Averager<XnVector3D, 10> hand_left_; // track the left hand
-    Averager<XnVector3D, 10> hand_right_; // track the right hand
-    bool hand_left_visible_; // whether the left hand is visible
-    bool hand_right_visible_; // whether the right hand is visible
-
-    ClickDetector click_detector_left_; // click detector for the left hand
-    ClickDetector click_detector_right_; // click detector for the right hand
-
 };
 
-KinectSensor::KinectSensor()
+KinectSensor::KinectSensor(size_t device, Acquisition acquisition)
     :
+      acquisition_(acquisition),
+      has_user_meta_(false),
       need_pose_(false),
       pose_name_(20, ' '),
-      pose_name_ptr_(&pose_name_[0]),
-      hand_left_({0, 0, 0}),
-      hand_right_({0, 0, 0}),
-      hand_left_visible_(false),
-      hand_right_visible_(false)
+      pose_name_ptr_(&pose_name_[0])
 {
-    // Initialize the kinect components.
+    // Initialize the kinect components. The generators are bound to the selected device.
     check_error(context_.Init());
-    check_error(depth_generator_.Create(context_));
-    check_error(user_generator_.Create(context_));
+    xn::NodeInfoList devices;
+    check_error(context_.EnumerateProductionTrees(XN_NODE_TYPE_DEVICE, NULL, devices));
+    auto it = devices.Begin();
+    for (size_t i = 0; i < device && it != devices.End(); ++i)
+        ++it;
+    if (it == devices.End())
+        throw std::runtime_error("KinectSensor::KinectSensor(): Device " + std::to_string(device) + " not found.");
+    xn::NodeInfo device_info = *it;
+    check_error(context_.CreateProductionTree(device_info, device_));
+    xn::Query depth_query;
+    check_error(depth_query.AddNeededNode(device_info.GetInstanceName()));
+    check_error(depth_generator_.Create(context_, &depth_query));
+    xn::Query user_query;
+    check_error(user_query.AddNeededNode(depth_generator_.GetName()));
+    check_error(user_generator_.Create(context_, &user_query));
     if (!user_generator_.IsCapabilitySupported(XN_CAPABILITY_SKELETON))
         throw std::runtime_error("KinectSensor::KinectSensor(): User generator does not support skeleton.");
     context_.SetGlobalMirror(true);
@@ -430,72 +189,67 @@ KinectSensor::KinectSensor()
     // Start generating the kinect data.
     check_error(context_.StartGeneratingAll());
 
-    // Get the kinect resolution to initialize the depth arrays.
+    // Get the kinect resolution and field of view and start the capture thread.
+    XnFieldOfView fov;
+    check_error(depth_generator_.GetFieldOfView(fov));
+    set_field_of_view(FieldOfView(static_cast<float>(fov.fHFOV), static_cast<float>(fov.fVFOV)));
     depth_generator_.GetMetaData(depth_meta_);
-    depth_data_.resize(x_res(), y_res());
-    user_data_.resize(x_res(), y_res());
+    start(depth_meta_.XRes(), depth_meta_.YRes(), depth_meta_.ZRes());
 }
 
 KinectSensor::~KinectSensor()
 {
+    stop();
     user_generator_.Release();
     depth_generator_.Release();
+    device_.Release();
     context_.Release();
 }
 
-XnUInt32 KinectSensor::x_res() const
-{
-    return depth_meta_.XRes();
-}
-
-XnUInt32 KinectSensor::y_res() const
-{
-    return depth_meta_.YRes();
-}
-
-XnUInt32 KinectSensor::z_res() const
-{
-    return depth_meta_.ZRes();
-}
-
-UpdateDetails KinectSensor::update(float elapsed_time)
+UpdateDetails KinectSensor::capture_impl(SensorFrame & frame)
 {
     UpdateDetails updates;
 
-    if (depth_generator_.IsNewDataAvailable())
-    {
-        check_error(depth_generator_.WaitAndUpdateData());
-        updates.depth_ = true;
-
-        // Get the depth map.
+    // Wait for the generators. The wait times out, so the capture thread can be stopped.
+    auto const status = acquisition_ == Synchronized ? context_.WaitOneUpdateAll(user_generator_) : context_.WaitAnyUpdateAll();
+    if (status == XN_STATUS_WAIT_DATA_TIMEOUT)
+        return updates;
+    check_error(status);
+    updates.depth_ = depth_generator_.IsDataNew();
+    updates.user_ = user_generator_.IsDataNew();
+    if (!updates.depth_ && !updates.user_)
+        return updates;
+    frame.timing_.mark(MarkAcquired);
+
+    if (updates.depth_)
         depth_generator_.GetMetaData(depth_meta_);
-        for (size_t y = 0; y < y_res(); ++y)
-            for (size_t x = 0; x < x_res(); ++x)
-                depth_data_(x, y) = depth_meta_(x, y);
-    }
 
-    if (user_generator_.IsNewDataAvailable())
+    if (updates.user_)
     {
-        check_error(user_generator_.WaitAndUpdateData());
-        updates.user_ = true;
+        has_user_meta_ = true;
 
         // Get the user pixels.
         user_generator_.GetUserPixels(0, user_meta_);
-        for (size_t y = 0; y < y_res(); ++y)
-            for (size_t x = 0; x < x_res(); ++x)
-                user_data_(x, y) = user_meta_(x, y);
-
-        // Get the user joints.
-        std::vector<XnUserID> user_ids(user_visible_.size());
-        XnUInt16 n_users = user_ids.size();
-        user_generator_.GetUsers(&user_ids.front(), n_users);
-        users_.clear();
+
+        // Get the user joints. The users are overwritten in place, so the buffers only grow
+        // when more users than ever before are tracked.
+        if (user_ids_.size() < user_visible_.size())
+            user_ids_.resize(user_visible_.size());
+        XnUInt16 n_users = user_visible_.size();
+        if (n_users > 0)
+            user_generator_.GetUsers(&user_ids_.front(), n_users);
+        size_t n_tracked = 0;
+        joint_buffer_.clear();
+        joint_users_.clear();
+        real_points_.clear();
         for (size_t i = 0; i < n_users; ++i)
         {
-            auto const user_id = user_ids[i];
+            auto const user_id = user_ids_[i];
             if (user_generator_.GetSkeletonCap().IsTracking(user_id))
             {
-                users_.emplace_back(user_id, user_visible_[user_id]);
+                if (n_tracked == users_.size())
+                    users_.emplace_back();
+                users_[n_tracked] = User(user_id, user_visible_[user_id]);
                 for (auto const j : skeleton_joints)
                 {
                     if (!user_generator_.GetSkeletonCap().IsJointActive(j))
@@ -504,21 +258,45 @@ UpdateDetails KinectSensor::update(float elapsed_time)
                     user_generator_.GetSkeletonCap().GetSkeletonJointPosition(user_id, j, jpos);
                     if (jpos.fConfidence < 0.7)
                         continue;
-                    XnPoint3D proj_pos;
-                    depth_generator_.ConvertRealWorldToProjective(1, &jpos.position, &proj_pos);
-                    users_.back().joints_[j] = JointInfo(j, jpos.fConfidence, jpos.position, proj_pos);
+                    joint_buffer_.emplace_back(j, jpos.fConfidence, jpos.position);
+                    joint_users_.push_back(n_tracked);
+                    real_points_.push_back(jpos.position);
                 }
-                users_.back().compute_base_change();
+                ++n_tracked;
             }
         }
+        users_.resize(n_tracked);
 
-        // Compute the new hand coordinates.
-        compute_hand_positions();
-
-        // Check for clicks.
-        check_for_clicks(elapsed_time);
+        // Project all joints of all users with a single call and scatter them into the users.
+        proj_points_.resize(real_points_.size());
+        if (!real_points_.empty())
+            check_error(depth_generator_.ConvertRealWorldToProjective(real_points_.size(), real_points_.data(), proj_points_.data()));
+        for (size_t k = 0; k < joint_buffer_.size(); ++k)
+        {
+            joint_buffer_[k].proj_position_ = proj_points_[k];
+            users_[joint_users_[k]].joints_.set(joint_buffer_[k]);
+        }
+        for (auto & user : users_)
+            user.compute_base_change();
     }
 
+    // The slot may hold an old frame, so both maps are copied, not only the updated one.
+    // The meta data buffers are reused by the next sensor update, so they cannot be handed out
+    // directly. Instead, each map is moved with a single bulk copy into the frame. The label
+    // bounds are computed while the label rows are still in the cache.
+    std::copy(depth_meta_.Data(), depth_meta_.Data() + x_res()*y_res(), frame.depth_data_.data());
+    if (has_user_meta_)
+        frame.label_bounds_ = copy_labels(user_meta_.Data(), frame.user_data_);
+    else
+        frame.label_bounds_ = Roi();
+    frame.users_ = users_;
+    frame.timestamp_ = depth_meta_.Timestamp();
+    frame.timing_.mark(MarkSkeleton);
+
+    // The user generator stamps its output with the time of the depth frame it was computed from.
+    updates.sensor_frame_ = depth_meta_.FrameID();
+    updates.synchronized_ = has_user_meta_ && user_meta_.Timestamp() == depth_meta_.Timestamp();
+
     return updates;
 }
 
@@ -533,7 +311,7 @@ void KinectSensor::check_error(XnStatus status)
 void XN_CALLBACK_TYPE KinectSensor::user_new(xn::UserGenerator & gen, XnUserID id, void* sensor_ptr)
 {
     KinectSensor & k = *static_cast<KinectSensor*>(sensor_ptr);
-    std::cout << "new user: " << id << std::endl;
+    Logger::instance().log(LogInfo, "kinect", id, "new user");
     if (id+1 > k.user_visible_.size())
         k.user_visible_.resize(id+1, false);
     k.user_visible_[id] = true;
@@ -546,14 +324,14 @@ void XN_CALLBACK_TYPE KinectSensor::user_new(xn::UserGenerator & gen, XnUserID i
 void XN_CALLBACK_TYPE KinectSensor::user_lost(xn::UserGenerator & gen, XnUserID id, void* sensor_ptr)
 {
     KinectSensor & k = *static_cast<KinectSensor*>(sensor_ptr);
-    std::cout << "lost user " << id << std::endl;
+    Logger::instance().log(LogInfo, "kinect", id, "lost user");
     k.user_visible_[id] = false;
 }
 
 void XN_CALLBACK_TYPE KinectSensor::user_calibration_start(xn::SkeletonCapability & cap, XnUserID id, void* sensor_ptr)
 {
     KinectSensor & k = *static_cast<KinectSensor*>(sensor_ptr);
-    std::cout << "starting calibration user " << id << std::endl;
+    Logger::instance().log(LogInfo, "kinect", id, "starting calibration");
 }
 
 void XN_CALLBACK_TYPE KinectSensor::user_calibration_complete(xn::SkeletonCapability & cap, XnUserID id, XnCalibrationStatus status, void* sensor_ptr)
@@ -561,12 +339,12 @@ void XN_CALLBACK_TYPE KinectSensor::user_calibration_complete(xn::SkeletonCapabi
     KinectSensor & k = *static_cast<KinectSensor*>(sensor_ptr);
     if (status == XN_CALIBRATION_STATUS_OK)
     {
-        std::cout << "calibration complete, start tracking user " << id << std::endl;
+        Logger::instance().log(LogInfo, "kinect", id, "calibration complete, start tracking");
         k.user_generator_.GetSkeletonCap().StartTracking(id);
     }
     else
     {
-        std::cout << "calibration failed for user " << id << ", trying again" << std::endl;
+        Logger::instance().log(LogWarning, "kinect", id, "calibration failed, trying again");
         if (k.need_pose_)
             k.user_generator_.GetPoseDetectionCap().StartPoseDetection(k.pose_name_ptr_, id);
         else
@@ -577,21 +355,21 @@ void XN_CALLBACK_TYPE KinectSensor::user_calibration_complete(xn::SkeletonCapabi
 void XN_CALLBACK_TYPE KinectSensor::user_exit(xn::UserGenerator & gen, XnUserID id, void* sensor_ptr)
 {
     KinectSensor & k = *static_cast<KinectSensor*>(sensor_ptr);
-    std::cout << "user " << id << " left scene" << std::endl;
+    Logger::instance().log(LogInfo, "kinect", id, "left scene");
     k.user_visible_[id] = false;
 }
 
 void XN_CALLBACK_TYPE KinectSensor::user_reenter(xn::UserGenerator & gen, XnUserID id, void* sensor_ptr)
 {
     KinectSensor & k = *static_cast<KinectSensor*>(sensor_ptr);
-    std::cout << "user " << id << " reentered scene" << std::endl;
+    Logger::instance().log(LogInfo, "kinect", id, "reentered scene");
     k.user_visible_[id] = true;
 }
 
 void XN_CALLBACK_TYPE KinectSensor::pose_detected(xn::PoseDetectionCapability& , const XnChar* strPose, XnUserID nId, void* sensor_ptr)
 {
     KinectSensor & k = *static_cast<KinectSensor*>(sensor_ptr);
-    std::cout << "pose "<< strPose << " detected."<< std::endl;
+    Logger::instance().log(LogInfo, "kinect", nId, "pose %s detected", strPose);
     k.user_generator_.GetPoseDetectionCap().StopPoseDetection(nId);
     k.user_generator_.GetSkeletonCap().RequestCalibration(nId,true);
 }
@@ -605,73 +383,6 @@ void XN_CALLBACK_TYPE KinectSensor::pose_detected(xn::PoseDetectionCapability& ,
 //{
 //}
 
-void KinectSensor::compute_hand_positions()
-{
-    // Only track if there are users.
-    if (users_.size() == 0)
-        return;
-    
-    // Only track if the main joints are known.
-    auto const & u = users_.front();
-    if (u.joints_.count(XN_SKEL_TORSO) == 0 ||
-        u.joints_.count(XN_SKEL_LEFT_SHOULDER) == 0 ||
-        u.joints_.count(XN_SKEL_RIGHT_SHOULDER) == 0)
-        return;
-        
-    // Track the left hand.
-    hand_left_visible_ = false;
-    if (u.joints_.count(XN_SKEL_LEFT_HAND) > 0)
-    {
-        hand_left_visible_ = true;
-
-        // Get the hand coordinates and transform them relative to the user plane position.
-        auto hand_pos = u.joints_.at(XN_SKEL_LEFT_HAND).real_position_;
-        auto torso = u.joints_.at(XN_SKEL_TORSO).real_position_;
-        auto ret = u.transform_vector(hand_pos - torso);
-        ret.Y = 1.5 - ret.Y;
-        
-        // Update the hand positions.
-        if (hand_left_.empty())
-            hand_left_.push(ret);
-        else if (length(hand_left_.mean() - ret) > 0.04) // Stabilization: Only update if the hand moved a significant amount.
-            hand_left_.push(ret);
-    }
-    
-    // Track the right hand.
-    hand_right_visible_ = false;
-    if (u.joints_.count(XN_SKEL_RIGHT_HAND) > 0)
-    {
-        hand_right_visible_ = true;
-
-        // Get the hand coordinates and transform them relative to the user plane position.
-        auto hand_pos = u.joints_.at(XN_SKEL_RIGHT_HAND).real_position_;
-        auto torso = u.joints_.at(XN_SKEL_TORSO).real_position_;
-        auto ret = u.transform_vector(hand_pos - torso);
-        ret.Y = 1.5 - ret.Y;
-        
-        // Update the hand positions.
-        if (hand_right_.empty())
-            hand_right_.push(ret);
-        else if (length(hand_right_.mean() - ret) > 0.04) // Stabilization: Only update if the hand moved a significant amount.
-            hand_right_.push(ret);
-    }
-}
-
-void KinectSensor::check_for_clicks(float elapsed_time)
-{
-    if (hand_left_visible())
-        click_detector_left_.update(elapsed_time, hand_left_.back());
-    else
-        click_detector_left_.reset();
-
-    if (hand_right_visible())
-        click_detector_right_.update(elapsed_time, hand_right_.back());
-    else
-        click_detector_left_.reset();
-}
-
-
-
 } // namespace kin
 
 
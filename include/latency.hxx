@@ -0,0 +1,323 @@
+#ifndef LATENCY_HXX
+#define LATENCY_HXX
+
+#include <array>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+
+#include "utility.hxx"
+
+namespace kin
+{
+
+typedef std::chrono::steady_clock LatencyClock;
+
+/**
+ * @brief The points in the processing of a frame at which it is time stamped (in this order).
+ */
+enum LatencyMark
+{
+    MarkAcquired, // the sensor delivered the data
+    MarkSkeleton, // depth, labels and skeletons are extracted
+    MarkFiltered, // the joints are filtered and the hand positions are computed
+    MarkGrabbed, // Sensor::update() grabbed the frame
+    MarkHovered, // the game handled the cursor position
+    MarkUpdated, // the game was updated
+    MarkRendered, // the game was rendered
+    MarkDisplayed, // the rendered image was displayed
+    num_latency_marks
+};
+
+/**
+ * @brief The FrameTiming struct holds the monotonic time stamps of a single sensor frame.
+ */
+struct FrameTiming
+{
+    FrameTiming()
+        :
+          sensor_timestamp_(0)
+    {}
+
+    /**
+     * @brief Store the current time for the given mark.
+     */
+    void mark(LatencyMark m)
+    {
+        marks_[m] = LatencyClock::now();
+    }
+
+    /**
+     * @brief Return whether the given mark was set.
+     */
+    bool has(LatencyMark m) const
+    {
+        return marks_[m] != LatencyClock::time_point();
+    }
+
+    /**
+     * @brief Clear all marks.
+     */
+    void reset()
+    {
+        marks_.fill(LatencyClock::time_point());
+        sensor_timestamp_ = 0;
+    }
+
+    XnUInt64 sensor_timestamp_; // the sensor timestamp in microseconds
+    std::array<LatencyClock::time_point, num_latency_marks> marks_; // the time stamps (default constructed if not set)
+};
+
+/**
+ * @brief Histogram of latencies with a resolution of 0.1 ms up to one second.
+ */
+class LatencyHistogram
+{
+public:
+
+    LatencyHistogram()
+        :
+          bins_(num_bins + 1, 0),
+          count_(0),
+          sum_(0),
+          max_(0)
+    {}
+
+    /**
+     * @brief Add a latency in milliseconds.
+     */
+    void add(double ms)
+    {
+        auto const b = static_cast<size_t>(std::max(0.0, ms) / bin_width);
+        ++bins_[b < num_bins ? b : num_bins];
+        ++count_;
+        sum_ += ms;
+        max_ = std::max(max_, ms);
+    }
+
+    /**
+     * @brief Return the given percentile (0 < p <= 100) in milliseconds (upper bin border, at most the maximum).
+     */
+    double percentile(double p) const
+    {
+        if (count_ == 0)
+            return 0;
+        auto const target = static_cast<size_t>(std::ceil(p / 100.0 * count_));
+        size_t sum = 0;
+        for (size_t b = 0; b < bins_.size(); ++b)
+        {
+            sum += bins_[b];
+            if (sum >= target && sum > 0)
+                return b < num_bins ? std::min((b+1) * bin_width, max_) : max_;
+        }
+        return max_;
+    }
+
+    size_t count() const
+    {
+        return count_;
+    }
+
+    double mean() const
+    {
+        return count_ == 0 ? 0 : sum_ / count_;
+    }
+
+    double max() const
+    {
+        return max_;
+    }
+
+    /**
+     * @brief Return the bin counts. The last bin counts all latencies of one second and more.
+     */
+    std::vector<size_t> const & bins() const
+    {
+        return bins_;
+    }
+
+    void clear()
+    {
+        std::fill(bins_.begin(), bins_.end(), 0);
+        count_ = 0;
+        sum_ = 0;
+        max_ = 0;
+    }
+
+    static size_t const num_bins = 10000;
+    static double constexpr bin_width = 0.1; // bin width in milliseconds
+
+private:
+
+    std::vector<size_t> bins_; // the bins
+    size_t count_; // number of samples
+    double sum_; // sum of all samples
+    double max_; // the largest sample
+
+};
+
+/**
+ * @brief The LatencyProfile class collects the per-stage and total latencies of the frames.
+ *
+ * A stage is the time between two consecutive marks. If a mark is missing (e. g. the game was not
+ * hovered since no hand was visible), the stage is measured from the last earlier mark. The total
+ * latency is the time from acquisition to display.
+ */
+class LatencyProfile
+{
+public:
+
+    /**
+     * @brief The number of stages (one per mark after the first one, plus the total).
+     */
+    static size_t const num_stages = num_latency_marks;
+
+    /**
+     * @param max_frames number of frames whose single latencies are kept for dump()
+     */
+    explicit LatencyProfile(size_t max_frames = 100000)
+        :
+          max_frames_(max_frames)
+    {}
+
+    /**
+     * @brief Return the name of the given stage.
+     */
+    static char const * stage_name(size_t stage)
+    {
+        static char const * const names[num_stages] = {
+            "skeleton", "filter", "queue", "hover", "update", "render", "display", "total"
+        };
+        return names[stage];
+    }
+
+    /**
+     * @brief Add the latencies of a completely processed frame.
+     */
+    void add(FrameTiming const & timing);
+
+    /**
+     * @brief Return the histogram of the given stage.
+     */
+    LatencyHistogram const & histogram(size_t stage) const
+    {
+        return histograms_[stage];
+    }
+
+    /**
+     * @brief Return a table with p50, p95 and p99 of all stages.
+     */
+    std::string summary() const;
+
+    /**
+     * @brief Write the summary, the histograms and the latencies of the single frames into the given file.
+     */
+    void dump(std::string const & filename) const;
+
+    void clear()
+    {
+        for (auto & h : histograms_)
+            h.clear();
+        frames_.clear();
+    }
+
+private:
+
+    typedef std::array<float, num_stages> FrameLatencies; // latencies of a single frame (negative: stage not measured)
+
+    std::array<LatencyHistogram, num_stages> histograms_; // the histograms
+    std::vector<std::pair<XnUInt64, FrameLatencies> > frames_; // sensor timestamp and latencies of the single frames
+    size_t max_frames_; // maximum size of frames_
+
+};
+
+void LatencyProfile::add(FrameTiming const & timing)
+{
+    if (!timing.has(MarkAcquired) || !timing.has(MarkDisplayed))
+        return;
+    auto const ms = [](LatencyClock::duration d){
+        return std::chrono::duration<double, std::milli>(d).count();
+    };
+
+    FrameLatencies latencies;
+    latencies.fill(-1.0f);
+    size_t last = MarkAcquired;
+    for (size_t m = MarkAcquired+1; m < num_latency_marks; ++m)
+    {
+        if (!timing.has(static_cast<LatencyMark>(m)))
+            continue;
+        auto const d = ms(timing.marks_[m] - timing.marks_[last]);
+        histograms_[m-1].add(d);
+        latencies[m-1] = static_cast<float>(d);
+        last = m;
+    }
+    auto const total = ms(timing.marks_[MarkDisplayed] - timing.marks_[MarkAcquired]);
+    histograms_[num_stages-1].add(total);
+    latencies[num_stages-1] = static_cast<float>(total);
+
+    if (frames_.size() < max_frames_)
+        frames_.emplace_back(timing.sensor_timestamp_, latencies);
+}
+
+std::string LatencyProfile::summary() const
+{
+    std::ostringstream s;
+    s << std::fixed << std::setprecision(1);
+    s << std::setw(10) << std::left << "stage" << std::right
+      << std::setw(8) << "p50" << std::setw(8) << "p95" << std::setw(8) << "p99" << std::setw(8) << "max" << "  [ms]\n";
+    for (size_t i = 0; i < num_stages; ++i)
+    {
+        auto const & h = histograms_[i];
+        s << std::setw(10) << std::left << stage_name(i) << std::right
+          << std::setw(8) << h.percentile(50) << std::setw(8) << h.percentile(95)
+          << std::setw(8) << h.percentile(99) << std::setw(8) << h.max() << "\n";
+    }
+    s << histograms_[num_stages-1].count() << " frames";
+    return s.str();
+}
+
+void LatencyProfile::dump(std::string const & filename) const
+{
+    std::ofstream f(filename);
+    if (!f)
+        throw std::runtime_error("LatencyProfile::dump(): Could not open " + filename);
+
+    f << "# Latency summary\n" << summary() << "\n\n";
+
+    // The histograms: one row per non-empty bin.
+    f << "# Histograms\nstage,bin_start_ms,count\n";
+    for (size_t i = 0; i < num_stages; ++i)
+    {
+        auto const & bins = histograms_[i].bins();
+        for (size_t b = 0; b < bins.size(); ++b)
+            if (bins[b] > 0)
+                f << stage_name(i) << "," << b * LatencyHistogram::bin_width << "," << bins[b] << "\n";
+    }
+
+    // The single frames.
+    f << "\n# Frames\nsensor_timestamp_us";
+    for (size_t i = 0; i < num_stages; ++i)
+        f << "," << stage_name(i) << "_ms";
+    f << "\n";
+    for (auto const & p : frames_)
+    {
+        f << p.first;
+        for (auto const v : p.second)
+        {
+            f << ",";
+            if (v >= 0)
+                f << v;
+        }
+        f << "\n";
+    }
+}
+
+} // namespace kin
+
+#endif
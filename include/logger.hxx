@@ -0,0 +1,319 @@
+#ifndef LOGGER_HXX
+#define LOGGER_HXX
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <ostream>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdint>
+
+namespace kin
+{
+
+/**
+ * @brief The severity of a log message.
+ */
+enum LogLevel
+{
+    LogDebug,
+    LogInfo,
+    LogWarning,
+    LogError
+};
+
+/**
+ * @brief The LogRecord struct holds one log message and its fields. It has a fixed size, so logging never allocates.
+ */
+struct LogRecord
+{
+    static size_t const max_message = 96;
+
+    LogLevel level_; // the severity
+    uint64_t timestamp_; // microseconds since the logger was created
+    char const * source_; // the component that wrote the message (must be a string literal)
+    int user_; // the user id the message refers to (-1: none)
+    char message_[max_message]; // the message, truncated if necessary
+};
+
+/**
+ * @brief The Logger class writes log messages from any thread without blocking the caller.
+ *
+ * log() formats the message into a fixed-size record and pushes it into a lock-free ring buffer
+ * (a bounded multi-producer queue with a sequence number per slot). A background thread drains the
+ * ring and writes the records to the output, flushing once per batch. If the ring is full, the
+ * message is dropped and counted instead of waiting for the writer, so the OpenNI callbacks and
+ * the capture threads are never stalled by terminal or file I/O.
+ */
+class Logger
+{
+public:
+
+    /**
+     * @brief Return the global logger. It writes to std::cout until set_output() is called.
+     */
+    static Logger & instance()
+    {
+        static Logger l;
+        return l;
+    }
+
+    ~Logger();
+
+    /**
+     * @brief Write the messages with at least the given level (default: LogInfo).
+     */
+    void set_level(LogLevel level)
+    {
+        level_.store(level, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Write the messages into the given file instead of std::cout.
+     */
+    void set_output(std::string const & filename);
+
+    /**
+     * @brief Log a printf style message about the given user (-1: no user).
+     */
+    void log(LogLevel level, char const * source, int user, char const * format, ...)
+#ifdef __GNUC__
+        __attribute__((format(printf, 5, 6)))
+#endif
+        ;
+
+    /**
+     * @brief Return the number of messages that were dropped because the ring buffer was full.
+     */
+    size_t dropped() const
+    {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Wait until the writer thread wrote all messages that were logged so far.
+     */
+    void flush();
+
+private:
+
+    typedef std::chrono::steady_clock Clock;
+
+    /**
+     * @brief A slot of the ring buffer. The sequence number tells producers and the writer whose turn it is.
+     */
+    struct Slot
+    {
+        std::atomic<size_t> sequence_; // == position: free for the producer, == position+1: ready for the writer
+        LogRecord record_; // the message
+    };
+
+    static size_t const capacity = 1024; // number of slots (power of two)
+
+    Logger();
+
+    Logger(Logger const &) = delete;
+    Logger & operator=(Logger const &) = delete;
+
+    /**
+     * @brief Push the record into the ring buffer. Return false if the ring is full.
+     */
+    bool push(LogRecord const & record);
+
+    /**
+     * @brief Pop the next record from the ring buffer (writer thread only). Return false if the ring is empty.
+     */
+    bool pop(LogRecord & record);
+
+    /**
+     * @brief The writer thread: Drain the ring buffer until the logger is destroyed.
+     */
+    void write_loop();
+
+    /**
+     * @brief Write a batch of records and flush the output (writer thread only). Return the number of written records.
+     */
+    size_t write_batch();
+
+    std::unique_ptr<Slot[]> slots_; // the ring buffer
+    std::atomic<size_t> head_; // the next position that is claimed by a producer
+    size_t tail_; // the next position that is read by the writer (writer thread)
+    std::atomic<size_t> written_; // number of records the writer has handled
+    std::atomic<size_t> dropped_; // number of dropped messages
+    size_t reported_dropped_; // number of dropped messages that were reported (writer thread)
+    std::atomic<int> level_; // the minimum level
+    Clock::time_point start_time_; // the time the logger was created
+
+    std::shared_ptr<std::ostream> output_; // the output (use atomic access)
+    std::atomic<bool> running_; // cleared to stop the writer thread
+    std::thread writer_; // the writer thread
+
+};
+
+Logger::Logger()
+    :
+      slots_(new Slot[capacity]),
+      head_(0),
+      tail_(0),
+      written_(0),
+      dropped_(0),
+      reported_dropped_(0),
+      level_(LogInfo),
+      start_time_(Clock::now()),
+      output_(&std::cout, [](std::ostream *){}),
+      running_(true)
+{
+    for (size_t i = 0; i < capacity; ++i)
+        slots_[i].sequence_.store(i, std::memory_order_relaxed);
+    writer_ = std::thread(&Logger::write_loop, this);
+}
+
+Logger::~Logger()
+{
+    running_ = false;
+    writer_.join();
+}
+
+void Logger::set_output(std::string const & filename)
+{
+    std::shared_ptr<std::ostream> out = std::make_shared<std::ofstream>(filename);
+    if (!*out)
+        throw std::runtime_error("Logger::set_output(): Could not open " + filename + ".");
+    std::atomic_store(&output_, out);
+}
+
+void Logger::log(LogLevel level, char const * source, int user, char const * format, ...)
+{
+    if (level < level_.load(std::memory_order_relaxed))
+        return;
+
+    LogRecord record;
+    record.level_ = level;
+    record.timestamp_ = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start_time_).count());
+    record.source_ = source;
+    record.user_ = user;
+    va_list args;
+    va_start(args, format);
+    std::vsnprintf(record.message_, LogRecord::max_message, format, args);
+    va_end(args);
+
+    if (!push(record))
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Logger::flush()
+{
+    auto const target = head_.load(std::memory_order_acquire);
+    while (written_.load(std::memory_order_acquire) < target)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+bool Logger::push(LogRecord const & record)
+{
+    auto pos = head_.load(std::memory_order_relaxed);
+    while (true)
+    {
+        auto & slot = slots_[pos % capacity];
+        auto const seq = slot.sequence_.load(std::memory_order_acquire);
+        if (seq == pos)
+        {
+            // The slot is free, try to claim it.
+            if (head_.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed))
+            {
+                slot.record_ = record;
+                slot.sequence_.store(pos+1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (seq < pos)
+        {
+            // The writer has not freed the slot yet: the ring is full.
+            return false;
+        }
+        else
+        {
+            // Another producer claimed the slot.
+            pos = head_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool Logger::pop(LogRecord & record)
+{
+    auto & slot = slots_[tail_ % capacity];
+    if (slot.sequence_.load(std::memory_order_acquire) != tail_+1)
+        return false;
+    record = slot.record_;
+    slot.sequence_.store(tail_ + capacity, std::memory_order_release);
+    ++tail_;
+    return true;
+}
+
+void Logger::write_loop()
+{
+    while (running_)
+    {
+        if (write_batch() == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    write_batch();
+}
+
+size_t Logger::write_batch()
+{
+    static char const * const level_names[] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
+
+    auto const out = std::atomic_load(&output_);
+    size_t n = 0;
+    LogRecord record;
+    while (pop(record))
+    {
+        // Format the time stamp without changing the stream flags, std::cout is shared with other code.
+        char time[32];
+        std::snprintf(time, sizeof(time), "[%6llu.%06llu] ",
+                      static_cast<unsigned long long>(record.timestamp_ / 1000000),
+                      static_cast<unsigned long long>(record.timestamp_ % 1000000));
+        *out << time << level_names[record.level_] << " " << record.source_;
+        if (record.user_ >= 0)
+            *out << " user=" << record.user_;
+        *out << " " << record.message_ << "\n";
+        ++n;
+    }
+    auto const dropped = dropped_.load(std::memory_order_relaxed);
+    bool const report = dropped != reported_dropped_;
+    if (report)
+    {
+        *out << "[logger] " << dropped - reported_dropped_ << " messages dropped\n";
+        reported_dropped_ = dropped;
+    }
+    if (n > 0 || report)
+        out->flush();
+    written_.fetch_add(n, std::memory_order_release);
+    return n;
+}
+
+/**
+ * @brief Parse a log level: debug, info, warning or error.
+ */
+LogLevel parse_log_level(std::string const & name)
+{
+    if (name == "debug")
+        return LogDebug;
+    if (name == "info")
+        return LogInfo;
+    if (name == "warning")
+        return LogWarning;
+    if (name == "error")
+        return LogError;
+    throw std::runtime_error("parse_log_level(): Unknown log level: " + name);
+}
+
+} // namespace kin
+
+#endif
@@ -175,6 +175,13 @@ public:
      */
     void hide_mouse();
 
+    /**
+     * @brief Let the menu items glide by the given distance (positive moves them down), e.g. after a swipe.
+     *
+     * If the items are still gliding, they stop instead.
+     */
+    void fling(float distance);
+
     std::function<void(std::string const &)> handle_menu_item_click_; // the callback for a click on a menu item
     std::function<void()> handle_close_; // the callback for the close event
 
@@ -539,12 +546,7 @@ void MenuOverlay::update_impl(
     {
         auto strength = scroll_wheel_.y / (1000 * scroll_movement_time_);
         if (std::abs(strength) > 1)
-        {
-            if (item_container_->actions().empty())
-                item_container_->add_action(std::make_shared<MoveByAction>(sf::Vector2f(0, strength), 1.5f, MoveByAction::Interpolation::Quadratic));
-            else
-                item_container_->clear_actions();
-        }
+            fling(strength);
 
         scroll_movement_time_ = 0;
     }
@@ -576,6 +578,14 @@ void MenuOverlay::hide_mouse()
     opts.mouse_->hide();
 }
 
+void MenuOverlay::fling(float distance)
+{
+    if (item_container_->actions().empty())
+        item_container_->add_action(std::make_shared<MoveByAction>(sf::Vector2f(0, distance), 1.5f, MoveByAction::Interpolation::Quadratic));
+    else
+        item_container_->clear_actions();
+}
+
 
 
 }
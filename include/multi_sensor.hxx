@@ -0,0 +1,428 @@
+#ifndef MULTI_SENSOR_HXX
+#define MULTI_SENSOR_HXX
+
+#include <array>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+
+#include "sensor.hxx"
+#include "sensor_pose.hxx"
+#include "logger.hxx"
+
+namespace kin
+{
+
+/**
+ * @brief The MultiSensor class merges the users of several sensors into one user list in world coordinates.
+ *
+ * Every source keeps capturing on its own thread. The capture thread of the MultiSensor grabs the
+ * latest frame of each source, maps the joints into world coordinates with the pose of the source
+ * and merges the users that are seen by several sources: Users of different sources whose torsos
+ * are closer than the merge distance are the same person. Their joints are averaged, weighted by
+ * the confidence. Each merged user has a world id that does not depend on the sources and that
+ * is kept as long as any source tracks the user.
+ *
+ * Depth and labels are taken from the first source, the labels are translated to the world ids.
+ * The projective joint positions are the ones of the first source that sees the user. The joints
+ * of the sources are not filtered, the merged users are filtered by the MultiSensor instead.
+ * Since the sources have independent clocks, the frames are time stamped when they are merged.
+ */
+class MultiSensor : public Sensor
+{
+public:
+
+    /**
+     * @brief Take over the given sources and start the merge thread.
+     * @param sensors the sources (at least one, at most max_sources)
+     * @param poses the pose of each source (sources without pose are placed at the origin)
+     * @param merge_distance users of different sources whose torsos are closer than this (mm) are merged
+     */
+    MultiSensor(std::vector<std::unique_ptr<Sensor> > sensors, std::vector<SensorPose> const & poses, float merge_distance = 400.0f);
+
+    /**
+     * @brief Join the merge thread and stop the sources.
+     */
+    ~MultiSensor();
+
+    /**
+     * @brief Return the number of sources.
+     */
+    size_t num_sources() const
+    {
+        return sources_.size();
+    }
+
+    /**
+     * @brief Return the pose of the given source.
+     */
+    SensorPose const & pose(size_t i) const
+    {
+        return sources_[i].pose_;
+    }
+
+    static size_t const max_sources = 64;
+
+protected:
+
+    /**
+     * @brief Wait for new frames of the sources and merge the latest frames of all sources into the given frame.
+     */
+    UpdateDetails capture_impl(SensorFrame & frame);
+
+private:
+
+    typedef std::chrono::steady_clock Clock;
+
+    /**
+     * @brief A source sensor and the translation of its user ids.
+     */
+    struct Source
+    {
+        std::unique_ptr<Sensor> sensor_; // the sensor
+        SensorPose pose_; // the pose of the sensor
+        std::vector<XnLabel> world_ids_; // world id of each user id of the sensor (0: not tracked)
+    };
+
+    /**
+     * @brief A user of a single source in world coordinates.
+     */
+    struct Observation
+    {
+        size_t source_; // index of the source
+        XnLabel world_id_; // the world id of the previous frame (0: new user)
+        XnVector3D center_; // the torso (or the mean of the joints)
+        size_t merged_; // index of the merged user
+        User user_; // the user with world coordinates
+    };
+
+    /**
+     * @brief Transform the users of all sources into world coordinates.
+     */
+    void collect_observations();
+
+    /**
+     * @brief Merge the observations into users_ and assign the world ids.
+     */
+    void merge_observations();
+
+    /**
+     * @brief Add the observation to the merged user m.
+     */
+    void add_observation(size_t m, Observation & o);
+
+    /**
+     * @brief Append a merged user that consists of the given observation.
+     */
+    void add_user(Observation & o, XnLabel world_id);
+
+    /**
+     * @brief Return whether observations of the given source can be added to the merged user m.
+     */
+    bool can_merge(size_t m, size_t source, XnVector3D const & center) const
+    {
+        return (user_sources_[m] & (uint64_t(1) << source)) == 0 && length(user_centers_[m] - center) < merge_distance_;
+    }
+
+    std::vector<Source> sources_; // the sources
+    float merge_distance_; // maximum torso distance of merged users (mm)
+    Clock::time_point start_time_; // the time stamps are measured from here
+
+    std::vector<Observation> observations_; // the users of all sources (capture thread)
+    std::vector<User> users_; // the merged users (capture thread)
+    std::vector<std::array<float, num_joints> > user_weights_; // summed confidence of each joint of the merged users (capture thread)
+    std::vector<uint64_t> user_sources_; // bitmask of the sources that see the merged users (capture thread)
+    std::vector<XnVector3D> user_centers_; // center of the merged users (capture thread)
+    std::vector<bool> previous_ids_; // the world ids of the previous frame (capture thread)
+    std::vector<bool> current_ids_; // the world ids of the current frame (capture thread)
+
+};
+
+MultiSensor::MultiSensor(std::vector<std::unique_ptr<Sensor> > sensors, std::vector<SensorPose> const & poses, float merge_distance)
+    :
+      merge_distance_(merge_distance),
+      start_time_(Clock::now())
+{
+    if (sensors.empty() || sensors.size() > max_sources)
+        throw std::runtime_error("MultiSensor::MultiSensor(): Invalid number of sources.");
+    for (size_t i = 0; i < sensors.size(); ++i)
+    {
+        if (!sensors[i])
+            throw std::runtime_error("MultiSensor::MultiSensor(): Empty source.");
+
+        // The merged users are filtered and predicted, so the sources only pass the joints through.
+        sensors[i]->set_joint_filter(JointFilterOptions(JointFilterOptions::None));
+        sensors[i]->set_hand_prediction(PredictionOptions(0.0f));
+        sensors[i]->set_depth_pyramid(DepthPyramidOptions(0));
+
+        Source s;
+        s.sensor_ = std::move(sensors[i]);
+        if (i < poses.size())
+            s.pose_ = poses[i];
+        sources_.push_back(std::move(s));
+    }
+
+    auto const & primary = *sources_.front().sensor_;
+    set_field_of_view(primary.field_of_view());
+    start(primary.x_res(), primary.y_res(), primary.z_res());
+}
+
+MultiSensor::~MultiSensor()
+{
+    stop();
+}
+
+UpdateDetails MultiSensor::capture_impl(SensorFrame & frame)
+{
+    // Grab the latest frame of each source. Only the first source provides the depth.
+    UpdateDetails updates;
+    LatencyClock::time_point acquired;
+    for (size_t i = 0; i < sources_.size(); ++i)
+    {
+        auto & sensor = *sources_[i].sensor_;
+        auto const u = sensor.update(0);
+        if (!u.depth_ && !u.user_)
+            continue;
+        if (i == 0)
+            updates.depth_ = u.depth_;
+        updates.user_ = updates.user_ || u.user_;
+
+        // The merged frame is as old as the oldest new data in it.
+        auto const & timing = sensor.frame().timing_;
+        if (timing.has(MarkAcquired) && (acquired == LatencyClock::time_point() || timing.marks_[MarkAcquired] < acquired))
+            acquired = timing.marks_[MarkAcquired];
+    }
+    if (!updates.depth_ && !updates.user_)
+    {
+        // The sources cannot notify this thread, so poll them with a short sleep.
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+        return updates;
+    }
+    if (acquired != LatencyClock::time_point())
+        frame.timing_.marks_[MarkAcquired] = acquired;
+
+    if (updates.user_)
+    {
+        collect_observations();
+        merge_observations();
+    }
+
+    // Copy the depth of the first source and translate its labels to the world ids.
+    auto const & primary = sources_.front();
+    auto const & primary_frame = primary.sensor_->frame();
+    std::copy(primary_frame.depth_data_.begin(), primary_frame.depth_data_.end(), frame.depth_data_.begin());
+    auto const & ids = primary.world_ids_;
+    std::transform(primary_frame.user_data_.begin(), primary_frame.user_data_.end(), frame.user_data_.begin(),
+                   [&ids](XnLabel l){
+        return l < ids.size() ? ids[l] : XnLabel(0);
+    });
+    frame.label_bounds_ = primary_frame.label_bounds_;
+    frame.users_ = users_;
+    frame.timestamp_ = static_cast<XnUInt64>(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start_time_).count());
+    frame.timing_.mark(MarkSkeleton);
+
+    // The merged frames are numbered like the depth of the first source, so its lost frames show up as gaps.
+    updates.sensor_frame_ = primary_frame.sensor_frame_;
+    updates.synchronized_ = primary_frame.synchronized_;
+
+    return updates;
+}
+
+void MultiSensor::collect_observations()
+{
+    observations_.clear();
+    for (size_t i = 0; i < sources_.size(); ++i)
+    {
+        auto const & s = sources_[i];
+        for (auto const & u : s.sensor_->frame().users_)
+        {
+            observations_.emplace_back();
+            auto & o = observations_.back();
+            o.source_ = i;
+            o.world_id_ = u.id_ < s.world_ids_.size() ? s.world_ids_[u.id_] : 0;
+            o.merged_ = 0;
+            o.user_ = User(u.id_, u.visible_);
+
+            XnVector3D sum = {0, 0, 0};
+            for (auto j : u.joints_)
+            {
+                j.real_position_ = s.pose_.to_world(j.real_position_);
+                sum += j.real_position_;
+                o.user_.joints_.set(j);
+            }
+            if (o.user_.joints_.has(XN_SKEL_TORSO))
+                o.center_ = o.user_.joints_.at(XN_SKEL_TORSO).real_position_;
+            else if (!o.user_.joints_.empty())
+                o.center_ = sum / static_cast<float>(o.user_.joints_.size());
+            else
+                o.center_ = to_xn(s.pose_.translation_); // users without joints are not merged with others
+        }
+    }
+}
+
+void MultiSensor::merge_observations()
+{
+    users_.clear();
+    user_weights_.clear();
+    user_sources_.clear();
+    user_centers_.clear();
+
+    // Observations that were tracked before join the merged user with their world id, unless
+    // the user was split up in the meantime.
+    for (auto & o : observations_)
+    {
+        if (o.world_id_ == 0)
+            continue;
+        auto const it = std::find_if(users_.begin(), users_.end(), [&o](User const & u){
+            return u.id_ == o.world_id_;
+        });
+        if (it == users_.end())
+            add_user(o, o.world_id_);
+        else if (can_merge(it - users_.begin(), o.source_, o.center_))
+            add_observation(it - users_.begin(), o);
+        else
+            o.world_id_ = 0;
+    }
+
+    // The other observations join the closest user of the other sources or start a new user.
+    for (auto & o : observations_)
+    {
+        if (o.world_id_ != 0)
+            continue;
+        size_t best = users_.size();
+        float best_distance = merge_distance_;
+        for (size_t m = 0; m < users_.size(); ++m)
+        {
+            auto const d = length(user_centers_[m] - o.center_);
+            if (d < best_distance && can_merge(m, o.source_, o.center_))
+            {
+                best = m;
+                best_distance = d;
+            }
+        }
+        if (best < users_.size())
+            add_observation(best, o);
+        else
+            add_user(o, 0);
+    }
+
+    // Users that were tracked separately by different sources and met each other are merged
+    // into the user with the smaller world id.
+    for (size_t a = 0; a < users_.size(); ++a)
+    {
+        for (size_t b = a+1; b < users_.size(); )
+        {
+            bool const disjoint = (user_sources_[a] & user_sources_[b]) == 0;
+            if (!disjoint || length(user_centers_[a] - user_centers_[b]) >= merge_distance_)
+            {
+                ++b;
+                continue;
+            }
+            auto const id_a = users_[a].id_;
+            auto const id_b = users_[b].id_;
+            for (auto & o : observations_)
+                if (o.merged_ == b)
+                    add_observation(a, o);
+            users_[a].id_ = id_a == 0 ? id_b : id_b == 0 ? id_a : std::min(id_a, id_b);
+
+            // Remove the merged user and fix the indices of the observations.
+            users_.erase(users_.begin() + b);
+            user_weights_.erase(user_weights_.begin() + b);
+            user_sources_.erase(user_sources_.begin() + b);
+            user_centers_.erase(user_centers_.begin() + b);
+            for (auto & o : observations_)
+            {
+                if (o.merged_ > b)
+                    --o.merged_;
+            }
+        }
+    }
+
+    // Assign new world ids. Ids of the previous frame are not reused right away, so a new user is
+    // never mistaken for a lost one.
+    current_ids_.assign(current_ids_.size(), false);
+    for (auto const & u : users_)
+    {
+        if (u.id_ >= current_ids_.size())
+            current_ids_.resize(u.id_+1, false);
+        current_ids_[u.id_] = true;
+    }
+    XnLabel next_id = 1;
+    for (auto & u : users_)
+    {
+        if (u.id_ != 0)
+            continue;
+        while ((next_id < current_ids_.size() && current_ids_[next_id]) ||
+               (next_id < previous_ids_.size() && previous_ids_[next_id]))
+            ++next_id;
+        if (next_id == 0)
+            throw std::runtime_error("MultiSensor::merge_observations(): Out of user ids.");
+        u.id_ = next_id;
+        if (next_id >= current_ids_.size())
+            current_ids_.resize(next_id+1, false);
+        current_ids_[next_id] = true;
+        Logger::instance().log(LogDebug, "multi", u.id_, "new merged user");
+    }
+    previous_ids_.swap(current_ids_);
+
+    // Remember the world ids of the source users.
+    for (auto & s : sources_)
+        std::fill(s.world_ids_.begin(), s.world_ids_.end(), 0);
+    for (auto const & o : observations_)
+    {
+        auto & ids = sources_[o.source_].world_ids_;
+        if (o.user_.id_ >= ids.size())
+            ids.resize(o.user_.id_+1, 0);
+        ids[o.user_.id_] = users_[o.merged_].id_;
+    }
+
+    for (auto & u : users_)
+        u.compute_base_change();
+}
+
+void MultiSensor::add_user(Observation & o, XnLabel world_id)
+{
+    o.merged_ = users_.size();
+    users_.push_back(User(world_id, o.user_.visible_));
+    user_weights_.emplace_back();
+    user_weights_.back().fill(0.0f);
+    user_sources_.push_back(0);
+    user_centers_.push_back(o.center_);
+    add_observation(o.merged_, o);
+}
+
+void MultiSensor::add_observation(size_t m, Observation & o)
+{
+    auto & u = users_[m];
+    auto & weights = user_weights_[m];
+    o.merged_ = m;
+    u.visible_ = u.visible_ || o.user_.visible_;
+    user_sources_[m] |= uint64_t(1) << o.source_;
+
+    // Average the joints, weighted by the confidence.
+    for (auto const & j : o.user_.joints_)
+    {
+        auto const i = joint_index(j.joint_);
+        auto const w = std::max(j.confidence_, 1e-3f);
+        if (!u.joints_.has(j.joint_))
+        {
+            u.joints_.set(j);
+            weights[i] = w;
+            continue;
+        }
+        auto joint = u.joints_.at(j.joint_);
+        joint.real_position_ = (joint.real_position_ * weights[i] + j.real_position_ * w) / (weights[i] + w);
+        joint.confidence_ = std::max(joint.confidence_, j.confidence_);
+        weights[i] += w;
+        u.joints_.set(joint);
+    }
+    user_centers_[m] = u.joints_.has(XN_SKEL_TORSO) ? u.joints_.at(XN_SKEL_TORSO).real_position_ : user_centers_[m];
+}
+
+} // namespace kin
+
+#endif
@@ -50,6 +50,16 @@ public:
         return data_[y*width_+x];
     }
 
+    value_type * data()
+    {
+        return data_.data();
+    }
+
+    value_type const * data() const
+    {
+        return data_.data();
+    }
+
     reference front()
     {
         return data_.front();
@@ -108,6 +118,103 @@ private:
 
 };
 
+/**
+ * @brief Read-only 2D view on memory that is owned by someone else.
+ *
+ * The view has the same interface as a const Array2D, so it can be passed to all functions that
+ * read from an Array2D. It is only valid as long as the viewed memory is valid.
+ */
+template <typename T>
+class Array2DView
+{
+public:
+
+    typedef T value_type;
+    typedef value_type const & reference;
+    typedef value_type const & const_reference;
+    typedef value_type const * iterator;
+    typedef value_type const * const_iterator;
+
+    explicit Array2DView(value_type const * data = nullptr, size_t width = 0, size_t height = 0)
+        :
+          data_(data),
+          width_(width),
+          height_(height)
+    {}
+
+    Array2DView(Array2D<value_type> const & a)
+        :
+          data_(a.data()),
+          width_(a.width()),
+          height_(a.height())
+    {}
+
+    size_t width() const
+    {
+        return width_;
+    }
+
+    size_t height() const
+    {
+        return height_;
+    }
+
+    const_reference operator()(size_t x, size_t y) const
+    {
+        return data_[y*width_+x];
+    }
+
+    value_type const * data() const
+    {
+        return data_;
+    }
+
+    /**
+     * @brief Return the pointer to the first element of row y.
+     */
+    value_type const * row(size_t y) const
+    {
+        return data_ + y*width_;
+    }
+
+    const_reference front() const
+    {
+        return data_[0];
+    }
+
+    const_reference back() const
+    {
+        return data_[width_*height_-1];
+    }
+
+    const_iterator begin() const
+    {
+        return data_;
+    }
+
+    const_iterator cbegin() const
+    {
+        return data_;
+    }
+
+    const_iterator end() const
+    {
+        return data_ + width_*height_;
+    }
+
+    const_iterator cend() const
+    {
+        return data_ + width_*height_;
+    }
+
+private:
+
+    value_type const * data_;
+    size_t width_;
+    size_t height_;
+
+};
+
 
 
 #endif
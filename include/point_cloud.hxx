@@ -0,0 +1,285 @@
+#ifndef POINT_CLOUD_HXX
+#define POINT_CLOUD_HXX
+
+#include <vector>
+#include <cmath>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "platform_support.hxx"
+#ifdef OPENNI_FOUND
+#include <XnCppWrapper.h>
+#endif
+
+#include "ndarray.hxx"
+#include "utility.hxx"
+#include "vecmath.hxx"
+#include "thread_pool.hxx"
+
+namespace kin
+{
+
+/**
+ * @brief The FieldOfView struct holds the opening angles of the depth camera in radians.
+ */
+struct FieldOfView
+{
+    explicit FieldOfView(float horizontal = 1.0144f, float vertical = 0.7898f)
+        :
+          horizontal_(horizontal),
+          vertical_(vertical)
+    {}
+
+    float horizontal_; // horizontal field of view (kinect default)
+    float vertical_; // vertical field of view (kinect default)
+};
+
+/**
+ * @brief The RayTable class holds the viewing ray of every depth pixel.
+ *
+ * The ray of pixel (x, y) is (x(x, y), y(x, y), 1), so multiplying it by the depth gives the real
+ * world point in mm, like ConvertProjectiveToRealWorld() of OpenNI does. The table is computed once
+ * per resolution, the conversion of a frame then needs two multiplications per pixel.
+ */
+class RayTable
+{
+public:
+
+    RayTable()
+    {}
+
+    /**
+     * @brief Compute the rays of a depth image of the given size that covers the field of view.
+     *
+     * A level of the depth pyramid covers the same field of view with a smaller size.
+     */
+    RayTable(size_t width, size_t height, FieldOfView const & fov);
+
+    size_t width() const
+    {
+        return x_.width();
+    }
+
+    size_t height() const
+    {
+        return x_.height();
+    }
+
+    /**
+     * @brief Return the x components of the rays (real world x per mm of depth).
+     */
+    Array2D<float> const & x() const
+    {
+        return x_;
+    }
+
+    /**
+     * @brief Return the y components of the rays (real world y per mm of depth).
+     */
+    Array2D<float> const & y() const
+    {
+        return y_;
+    }
+
+private:
+
+    Array2D<float> x_; // the x components
+    Array2D<float> y_; // the y components
+
+};
+
+RayTable::RayTable(size_t width, size_t height, FieldOfView const & fov)
+    :
+      x_(width, height),
+      y_(width, height)
+{
+    // The same factors as in the projective conversion of OpenNI.
+    auto const x_to_z = 2.0 * std::tan(fov.horizontal_ / 2.0);
+    auto const y_to_z = 2.0 * std::tan(fov.vertical_ / 2.0);
+    for (size_t y = 0; y < height; ++y)
+    {
+        auto const ry = static_cast<float>((0.5 - y / static_cast<double>(height)) * y_to_z);
+        for (size_t x = 0; x < width; ++x)
+        {
+            x_(x, y) = static_cast<float>((x / static_cast<double>(width) - 0.5) * x_to_z);
+            y_(x, y) = ry;
+        }
+    }
+}
+
+/**
+ * @brief The PointCloud class holds the real world points (mm) of a grid of depth pixels as packed XYZ triples.
+ *
+ * The points are stored row by row. Pixels without depth give the point (0, 0, 0).
+ */
+class PointCloud
+{
+public:
+
+    PointCloud()
+        :
+          width_(0),
+          height_(0)
+    {}
+
+    /**
+     * @brief Set the size of the grid. The buffer only grows, so converting frames of the same size does not allocate.
+     */
+    void resize(size_t width, size_t height)
+    {
+        width_ = width;
+        height_ = height;
+        if (points_.size() < width * height)
+            points_.resize(width * height);
+    }
+
+    size_t width() const
+    {
+        return width_;
+    }
+
+    size_t height() const
+    {
+        return height_;
+    }
+
+    size_t size() const
+    {
+        return width_ * height_;
+    }
+
+    XnPoint3D & operator()(size_t x, size_t y)
+    {
+        return points_[y*width_+x];
+    }
+
+    XnPoint3D const & operator()(size_t x, size_t y) const
+    {
+        return points_[y*width_+x];
+    }
+
+    /**
+     * @brief Return the packed coordinates x0, y0, z0, x1, ...
+     */
+    float * data()
+    {
+        return &points_.front().X;
+    }
+
+    float const * data() const
+    {
+        return &points_.front().X;
+    }
+
+private:
+
+    static_assert(sizeof(XnPoint3D) == 3 * sizeof(float), "PointCloud: XnPoint3D must be packed.");
+
+    size_t width_; // the grid size
+    size_t height_;
+    std::vector<XnPoint3D> points_; // the points (may be longer than the grid)
+
+};
+
+namespace points
+{
+
+/**
+ * @brief Convert n depth pixels, taking every step-th pixel, to packed XYZ points.
+ *
+ * With SSE2 and step 1, four pixels are converted at once and interleaved to XYZ (see vecmath::store_xyz()).
+ */
+inline void convert_row(
+        XnDepthPixel const * depth,
+        float const * ray_x,
+        float const * ray_y,
+        size_t n,
+        size_t step,
+        float * out
+){
+    size_t i = 0;
+#ifdef __SSE2__
+    if (step == 1)
+    {
+        __m128i const zero = _mm_setzero_si128();
+        for (; i+4 <= n; i += 4)
+        {
+            auto const d16 = _mm_loadl_epi64(reinterpret_cast<__m128i const *>(depth+i));
+            auto const z = _mm_cvtepi32_ps(_mm_unpacklo_epi16(d16, zero));
+            auto const x = _mm_mul_ps(z, _mm_loadu_ps(ray_x+i));
+            auto const y = _mm_mul_ps(z, _mm_loadu_ps(ray_y+i));
+            vecmath::store_xyz(x, y, z, out + 3*i);
+        }
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        auto const z = static_cast<float>(depth[i*step]);
+        out[3*i] = z * ray_x[i*step];
+        out[3*i+1] = z * ray_y[i*step];
+        out[3*i+2] = z;
+    }
+}
+
+} // namespace points
+
+/**
+ * @brief Convert every step-th depth pixel inside of roi (in x and y) to real world points.
+ *
+ * The cloud gets one point per converted pixel, row by row. The ray table must have the size of
+ * the depth image. If a thread pool is given, the rows are split among its threads.
+ */
+template <typename DEPTHARRAY>
+void depth_to_points(
+        DEPTHARRAY const & depth_data,
+        RayTable const & rays,
+        Roi const & roi,
+        size_t step,
+        PointCloud & cloud,
+        ThreadPool * pool = nullptr
+){
+    if (depth_data.width() != rays.width() || depth_data.height() != rays.height())
+        throw std::runtime_error("depth_to_points(): Shape mismatch.");
+    if (roi.x1_ > depth_data.width() || roi.y1_ > depth_data.height())
+        throw std::runtime_error("depth_to_points(): ROI out of range.");
+    if (step == 0)
+        throw std::runtime_error("depth_to_points(): The step must be greater than zero.");
+
+    auto const w = (roi.width() + step - 1) / step;
+    auto const h = (roi.height() + step - 1) / step;
+    cloud.resize(w, h);
+    if (w == 0 || h == 0)
+        return;
+
+    auto const convert = [&](size_t row_begin, size_t row_end){
+        for (size_t r = row_begin; r < row_end; ++r)
+        {
+            auto const y = roi.y0_ + r * step;
+            points::convert_row(&depth_data(roi.x0_, y), &rays.x()(roi.x0_, y), &rays.y()(roi.x0_, y), w, step, &cloud(0, r).X);
+        }
+    };
+    if (pool)
+        pool->parallel_for(0, h, 16, convert);
+    else
+        convert(0, h);
+}
+
+/**
+ * @brief Convert all depth pixels to real world points.
+ */
+template <typename DEPTHARRAY>
+void depth_to_points(
+        DEPTHARRAY const & depth_data,
+        RayTable const & rays,
+        PointCloud & cloud,
+        ThreadPool * pool = nullptr
+){
+    depth_to_points(depth_data, rays, Roi::full(depth_data.width(), depth_data.height()), 1, cloud, pool);
+}
+
+} // namespace kin
+
+#endif
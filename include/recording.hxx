@@ -0,0 +1,635 @@
+#ifndef RECORDING_HXX
+#define RECORDING_HXX
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+#include <mutex>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include "sensor.hxx"
+#include "depth_codec.hxx"
+
+namespace kin
+{
+
+/**
+ * @brief Read-only memory mapping of a whole file.
+ */
+class MappedFile
+{
+public:
+
+    explicit MappedFile(std::string const & filename);
+
+    ~MappedFile();
+
+    MappedFile(MappedFile const & other) = delete;
+
+    MappedFile & operator=(MappedFile const & other) = delete;
+
+    /**
+     * @brief Return the pointer to the first byte of the file.
+     */
+    char const * data() const
+    {
+        return data_;
+    }
+
+    /**
+     * @brief Return the file size in bytes.
+     */
+    size_t size() const
+    {
+        return size_;
+    }
+
+private:
+
+    char const * data_; // the mapped memory
+    size_t size_; // the file size
+#ifdef _MSC_VER
+    HANDLE file_; // the file handle
+    HANDLE mapping_; // the mapping handle
+#endif
+
+};
+
+#ifdef _MSC_VER
+
+MappedFile::MappedFile(std::string const & filename)
+    :
+      data_(nullptr),
+      size_(0),
+      file_(INVALID_HANDLE_VALUE),
+      mapping_(NULL)
+{
+    file_ = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_ == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("MappedFile::MappedFile(): Could not open " + filename);
+    LARGE_INTEGER size;
+    GetFileSizeEx(file_, &size);
+    size_ = static_cast<size_t>(size.QuadPart);
+    if (size_ == 0)
+        return;
+    mapping_ = CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping_ != NULL)
+        data_ = static_cast<char const *>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    if (data_ == nullptr)
+    {
+        if (mapping_ != NULL)
+            CloseHandle(mapping_);
+        CloseHandle(file_);
+        throw std::runtime_error("MappedFile::MappedFile(): Could not map " + filename);
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    if (data_ != nullptr)
+        UnmapViewOfFile(data_);
+    if (mapping_ != NULL)
+        CloseHandle(mapping_);
+    CloseHandle(file_);
+}
+
+#else
+
+MappedFile::MappedFile(std::string const & filename)
+    :
+      data_(nullptr),
+      size_(0)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("MappedFile::MappedFile(): Could not open " + filename);
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        close(fd);
+        throw std::runtime_error("MappedFile::MappedFile(): Could not stat " + filename);
+    }
+    size_ = static_cast<size_t>(info.st_size);
+    if (size_ > 0)
+    {
+        void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            close(fd);
+            throw std::runtime_error("MappedFile::MappedFile(): Could not map " + filename);
+        }
+        data_ = static_cast<char const *>(p);
+    }
+    close(fd); // the mapping stays valid after closing the descriptor
+}
+
+MappedFile::~MappedFile()
+{
+    if (data_ != nullptr)
+        munmap(const_cast<char*>(data_), size_);
+}
+
+#endif
+
+/**
+ * @brief The on-disk layout of a sensor recording.
+ *
+ * A recording starts with the FileHeader. It is followed by the frames, each consisting of a
+ * FrameHeader, the depth pixels, the label pixels and the users (UserRecord followed by its
+ * JointRecords). The file ends with the frame index, one IndexEntry per frame. All numbers are
+ * stored in the byte order of the recording machine.
+ *
+ * Depth and labels are either stored raw or compressed (see depth_codec.hxx), which is marked in
+ * the frame flags. Compressed depth delta frames need all frames since the last keyframe.
+ */
+namespace recording
+{
+
+static char const magic[8] = {'K', 'I', 'N', 'R', 'E', 'C', '0', '1'};
+static uint32_t const version = 2; // version 2 added the field of view
+
+enum FrameFlags
+{
+    DepthNew = 1,
+    UserNew = 2,
+    DepthEncoded = 4, // the depth is compressed with the DepthEncoder
+    LabelsEncoded = 8, // the labels are compressed with encode_labels()
+    Keyframe = 16, // the depth is raw or a compressed keyframe
+    Unsynchronized = 32 // the labels belong to another sensor frame than the depth
+};
+
+struct FileHeader
+{
+    char magic_[8];
+    uint32_t version_;
+    uint32_t x_res_;
+    uint32_t y_res_;
+    uint32_t z_res_;
+    uint64_t frame_count_;
+    uint64_t index_offset_;
+    float horizontal_fov_; // field of view of the depth camera in radians
+    float vertical_fov_;
+};
+
+struct FrameHeader
+{
+    uint64_t timestamp_; // sensor timestamp in microseconds
+    uint32_t flags_; // combination of FrameFlags
+    uint32_t num_users_;
+    uint32_t depth_bytes_; // size of the stored depth data
+    uint32_t label_bytes_; // size of the stored label data
+};
+
+struct UserRecord
+{
+    uint32_t id_;
+    uint32_t visible_;
+    uint32_t num_joints_;
+};
+
+struct JointRecord
+{
+    uint32_t joint_;
+    float confidence_;
+    float real_position_[3];
+    float proj_position_[3];
+};
+
+struct IndexEntry
+{
+    uint64_t offset_; // file offset of the FrameHeader
+    uint64_t timestamp_; // sensor timestamp in microseconds
+};
+
+/**
+ * @brief Copy a trivial struct out of a (possibly unaligned) buffer and advance the pointer.
+ */
+template <typename T>
+T read_struct(char const * & p)
+{
+    T t;
+    std::memcpy(&t, p, sizeof(T));
+    p += sizeof(T);
+    return t;
+}
+
+} // namespace recording
+
+/**
+ * @brief Streams sensor frames into a recording file that can be played back with a ReplaySensor.
+ *
+ * The resolution and the field of view are those of the recorded sensor, so the replay unprojects the depth like the original.
+ * Attach it to a sensor with attach(). The frame index is written when the recorder is closed or destroyed.
+ * By default, depth and labels are compressed losslessly with a keyframe every keyframe_interval frames.
+ */
+class SensorRecorder
+{
+public:
+
+    SensorRecorder(
+            std::string const & filename,
+            XnUInt32 x_res,
+            XnUInt32 y_res,
+            XnUInt32 z_res,
+            FieldOfView const & fov,
+            bool compress = true,
+            size_t keyframe_interval = 30
+    );
+
+    ~SensorRecorder();
+
+    SensorRecorder(SensorRecorder const & other) = delete;
+
+    SensorRecorder & operator=(SensorRecorder const & other) = delete;
+
+    /**
+     * @brief Append the given frame.
+     */
+    void write(SensorFrame const & frame, UpdateDetails const & updates);
+
+    /**
+     * @brief Write the frame index and close the file. Later frames are ignored.
+     */
+    void close();
+
+    /**
+     * @brief Return the number of written frames.
+     */
+    size_t size() const
+    {
+        return index_.size();
+    }
+
+    /**
+     * @brief Record the frames of the given sensor from now on.
+     *
+     * The sensors capture from their construction on, so the frames that were captured before are not recorded.
+     */
+    static void attach(Sensor & sensor, std::shared_ptr<SensorRecorder> recorder)
+    {
+        sensor.set_frame_callback([recorder](SensorFrame const & frame, UpdateDetails const & updates){
+            recorder->write(frame, updates);
+        });
+    }
+
+private:
+
+    template <typename T>
+    void write_struct(T const & t)
+    {
+        out_.write(reinterpret_cast<char const *>(&t), sizeof(T));
+    }
+
+    void write_header();
+
+    std::ofstream out_; // the output file
+    recording::FileHeader header_; // the file header
+    std::vector<recording::IndexEntry> index_; // the frame index
+    bool compress_; // whether to compress depth and labels
+    DepthEncoder depth_encoder_; // the depth encoder
+    std::vector<uint8_t> depth_buffer_; // the encoded depth of the current frame
+    std::vector<uint8_t> label_buffer_; // the encoded labels of the current frame
+    std::mutex mutex_; // write() and close() may be called from different threads
+
+};
+
+SensorRecorder::SensorRecorder(
+        std::string const & filename,
+        XnUInt32 x_res,
+        XnUInt32 y_res,
+        XnUInt32 z_res,
+        FieldOfView const & fov,
+        bool compress,
+        size_t keyframe_interval
+)   :
+      out_(filename, std::ios::binary | std::ios::trunc),
+      compress_(compress),
+      depth_encoder_(keyframe_interval)
+{
+    if (!out_)
+        throw std::runtime_error("SensorRecorder::SensorRecorder(): Could not open " + filename);
+    std::memcpy(header_.magic_, recording::magic, sizeof(recording::magic));
+    header_.version_ = recording::version;
+    header_.x_res_ = x_res;
+    header_.y_res_ = y_res;
+    header_.z_res_ = z_res;
+    header_.frame_count_ = 0;
+    header_.index_offset_ = 0;
+    header_.horizontal_fov_ = fov.horizontal_;
+    header_.vertical_fov_ = fov.vertical_;
+    write_header();
+}
+
+SensorRecorder::~SensorRecorder()
+{
+    close();
+}
+
+void SensorRecorder::write_header()
+{
+    out_.seekp(0);
+    write_struct(header_);
+}
+
+void SensorRecorder::write(SensorFrame const & frame, UpdateDetails const & updates)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!out_.is_open())
+        return;
+    if (frame.depth_data_.width() != header_.x_res_ || frame.depth_data_.height() != header_.y_res_)
+        throw std::runtime_error("SensorRecorder::write(): Shape mismatch.");
+
+    auto const num_pixels = header_.x_res_ * header_.y_res_;
+    recording::IndexEntry entry;
+    entry.offset_ = static_cast<uint64_t>(out_.tellp());
+    entry.timestamp_ = frame.timestamp_;
+
+    recording::FrameHeader h;
+    h.timestamp_ = frame.timestamp_;
+    h.flags_ = (updates.depth_ ? recording::DepthNew : 0) | (updates.user_ ? recording::UserNew : 0) |
+               (updates.synchronized_ ? 0 : recording::Unsynchronized);
+    h.num_users_ = static_cast<uint32_t>(frame.users_.size());
+    if (compress_)
+    {
+        depth_buffer_.clear();
+        label_buffer_.clear();
+        bool const keyframe = depth_encoder_.encode(frame.depth_data_, depth_buffer_);
+        encode_labels(frame.user_data_, label_buffer_);
+        h.flags_ |= recording::DepthEncoded | recording::LabelsEncoded | (keyframe ? recording::Keyframe : 0);
+        h.depth_bytes_ = static_cast<uint32_t>(depth_buffer_.size());
+        h.label_bytes_ = static_cast<uint32_t>(label_buffer_.size());
+        write_struct(h);
+        out_.write(reinterpret_cast<char const *>(depth_buffer_.data()), h.depth_bytes_);
+        out_.write(reinterpret_cast<char const *>(label_buffer_.data()), h.label_bytes_);
+    }
+    else
+    {
+        h.flags_ |= recording::Keyframe;
+        h.depth_bytes_ = num_pixels * sizeof(XnDepthPixel);
+        h.label_bytes_ = num_pixels * sizeof(XnLabel);
+        write_struct(h);
+        out_.write(reinterpret_cast<char const *>(frame.depth_data_.data()), h.depth_bytes_);
+        out_.write(reinterpret_cast<char const *>(frame.user_data_.data()), h.label_bytes_);
+    }
+
+    for (auto const & u : frame.users_)
+    {
+        recording::UserRecord ur;
+        ur.id_ = u.id_;
+        ur.visible_ = u.visible_ ? 1 : 0;
+        ur.num_joints_ = static_cast<uint32_t>(u.joints_.size());
+        write_struct(ur);
+        for (auto const & j : u.joints_)
+        {
+            recording::JointRecord jr;
+            jr.joint_ = j.joint_;
+            jr.confidence_ = j.confidence_;
+            jr.real_position_[0] = j.real_position_.X;
+            jr.real_position_[1] = j.real_position_.Y;
+            jr.real_position_[2] = j.real_position_.Z;
+            jr.proj_position_[0] = j.proj_position_.X;
+            jr.proj_position_[1] = j.proj_position_.Y;
+            jr.proj_position_[2] = j.proj_position_.Z;
+            write_struct(jr);
+        }
+    }
+    index_.push_back(entry);
+}
+
+void SensorRecorder::close()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!out_.is_open())
+        return;
+    header_.index_offset_ = static_cast<uint64_t>(out_.tellp());
+    header_.frame_count_ = index_.size();
+    for (auto const & e : index_)
+        write_struct(e);
+    write_header();
+    out_.close();
+}
+
+/**
+ * @brief Memory-mapped, seekable read access to a recording file.
+ */
+class Recording
+{
+public:
+
+    explicit Recording(std::string const & filename);
+
+    /**
+     * @brief Return the number of frames.
+     */
+    size_t size() const
+    {
+        return static_cast<size_t>(header_.frame_count_);
+    }
+
+    XnUInt32 x_res() const
+    {
+        return header_.x_res_;
+    }
+
+    XnUInt32 y_res() const
+    {
+        return header_.y_res_;
+    }
+
+    XnUInt32 z_res() const
+    {
+        return header_.z_res_;
+    }
+
+    /**
+     * @brief Return the field of view of the recorded depth camera.
+     */
+    FieldOfView field_of_view() const
+    {
+        return FieldOfView(header_.horizontal_fov_, header_.vertical_fov_);
+    }
+
+    /**
+     * @brief Return the timestamp of frame i in microseconds.
+     */
+    XnUInt64 timestamp(size_t i) const
+    {
+        return index_entry(i).timestamp_;
+    }
+
+    /**
+     * @brief Read frame i into the given frame and return which parts were new when it was recorded.
+     *
+     * The frame number of the returned details is i+1: The recording holds the frames that reached
+     * the recorder, so the frames that were lost before are not visible in a replay.
+     * @note Reading the frames in order is fastest, since compressed delta frames are decoded from their predecessor.
+     */
+    UpdateDetails read(size_t i, SensorFrame & frame) const;
+
+private:
+
+    /**
+     * @brief Return the frame header of frame i.
+     */
+    recording::FrameHeader frame_header(size_t i) const
+    {
+        char const * p = frame_data(i);
+        return recording::read_struct<recording::FrameHeader>(p);
+    }
+
+    /**
+     * @brief Return the position of the frame header of frame i. It throws if the header does not fit into the file.
+     */
+    char const * frame_data(size_t i) const
+    {
+        auto const offset = index_entry(i).offset_;
+        if (offset > file_.size() || file_.size() - offset < sizeof(recording::FrameHeader))
+            throw std::runtime_error("Recording::frame_data(): Corrupt frame.");
+        return file_.data() + offset;
+    }
+
+    /**
+     * @brief Return the number of bytes from p (inside of the file) to the end of the file.
+     */
+    size_t remaining(char const * p) const
+    {
+        return static_cast<size_t>(file_.data() + file_.size() - p);
+    }
+
+    /**
+     * @brief Decode the depth of frame i into out. The depth decoder must hold frame i-1 if frame i is a delta frame.
+     */
+    void read_depth(size_t i, Array2D<XnDepthPixel> & out) const;
+
+    recording::IndexEntry index_entry(size_t i) const
+    {
+        if (i >= size())
+            throw std::out_of_range("Recording::index_entry(): Frame index out of range.");
+        char const * p = file_.data() + header_.index_offset_ + i * sizeof(recording::IndexEntry);
+        return recording::read_struct<recording::IndexEntry>(p);
+    }
+
+    MappedFile file_; // the mapped recording
+    recording::FileHeader header_; // the file header
+    mutable DepthDecoder depth_decoder_; // decoder for compressed depth
+    mutable size_t last_depth_; // the frame that was decoded last, or npos
+    mutable Array2D<XnDepthPixel> scratch_; // target for the frames that are decoded while seeking
+
+};
+
+Recording::Recording(std::string const & filename)
+    :
+      file_(filename),
+      last_depth_(std::string::npos)
+{
+    if (file_.size() < sizeof(recording::FileHeader))
+        throw std::runtime_error("Recording::Recording(): File too small: " + filename);
+    char const * p = file_.data();
+    header_ = recording::read_struct<recording::FileHeader>(p);
+    if (std::memcmp(header_.magic_, recording::magic, sizeof(recording::magic)) != 0)
+        throw std::runtime_error("Recording::Recording(): Not a recording: " + filename);
+    if (header_.version_ != recording::version)
+        throw std::runtime_error("Recording::Recording(): Unsupported version: " + filename);
+    if (header_.index_offset_ == 0 ||
+        header_.index_offset_ + header_.frame_count_ * sizeof(recording::IndexEntry) > file_.size())
+        throw std::runtime_error("Recording::Recording(): Missing frame index (recording was not closed?): " + filename);
+}
+
+void Recording::read_depth(size_t i, Array2D<XnDepthPixel> & out) const
+{
+    char const * p = frame_data(i);
+    auto const h = recording::read_struct<recording::FrameHeader>(p);
+    out.resize(header_.x_res_, header_.y_res_);
+    if (h.flags_ & recording::DepthEncoded)
+    {
+        if (remaining(p) < h.depth_bytes_)
+            throw std::runtime_error("Recording::read_depth(): Corrupt frame.");
+        depth_decoder_.decode(reinterpret_cast<uint8_t const *>(p), h.depth_bytes_, (h.flags_ & recording::Keyframe) != 0, out);
+    }
+    else
+    {
+        if (h.depth_bytes_ != out.width() * out.height() * sizeof(XnDepthPixel) || remaining(p) < h.depth_bytes_)
+            throw std::runtime_error("Recording::read_depth(): Corrupt frame.");
+        std::memcpy(out.data(), p, h.depth_bytes_);
+        depth_decoder_.reset();
+    }
+    last_depth_ = i;
+}
+
+UpdateDetails Recording::read(size_t i, SensorFrame & frame) const
+{
+    char const * p = frame_data(i);
+    auto const h = recording::read_struct<recording::FrameHeader>(p);
+
+    // Delta frames need their predecessor: When seeking, decode everything since the last keyframe.
+    bool const delta = (h.flags_ & recording::DepthEncoded) && !(h.flags_ & recording::Keyframe);
+    if (delta && (last_depth_ == std::string::npos || last_depth_+1 != i))
+    {
+        size_t k = i;
+        while (k > 0 && (frame_header(k).flags_ & (recording::DepthEncoded | recording::Keyframe)) == recording::DepthEncoded)
+            --k;
+        for (; k < i; ++k)
+            read_depth(k, scratch_);
+    }
+    read_depth(i, frame.depth_data_);
+    p += h.depth_bytes_;
+
+    frame.user_data_.resize(header_.x_res_, header_.y_res_);
+    if (h.flags_ & recording::LabelsEncoded)
+    {
+        if (remaining(p) < h.label_bytes_)
+            throw std::runtime_error("Recording::read(): Corrupt frame.");
+        decode_labels(reinterpret_cast<uint8_t const *>(p), h.label_bytes_, frame.user_data_);
+    }
+    else
+    {
+        if (h.label_bytes_ != header_.x_res_ * header_.y_res_ * sizeof(XnLabel) || remaining(p) < h.label_bytes_)
+            throw std::runtime_error("Recording::read(): Corrupt frame.");
+        std::memcpy(frame.user_data_.data(), p, h.label_bytes_);
+    }
+    p += h.label_bytes_;
+    frame.label_bounds_ = label_bounds(frame.user_data_);
+
+    frame.users_.clear();
+    for (size_t k = 0; k < h.num_users_; ++k)
+    {
+        if (remaining(p) < sizeof(recording::UserRecord))
+            throw std::runtime_error("Recording::read(): Corrupt frame.");
+        auto const ur = recording::read_struct<recording::UserRecord>(p);
+        frame.users_.emplace_back(ur.id_, ur.visible_ != 0);
+        auto & u = frame.users_.back();
+        for (size_t l = 0; l < ur.num_joints_; ++l)
+        {
+            if (remaining(p) < sizeof(recording::JointRecord))
+                throw std::runtime_error("Recording::read(): Corrupt frame.");
+            auto const jr = recording::read_struct<recording::JointRecord>(p);
+            if (jr.joint_ < XN_SKEL_HEAD || jr.joint_ > XN_SKEL_RIGHT_FOOT)
+                throw std::runtime_error("Recording::read(): Corrupt frame.");
+            auto const j = static_cast<XnSkeletonJoint>(jr.joint_);
+            XnPoint3D real_pos = {jr.real_position_[0], jr.real_position_[1], jr.real_position_[2]};
+            XnPoint3D proj_pos = {jr.proj_position_[0], jr.proj_position_[1], jr.proj_position_[2]};
+            u.joints_.set(JointInfo(j, jr.confidence_, real_pos, proj_pos));
+        }
+        u.compute_base_change();
+    }
+    frame.timestamp_ = h.timestamp_;
+
+    UpdateDetails updates((h.flags_ & recording::DepthNew) != 0, (h.flags_ & recording::UserNew) != 0);
+    updates.synchronized_ = (h.flags_ & recording::Unsynchronized) == 0;
+    updates.sensor_frame_ = static_cast<XnUInt32>(i+1);
+    return updates;
+}
+
+} // namespace kin
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef REPLAY_SENSOR_HXX
+#define REPLAY_SENSOR_HXX
+
+#include <string>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+
+#include "sensor.hxx"
+#include "recording.hxx"
+
+namespace kin
+{
+
+/**
+ * @brief The ReplaySensor class plays a recording (see SensorRecorder) back as if it came from a sensor.
+ */
+class ReplaySensor : public Sensor
+{
+public:
+
+    enum PlaybackMode
+    {
+        RealTime, // keep the recorded frame timing
+        AsFastAsPossible // publish the next frame as soon as the previous one was grabbed by update()
+    };
+
+    /**
+     * @brief Open the recording and start the playback thread.
+     */
+    explicit ReplaySensor(std::string const & filename, PlaybackMode mode = RealTime, bool loop = true);
+
+    /**
+     * @brief Join the playback thread.
+     */
+    ~ReplaySensor();
+
+    /**
+     * @brief Return the number of recorded frames.
+     */
+    size_t size() const
+    {
+        return recording_.size();
+    }
+
+    /**
+     * @brief Continue the playback at the given frame.
+     */
+    void seek(size_t frame)
+    {
+        seek_frame_.store(frame);
+    }
+
+    /**
+     * @brief Return whether the end of the recording was reached (only if loop is disabled).
+     */
+    bool finished() const
+    {
+        return finished_.load();
+    }
+
+protected:
+
+    /**
+     * @brief Wait until the next recorded frame is due and read it into the given frame.
+     */
+    UpdateDetails capture_impl(SensorFrame & frame);
+
+private:
+
+    typedef std::chrono::steady_clock Clock;
+
+    Recording recording_; // the recording
+    PlaybackMode mode_; // the playback mode
+    bool loop_; // whether to restart at the end of the recording
+    size_t next_frame_; // the next frame to play (playback thread)
+    std::atomic<size_t> seek_frame_; // frame requested by seek(), or npos
+    std::atomic<bool> finished_; // whether the end was reached
+    Clock::time_point start_time_; // the time at which frame start_frame_ was played
+    size_t start_frame_; // the frame that was played at start_time_
+
+};
+
+ReplaySensor::ReplaySensor(std::string const & filename, PlaybackMode mode, bool loop)
+    :
+      recording_(filename),
+      mode_(mode),
+      loop_(loop),
+      next_frame_(0),
+      seek_frame_(std::string::npos),
+      finished_(false),
+      start_frame_(0)
+{
+    if (recording_.size() == 0)
+        throw std::runtime_error("ReplaySensor::ReplaySensor(): The recording is empty.");
+    set_field_of_view(recording_.field_of_view());
+    start_time_ = Clock::now();
+    start(recording_.x_res(), recording_.y_res(), recording_.z_res());
+}
+
+ReplaySensor::~ReplaySensor()
+{
+    stop();
+}
+
+UpdateDetails ReplaySensor::capture_impl(SensorFrame & frame)
+{
+    // Handle seek requests and the end of the recording.
+    auto const seek_frame = seek_frame_.exchange(std::string::npos);
+    if (seek_frame != std::string::npos)
+    {
+        next_frame_ = std::min(seek_frame, recording_.size()-1);
+        start_time_ = Clock::now();
+        start_frame_ = next_frame_;
+        finished_ = false;
+    }
+    if (next_frame_ >= recording_.size())
+    {
+        if (!loop_)
+        {
+            finished_ = true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            return UpdateDetails();
+        }
+        next_frame_ = 0;
+        start_time_ = Clock::now();
+        start_frame_ = 0;
+    }
+
+    if (mode_ == RealTime)
+    {
+        // If the timestamps go backwards (e. g. the device was restarted during the recording), the
+        // timing starts anew at this frame.
+        auto offset = static_cast<int64_t>(recording_.timestamp(next_frame_)) - static_cast<int64_t>(recording_.timestamp(start_frame_));
+        if (offset < 0)
+        {
+            start_time_ = Clock::now();
+            start_frame_ = next_frame_;
+            offset = 0;
+        }
+
+        // Wait in small steps, so the thread can be stopped while waiting for a long gap.
+        auto const due = start_time_ + std::chrono::microseconds(offset);
+        auto const now = Clock::now();
+        if (due > now)
+        {
+            auto const max_wait = std::chrono::milliseconds(50);
+            if (due - now > max_wait)
+            {
+                std::this_thread::sleep_for(max_wait);
+                return UpdateDetails();
+            }
+            std::this_thread::sleep_until(due);
+        }
+    }
+    else
+    {
+        // Hand out every frame: Wait until update() grabbed the previous one.
+        while (frame_pending() && running())
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+
+    auto const updates = recording_.read(next_frame_, frame);
+    ++next_frame_;
+    return updates;
+}
+
+} // namespace kin
+
+#endif
@@ -0,0 +1,290 @@
+#ifndef ROI_HXX
+#define ROI_HXX
+
+#include <algorithm>
+#include <cstddef>
+
+#include "ndarray.hxx"
+
+/**
+ * @brief The Roi struct is a rectangular region of interest in pixel coordinates: [x0_, x1_) x [y0_, y1_).
+ */
+struct Roi
+{
+    explicit Roi(size_t x0 = 0, size_t y0 = 0, size_t x1 = 0, size_t y1 = 0)
+        :
+          x0_(x0),
+          y0_(y0),
+          x1_(x1),
+          y1_(y1)
+    {}
+
+    /**
+     * @brief Return the region that covers a whole image of the given size.
+     */
+    static Roi full(size_t width, size_t height)
+    {
+        return Roi(0, 0, width, height);
+    }
+
+    bool empty() const
+    {
+        return x0_ >= x1_ || y0_ >= y1_;
+    }
+
+    size_t width() const
+    {
+        return empty() ? 0 : x1_ - x0_;
+    }
+
+    size_t height() const
+    {
+        return empty() ? 0 : y1_ - y0_;
+    }
+
+    size_t area() const
+    {
+        return width() * height();
+    }
+
+    /**
+     * @brief Return whether the other region lies inside this one.
+     */
+    bool contains(Roi const & other) const
+    {
+        return other.empty() || (!empty() && other.x0_ >= x0_ && other.y0_ >= y0_ && other.x1_ <= x1_ && other.y1_ <= y1_);
+    }
+
+    /**
+     * @brief Return the bounding box of both regions.
+     */
+    Roi united(Roi const & other) const
+    {
+        if (empty())
+            return other;
+        if (other.empty())
+            return *this;
+        return Roi(std::min(x0_, other.x0_), std::min(y0_, other.y0_), std::max(x1_, other.x1_), std::max(y1_, other.y1_));
+    }
+
+    /**
+     * @brief Return the region grown by margin pixels on each side and clipped to an image of the given size.
+     */
+    Roi expanded(size_t margin, size_t width, size_t height) const
+    {
+        if (empty())
+            return Roi();
+        return Roi(x0_ > margin ? x0_ - margin : 0,
+                   y0_ > margin ? y0_ - margin : 0,
+                   std::min(width, x1_ + margin),
+                   std::min(height, y1_ + margin));
+    }
+
+    /**
+     * @brief Return the region in an image that is downsampled by the given factor (rounded outwards).
+     */
+    Roi reduced(size_t factor) const
+    {
+        if (empty())
+            return Roi();
+        return Roi(x0_ / factor, y0_ / factor, (x1_ + factor - 1) / factor, (y1_ + factor - 1) / factor);
+    }
+
+    bool operator==(Roi const & other) const
+    {
+        return x0_ == other.x0_ && y0_ == other.y0_ && x1_ == other.x1_ && y1_ == other.y1_;
+    }
+
+    bool operator!=(Roi const & other) const
+    {
+        return !(*this == other);
+    }
+
+    size_t x0_; // the left border
+    size_t y0_; // the top border
+    size_t x1_; // one past the right border
+    size_t y1_; // one past the bottom border
+};
+
+/**
+ * @brief Return the bounding box of the non-zero pixels of the given array.
+ *
+ * The rows above and below the first and last labelled row are scanned completely. In between,
+ * only the pixels left and right of the current box are visited.
+ */
+template <typename ARRAY>
+Roi label_bounds(ARRAY const & labels)
+{
+    auto const w = labels.width();
+    auto const h = labels.height();
+    if (w == 0 || h == 0)
+        return Roi();
+    auto const row = [&](size_t y){
+        return &labels(0, y);
+    };
+    auto const labelled = [](typename ARRAY::value_type l){
+        return l != 0;
+    };
+
+    // Find the first and the last labelled row.
+    size_t y0 = 0;
+    while (y0 < h && std::none_of(row(y0), row(y0) + w, labelled))
+        ++y0;
+    if (y0 == h)
+        return Roi();
+    size_t y1 = h;
+    while (y1 > y0+1 && std::none_of(row(y1-1), row(y1-1) + w, labelled))
+        --y1;
+
+    // Extend the columns.
+    size_t x0 = w;
+    size_t x1 = 0;
+    for (size_t y = y0; y < y1; ++y)
+    {
+        auto const r = row(y);
+        auto const left = std::find_if(r, r + x0, labelled);
+        if (left != r + x0)
+            x0 = left - r;
+        for (size_t x = w; x > x1 && x > x0; --x)
+        {
+            if (r[x-1] != 0)
+            {
+                x1 = x;
+                break;
+            }
+        }
+    }
+    return Roi(x0, y0, std::max(x1, x0+1), y1);
+}
+
+/**
+ * @brief Copy a label image from src into dst (which must already have the correct shape) and return the bounding box of the non-zero labels.
+ */
+template <typename T>
+Roi copy_labels(T const * src, Array2D<T> & dst)
+{
+    auto const w = dst.width();
+    auto const h = dst.height();
+    Roi bounds(w, h, 0, 0);
+    for (size_t y = 0; y < h; ++y)
+    {
+        auto const in = src + y*w;
+        auto const out = &dst(0, y);
+        std::copy(in, in + w, out);
+
+        // The row was just copied, so it is still in the cache.
+        size_t x = 0;
+        while (x < w && out[x] == 0)
+            ++x;
+        if (x == w)
+            continue;
+        size_t x1 = w;
+        while (out[x1-1] == 0)
+            --x1;
+        bounds.x0_ = std::min(bounds.x0_, x);
+        bounds.x1_ = std::max(bounds.x1_, x1);
+        bounds.y0_ = std::min(bounds.y0_, y);
+        bounds.y1_ = y+1;
+    }
+    return bounds.empty() ? Roi() : bounds;
+}
+
+/**
+ * @brief Set the pixels that are inside of dirty but outside of roi to the given value.
+ *
+ * Callers that convert only the ROI of an image pass the ROI of the previous conversion as dirty
+ * region, so the constant fill only touches the pixels that changed from inside to outside.
+ */
+template <typename ARRAY, typename T>
+void fill_outside(ARRAY & a, Roi const & roi, T const & value, Roi const & dirty)
+{
+    if (dirty.empty())
+        return;
+    for (size_t y = dirty.y0_; y < dirty.y1_; ++y)
+    {
+        auto const r = &a(0, y);
+        if (roi.empty() || y < roi.y0_ || y >= roi.y1_)
+        {
+            std::fill(r + dirty.x0_, r + dirty.x1_, value);
+        }
+        else
+        {
+            std::fill(r + dirty.x0_, r + std::max(dirty.x0_, std::min(dirty.x1_, roi.x0_)), value);
+            std::fill(r + std::min(dirty.x1_, std::max(dirty.x0_, roi.x1_)), r + dirty.x1_, value);
+        }
+    }
+}
+
+/**
+ * @brief The RoiTracker class turns the label bounding boxes of consecutive frames into a stable region of interest.
+ *
+ * The region grows at once when the users move out of it, but it only shrinks (or vanishes when
+ * no user is left) after the users stayed inside a smaller region for hold_frames frames. This
+ * hysteresis keeps the region from jittering with the label noise at the user borders.
+ */
+class RoiTracker
+{
+public:
+
+    /**
+     * @param margin number of pixels that are added around the label bounding box
+     * @param hold_frames number of frames before the region shrinks
+     */
+    explicit RoiTracker(size_t margin = 24, size_t hold_frames = 15)
+        :
+          margin_(margin),
+          hold_frames_(hold_frames),
+          shrink_count_(0)
+    {}
+
+    /**
+     * @brief Add the label bounding box of the next frame of an image with the given size and return the new region.
+     */
+    Roi const & update(Roi const & bounds, size_t width, size_t height)
+    {
+        auto const target = bounds.expanded(margin_, width, height);
+        if (!roi_.contains(target))
+        {
+            roi_ = roi_.united(target);
+            shrink_count_ = 0;
+        }
+        else if (target != roi_)
+        {
+            ++shrink_count_;
+            if (shrink_count_ >= hold_frames_)
+            {
+                roi_ = target;
+                shrink_count_ = 0;
+            }
+        }
+        else
+        {
+            shrink_count_ = 0;
+        }
+        return roi_;
+    }
+
+    /**
+     * @brief Return the current region.
+     */
+    Roi const & roi() const
+    {
+        return roi_;
+    }
+
+    void reset()
+    {
+        roi_ = Roi();
+        shrink_count_ = 0;
+    }
+
+private:
+
+    size_t margin_; // the margin around the labels
+    size_t hold_frames_; // number of frames before the region shrinks
+    Roi roi_; // the current region
+    size_t shrink_count_; // number of consecutive frames in which a smaller region would have sufficed
+
+};
+
+#endif
@@ -5,6 +5,8 @@
 #include <memory>
 #include <string>
 #include <cmath>
+#include <vector>
+#include <algorithm>
 
 #include "../widgets.hxx"
 #include "../events.hxx"
@@ -37,7 +39,6 @@ public:
           combo_count_(0),
           perfect_game_(true),
           combo_mult_(1),
-          hovered_index_(-1),
           highscore_(0)
     {
         // Hide the mouse.
@@ -247,7 +248,6 @@ public:
         if (opts.use_kinect_)
         {
             // Create the crosshairs.
-            std::vector<std::shared_ptr<ImageWidget> > targets;
             for (size_t i = 0; i < 9; ++i)
             {
                 auto w = std::make_shared<ImageWidget>("images/crosshairs.png", 5);
@@ -256,24 +256,39 @@ public:
                 w->align_x_ = CenterX;
                 w->align_y_ = CenterY;
                 w->hide();
-                targets.push_back(w);
+                targets_.push_back(w);
                 mole_grid(i%3, i/3)->add_widget(w);
             }
 
-            // Create the event listener for the crosshairs.
+            // Create the event listener for the crosshairs and the strikes of the players. The volume
+            // of each mole hole has the index of the mole (see InteractionEngine).
             listener_ = std::make_shared<Listener>();
-            listener_->handle_notify_ = [&, targets](Event const & ev){
-                if (ev.type_ == Event::FieldHover)
+            listener_->handle_notify_ = [&](Event const & ev){
+                if (ev.type_ != Event::Interaction)
+                    return;
+                auto const & in = ev.interaction_;
+                if (in.player_ < 0 || in.hand_ < 0 || in.volume_ < 0 || static_cast<size_t>(in.volume_) >= targets_.size())
+                    return;
+                if (in.interaction_ == Event::InteractionEvent::Strike)
                 {
-                    auto x = ev.field_hover_.x_;
-                    auto y = ev.field_hover_.y_;
-                    if (x != -1 && y != -1)
-                    {
-                        hovered_index_ = 3*y+x;
-                        for (auto w : targets)
-                            w->hide();
-                        targets[hovered_index_]->show();
-                    }
+                    striking_fields_.push_back(in.volume_);
+                    return;
+                }
+
+                // Show the crosshair while a hand is inside of the field.
+                auto const slot = 2 * static_cast<size_t>(in.player_) + in.hand_;
+                if (slot >= hovered_fields_.size())
+                    hovered_fields_.resize(slot+1, -1);
+                if (in.interaction_ == Event::InteractionEvent::Enter)
+                {
+                    hovered_fields_[slot] = in.volume_;
+                    targets_[in.volume_]->show();
+                }
+                else if (hovered_fields_[slot] == in.volume_)
+                {
+                    hovered_fields_[slot] = -1;
+                    if (std::count(hovered_fields_.begin(), hovered_fields_.end(), in.volume_) == 0)
+                        targets_[in.volume_]->hide();
                 }
             };
             EventManager::instance().register_listener(listener_);
@@ -295,13 +310,14 @@ protected:
                 start_wave();
 
             // Check if a mole was hit.
-            if (opts.mouse_clicked_)
+            if (opts.use_kinect_)
             {
-                auto m = hovered_mole();
-                if (m >= 0 && mole_out_[m] && !mole_hit_[m])
-                    hit(m);
-                else
-                    miss();
+                for (auto m : striking_fields_)
+                    strike(m);
+            }
+            else if (opts.mouse_clicked_)
+            {
+                strike(hovered_mole());
             }
 
             // Update the timer.
@@ -320,10 +336,22 @@ protected:
                 timetext_->color_ = sf::Color(255, 149, 14);
 //                timetext_->color_ = sf::Color(255, 255, 255);
         }
+        striking_fields_.clear();
     }
 
 private:
 
+    /**
+     * @brief Hit the mole with index m if it is out, else count a miss.
+     */
+    void strike(int m)
+    {
+        if (m >= 0 && mole_out_[m] && !mole_hit_[m])
+            hit(m);
+        else
+            miss();
+    }
+
     /**
      * @brief Reset the combo counter.
      */
@@ -541,23 +569,16 @@ private:
     }
 
     /**
-     * @brief Return index of the hovered mole (or -1 of no mole is hovered).
+     * @brief Return index of the mole that is hovered by the mouse (or -1 of no mole is hovered).
      */
     int hovered_mole()
     {
-        if (opts.use_kinect_)
-        {
-            return hovered_index_;
-        }
-        else
-        {
-            for (size_t i = 0; i < moles_.size(); ++i)
-                if (moles_[i]->hovered())
-                    return static_cast<int>(i);
-            if (gmole_->hovered())
-                return gmole_position_;
-            return -1;
-        }
+        for (size_t i = 0; i < moles_.size(); ++i)
+            if (moles_[i]->hovered())
+                return static_cast<int>(i);
+        if (gmole_->hovered())
+            return gmole_position_;
+        return -1;
     }
 
     /**
@@ -723,7 +744,9 @@ private:
     size_t combo_mult_; // the current point multiplier
     std::shared_ptr<AnimatedWidget> combo_counter_; // the combo counter
     std::shared_ptr<Listener> listener_; // the event listener
-    int hovered_index_; // index of the hovered mole
+    std::vector<std::shared_ptr<ImageWidget> > targets_; // the crosshairs
+    std::vector<int> hovered_fields_; // index of the mole that is hovered by each hand (hand h of player p at 2*p+h)
+    std::vector<int> striking_fields_; // the fields that were struck since the last update
     int highscore_; // the best highscore
     std::shared_ptr<TextWidget> score_text_; // the current score displayed
 
@@ -0,0 +1,1181 @@
+#ifndef SENSOR_HXX
+#define SENSOR_HXX
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <exception>
+#include <functional>
+
+#include "platform_support.hxx"
+#ifdef OPENNI_FOUND
+#include <XnCppWrapper.h>
+#endif
+
+#include "ndarray.hxx"
+#include "utility.hxx"
+#include "triple_buffer.hxx"
+#include "skeleton.hxx"
+#include "joint_filter.hxx"
+#include "latency.hxx"
+#include "depth_pyramid.hxx"
+#include "depth_filter.hxx"
+#include "user_segmentation.hxx"
+#include "input_queue.hxx"
+#include "point_cloud.hxx"
+
+
+namespace kin
+{
+
+/**
+ * @brief The UpdateDetails struct describes what a sensor update delivered.
+ *
+ * Sources return it from capture_impl() with the flags, the frame number and whether depth and
+ * labels belong together. Sensor::update() adds the sequence number of the grabbed frame set and
+ * the frames that were lost or repeated since the previous update.
+ */
+struct UpdateDetails
+{
+    explicit UpdateDetails(bool depth = false, bool user = false)
+        :
+          depth_(depth),
+          user_(user),
+          synchronized_(true),
+          sensor_frame_(0),
+          timestamp_(0),
+          sequence_(0),
+          skipped_(0),
+          duplicated_(0),
+          unsynchronized_(0),
+          dropped_(0)
+    {}
+    bool depth_; // whether new depth was delivered
+    bool user_; // whether new labels and skeletons were delivered
+    bool synchronized_; // whether the labels belong to the same sensor frame as the depth
+    XnUInt32 sensor_frame_; // the frame number of the depth at the source (0: unknown)
+    XnUInt64 timestamp_; // the sensor timestamp of the depth in microseconds (Sensor::update())
+    size_t sequence_; // the sequence number of the frame set (Sensor::update())
+    size_t skipped_; // sensor frames that did not reach the capture thread since the previous update (Sensor::update())
+    size_t duplicated_; // frame sets that repeated the depth of their predecessor since the previous update (Sensor::update())
+    size_t unsynchronized_; // frame sets with labels of another sensor frame since the previous update (Sensor::update())
+    size_t dropped_; // frame sets that were replaced before they were grabbed since the previous update (Sensor::update())
+};
+
+/**
+ * @brief The FrameStats struct counts the frame sets of a sensor and the frames that were lost or repeated on the way.
+ */
+struct FrameStats
+{
+    FrameStats()
+        :
+          published_(0),
+          skipped_(0),
+          duplicated_(0),
+          unsynchronized_(0),
+          dropped_(0)
+    {}
+
+    size_t published_; // frame sets that were published by the capture thread
+    size_t skipped_; // sensor frames that never reached the capture thread (gaps in the frame numbers)
+    size_t duplicated_; // frame sets that repeated the depth of their predecessor
+    size_t unsynchronized_; // frame sets whose labels belong to another sensor frame than the depth
+    size_t dropped_; // frame sets that were replaced before update() grabbed them
+};
+
+/**
+ * @brief The UserHands struct holds the hand positions of a single user relative to the user plane.
+ */
+struct UserHands
+{
+    UserHands()
+        :
+          id_(0),
+          left_({0, 0, 0}),
+          right_({0, 0, 0}),
+          left_raw_({0, 0, 0}),
+          right_raw_({0, 0, 0}),
+          left_predicted_({0, 0, 0}),
+          right_predicted_({0, 0, 0}),
+          left_visible_(false),
+          right_visible_(false),
+          click_left_(0),
+          click_right_(0)
+    {}
+
+    XnLabel id_; // the user id
+    XnVector3D left_; // the filtered left hand position
+    XnVector3D right_; // the filtered right hand position
+    XnVector3D left_raw_; // the unfiltered left hand position
+    XnVector3D right_raw_; // the unfiltered right hand position
+    XnVector3D left_predicted_; // the predicted left hand position
+    XnVector3D right_predicted_; // the predicted right hand position
+    bool left_visible_; // whether the left hand is visible
+    bool right_visible_; // whether the right hand is visible
+    size_t click_left_; // sequence number of the last click of the left hand (0: no click)
+    size_t click_right_; // sequence number of the last click of the right hand (0: no click)
+};
+
+/**
+ * @brief The Cursor struct holds the normalized hand positions and the clicks of one player.
+ */
+struct Cursor
+{
+    Cursor()
+        :
+          id_(0),
+          left_({0, 0, 0}),
+          right_({0, 0, 0}),
+          left_visible_(false),
+          right_visible_(false),
+          clicked_left_(false),
+          clicked_right_(false)
+    {}
+
+    XnLabel id_; // the user id
+    XnVector3D left_; // the normalized predicted left hand position (see Sensor::hand_left())
+    XnVector3D right_; // the normalized predicted right hand position (see Sensor::hand_right())
+    bool left_visible_; // whether the left hand is visible
+    bool right_visible_; // whether the right hand is visible
+    bool clicked_left_; // whether the left hand clicked in the last update()
+    bool clicked_right_; // whether the right hand clicked in the last update()
+};
+
+/**
+ * @brief The SensorFrame struct holds everything the capture thread publishes for one sensor update.
+ */
+struct SensorFrame
+{
+    SensorFrame()
+        :
+          depth_id_(0),
+          user_id_(0),
+          timestamp_(0),
+          sensor_frame_(0),
+          synchronized_(true),
+          segmented_(false),
+          hand_left_({0, 0, 0}),
+          hand_right_({0, 0, 0}),
+          hand_left_raw_({0, 0, 0}),
+          hand_right_raw_({0, 0, 0}),
+          hand_left_predicted_({0, 0, 0}),
+          hand_right_predicted_({0, 0, 0}),
+          hand_left_visible_(false),
+          hand_right_visible_(false)
+    {}
+
+    Array2D<XnDepthPixel> depth_data_; // the depth data
+    DepthPyramid depth_pyramid_; // the downsampled depth data (see Sensor::set_depth_pyramid())
+    Array2D<XnLabel> user_data_; // the combined pixel data of all users
+    std::vector<User> users_; // the tracked users
+    std::vector<UserHands> hands_; // the hands of the tracked users (same order as users_)
+    Roi label_bounds_; // the bounding box of the labelled pixels in user_data_ (set by capture_impl())
+    Roi roi_; // the region of interest around the users (see Sensor::roi())
+    size_t depth_id_; // number of depth updates up to this frame
+    size_t user_id_; // number of user updates up to this frame
+    XnUInt64 timestamp_; // the sensor timestamp in microseconds
+    XnUInt32 sensor_frame_; // the frame number of the depth at the source (0: unknown)
+    bool synchronized_; // whether the labels belong to the same sensor frame as the depth
+    bool segmented_; // whether user_data_ was segmented from the depth instead of labelled by the tracker
+    FrameStats stats_; // the counters of the capture thread up to this frame set (stats_.published_ is its sequence number)
+    XnVector3D hand_left_; // the filtered left hand position of the first user
+    XnVector3D hand_right_; // the filtered right hand position of the first user
+    XnVector3D hand_left_raw_; // the unfiltered left hand position of the first user
+    XnVector3D hand_right_raw_; // the unfiltered right hand position of the first user
+    XnVector3D hand_left_predicted_; // the predicted left hand position of the first user
+    XnVector3D hand_right_predicted_; // the predicted right hand position of the first user
+    bool hand_left_visible_; // whether the left hand of the first user is visible
+    bool hand_right_visible_; // whether the right hand of the first user is visible
+    FrameTiming timing_; // the time stamps of the processing stages
+};
+
+/**
+ * @brief Parent class for all sensors. It runs a thread that captures frames from the actual source.
+ *
+ * The capture thread calls capture_impl() to fill a frame with depth, user labels and skeletons,
+ * computes the hand positions and publishes the complete SensorFrame through a triple buffer. The
+ * update() method only grabs the latest published frame, so it never blocks the render loop.
+ *
+ * The hands of every tracked user are followed separately. The per-user state (predictors and
+ * click detectors) is stored in tables that are indexed by the user id, so each frame costs a
+ * constant amount of work per user and no allocations once all ids were seen.
+ *
+ * Subclasses call start() at the end of their constructor and stop() at the beginning of their
+ * destructor, so the capture thread never runs on a partially constructed object.
+ */
+class Sensor
+{
+public:
+
+    typedef std::function<void(SensorFrame const &, UpdateDetails const &)> FrameCallback;
+
+    virtual ~Sensor();
+
+    /**
+     * @brief Disable copy constructor to avoid duplicate sensor access.
+     */
+    Sensor(Sensor const & other) = delete;
+
+    /**
+     * @brief Disable assignment operator to avoid duplicate sensor access.
+     */
+    Sensor & operator=(Sensor const & other) = delete;
+
+    /**
+     * @brief Return the x resolution of the depth data.
+     * @return the x resolution
+     */
+    XnUInt32 x_res() const
+    {
+        return x_res_;
+    }
+
+    /**
+     * @brief Return the y resolution of the depth data.
+     * @return the y resolution
+     */
+    XnUInt32 y_res() const
+    {
+        return y_res_;
+    }
+
+    /**
+     * @brief Return the z resolution of the depth data.
+     * @return the z resolution
+     */
+    XnUInt32 z_res() const
+    {
+        return z_res_;
+    }
+
+    /**
+     * @brief Return the field of view of the depth camera.
+     */
+    FieldOfView const & field_of_view() const
+    {
+        return field_of_view_;
+    }
+
+    /**
+     * @brief Return the viewing rays of the depth pixels (see depth_to_points()). They are computed once at the start.
+     */
+    RayTable const & rays() const
+    {
+        return rays_;
+    }
+
+    /**
+     * @brief Grab the latest frame of the capture thread without waiting. It should be called once per frame.
+     *
+     * The elapsed time is not used anymore: The clicks are detected in the capture thread by the sensor time.
+     */
+    UpdateDetails update(float elapsed_time);
+
+    /**
+     * @brief Return the current frame. It is valid until the next call of update().
+     */
+    SensorFrame const & frame() const
+    {
+        return frames_.front();
+    }
+
+    /**
+     * @brief Return a view on the depth data of the current frame. The view is valid until the next call of update().
+     */
+    Array2DView<XnDepthPixel> depth_data() const
+    {
+        return Array2DView<XnDepthPixel>(frames_.front().depth_data_);
+    }
+
+    /**
+     * @brief Return a view on the depth data of the current frame, reduced by 2^level (level 0 is the full resolution).
+     *
+     * Coarse analyses and previews can use the levels 1 to depth_levels() instead of the full
+     * resolution. The view is valid until the next call of update().
+     */
+    Array2DView<XnDepthPixel> depth_data(size_t level) const
+    {
+        if (level == 0)
+            return depth_data();
+        return Array2DView<XnDepthPixel>(frames_.front().depth_pyramid_.level(level));
+    }
+
+    /**
+     * @brief Return the number of reduced depth levels of the current frame.
+     */
+    size_t depth_levels() const
+    {
+        return frames_.front().depth_pyramid_.levels();
+    }
+
+    /**
+     * @brief Return a view on the user pixel data of the current frame. The view is valid until the next call of update().
+     */
+    Array2DView<XnLabel> user_data() const
+    {
+        return Array2DView<XnLabel>(frames_.front().user_data_);
+    }
+
+    /**
+     * @brief Return the users.
+     */
+    std::vector<User> const & users() const
+    {
+        return frames_.front().users_;
+    }
+
+    /**
+     * @brief Return the region of interest of the current frame.
+     *
+     * The region contains the labelled pixels plus a margin. It follows the users at once when
+     * they move out, but only shrinks after a short delay. It is empty if no user was seen for a
+     * while, so per-pixel passes can skip the background completely.
+     */
+    Roi const & roi() const
+    {
+        return frames_.front().roi_;
+    }
+
+    /**
+     * @brief Return whether the labels of the current frame were segmented from the depth (see set_user_segmentation()).
+     */
+    bool labels_segmented() const
+    {
+        return frames_.front().segmented_;
+    }
+    
+    /**
+     * @brief The hand positions that can be queried.
+     */
+    enum HandSource
+    {
+        HandRaw, // computed from the unfiltered joints
+        HandFiltered, // computed from the filtered joints (see set_joint_filter())
+        HandPredicted // the filtered position, extrapolated to the display time (see set_hand_prediction())
+    };
+
+    /**
+     * @brief Map a left hand position relative to the user plane to screen coordinates (0 to 1 inside the screen).
+     */
+    static XnVector3D normalize_hand_left(XnVector3D p)
+    {
+        p.X = (p.X + 1.5) / 1.75;
+        p.Y = (p.Y - 0.7) / 1.5;
+//        p.Z = (p.Z + 1.0);
+        return p;
+    }
+
+    /**
+     * @brief Map a right hand position relative to the user plane to screen coordinates (0 to 1 inside the screen).
+     */
+    static XnVector3D normalize_hand_right(XnVector3D p)
+    {
+        p.X = (p.X + 0.25) / 1.75;
+        p.Y = (p.Y - 0.7) / 1.5;
+//        p.Z = (p.Z + 1.0);
+        return p;
+    }
+
+    /**
+     * @brief Compute the hand positions of the given user relative to the user plane.
+     *
+     * If the main joints are not known, the positions and the visibility are not changed.
+     */
+    static void compute_hand_positions(User const & u, XnVector3D & left, XnVector3D & right, bool & left_visible, bool & right_visible);
+
+    /**
+     * @brief Return the position of the left hand of the first user.
+     */
+    XnVector3D hand_left(HandSource source = HandPredicted) const
+    {
+        auto const & f = frames_.front();
+        return normalize_hand_left(source == HandRaw ? f.hand_left_raw_ : source == HandFiltered ? f.hand_left_ : f.hand_left_predicted_);
+    }
+    
+    /**
+     * @brief Return the position of the right hand of the first user.
+     */
+    XnVector3D hand_right(HandSource source = HandPredicted) const
+    {
+        auto const & f = frames_.front();
+        return normalize_hand_right(source == HandRaw ? f.hand_right_raw_ : source == HandFiltered ? f.hand_right_ : f.hand_right_predicted_);
+    }
+
+    /**
+     * @brief Return whether the left hand of the first user is visible.
+     */
+    bool hand_left_visible() const
+    {
+        return frames_.front().hand_left_visible_;
+    }
+
+    /**
+     * @brief Return whether the right hand of the first user is visible.
+     */
+    bool hand_right_visible() const
+    {
+        return frames_.front().hand_right_visible_;
+    }
+
+    /**
+     * @brief Return the cursors of all tracked users (same order as users()). They are valid until the next call of update().
+     */
+    std::vector<Cursor> const & cursors() const
+    {
+        return cursors_;
+    }
+
+    /**
+     * @brief Callback for clicks with the left hand of the first user. It is called by update() for the clicks the capture thread detected since the previous update().
+     */
+    std::function<void()> & handle_click_left()
+    {
+        return handle_click_left_;
+    }
+
+    /**
+     * @brief Callback for clicks with the right hand of the first user. It is called by update() for the clicks the capture thread detected since the previous update().
+     */
+    std::function<void()> & handle_click_right()
+    {
+        return handle_click_right_;
+    }
+
+    /**
+     * @brief Create the queue that receives the hand movements, clicks and entering and leaving users of all frames.
+     *
+     * The capture thread pushes the samples of every frame, also of frames that are skipped by
+     * update(), so no click is lost when the sensor rate and the frame rate drift apart. The
+     * returned queue must be drained by a single consumer, e. g. EventManager::attach_input(). A
+     * previously opened queue does not receive samples anymore.
+     */
+    std::shared_ptr<InputQueue> open_input_queue();
+
+    /**
+     * @brief Return the number of input samples that were dropped because the queue was full.
+     */
+    size_t input_dropped() const
+    {
+        return input_dropped_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Return the counters of the frame sets up to the frame that was grabbed last.
+     */
+    FrameStats const & frame_stats() const
+    {
+        return frame_stats_;
+    }
+
+    /**
+     * @brief Use depth for click detection.
+     */
+    void use_y_click()
+    {
+        click_use_y_ = true;
+    }
+
+    /**
+     * @brief Use height for click detection.
+     */
+    void use_z_click()
+    {
+        click_use_y_ = false;
+    }
+
+    /**
+     * @brief Set a callback that receives every captured frame, e. g. to record it. Pass an empty function to remove it.
+     * @note The callback is called in the capture thread. It receives the unfiltered joints and no hand positions.
+     */
+    void set_frame_callback(FrameCallback const & f);
+
+    /**
+     * @brief Select the filter that smoothes the joints of all users. It replaces the current filter from the next frame on.
+     * @note The hand positions are computed from the filtered joints, the click detection uses the unfiltered ones.
+     */
+    void set_joint_filter(JointFilterOptions const & options);
+
+    /**
+     * @brief Configure how far the predicted hand positions are extrapolated, e. g. to compensate the sensor latency.
+     */
+    void set_hand_prediction(PredictionOptions const & options);
+
+    /**
+     * @brief Select the levels of the depth pyramid that is built for every frame (default: 3 levels, nearest depth).
+     */
+    void set_depth_pyramid(DepthPyramidOptions const & options);
+
+    /**
+     * @brief Select the temporal filter and the hole filling of the depth (default: none). The filter restarts with the next frame.
+     * @note The frame callback receives the unfiltered depth, the pyramid is built from the filtered one.
+     */
+    void set_depth_filter(DepthFilterOptions const & options);
+
+    /**
+     * @brief Select when the users are segmented from the (filtered) depth instead of taken from the tracker (default: never).
+     * @note The frame callback receives the labels of the tracker. Segmented users have no skeletons.
+     */
+    void set_user_segmentation(SegmentationOptions const & options);
+
+protected:
+
+    Sensor();
+
+    /**
+     * @brief Set the field of view of the depth camera (default: kinect). It must be called before start().
+     */
+    void set_field_of_view(FieldOfView const & fov)
+    {
+        field_of_view_ = fov;
+    }
+
+    /**
+     * @brief Allocate the frames, compute the viewing rays and start the capture thread.
+     */
+    void start(XnUInt32 x_res, XnUInt32 y_res, XnUInt32 z_res);
+
+    /**
+     * @brief Stop and join the capture thread.
+     */
+    void stop();
+
+    /**
+     * @brief Return whether the capture thread should keep running.
+     */
+    bool running() const
+    {
+        return running_;
+    }
+
+    /**
+     * @brief Return whether the last published frame was not grabbed by update() yet.
+     */
+    bool frame_pending() const
+    {
+        return frames_.pending();
+    }
+
+    /**
+     * @brief Wait for the next data of the source and write it into the given frame.
+     *
+     * The frame slot may hold an old frame, so depth data, user data, label bounds and users must
+     * always be written completely. Return which parts are new. If nothing is new, the frame is dropped.
+     */
+    virtual UpdateDetails capture_impl(SensorFrame & frame) = 0;
+
+private:
+
+    /**
+     * @brief The hand state of a single user that is carried from frame to frame (capture thread).
+     */
+    struct HandTracker
+    {
+        HandTracker()
+            :
+              last_user_id_(0),
+              entered_(false)
+        {}
+
+        UserHands hands_; // the current hand positions
+        MotionPredictor predictor_left_; // predicts the left hand
+        MotionPredictor predictor_right_; // predicts the right hand
+        ClickDetector click_left_; // click detector for the left hand
+        ClickDetector click_right_; // click detector for the right hand
+        size_t last_user_id_; // the user update in which the user was tracked last
+        bool entered_; // whether the user was not tracked in the previous update
+    };
+
+    /**
+     * @brief The capture thread: Capture and publish frames until the sensor is stopped.
+     */
+    void capture_loop();
+
+    /**
+     * @brief Return the thread pool of the depth filter and the user segmentation, it is started on the first call (capture thread).
+     */
+    ThreadPool * image_pool()
+    {
+        if (!image_pool_)
+            image_pool_.reset(new ThreadPool());
+        return image_pool_.get();
+    }
+
+    /**
+     * @brief Return the hand tracker of the given user. Trackers of users that were lost in between are reset.
+     */
+    HandTracker & hand_tracker(XnLabel id);
+
+    /**
+     * @brief Update the click detectors of the given user with the unfiltered hands (capture thread).
+     */
+    void detect_clicks(HandTracker & tracker, float elapsed_time);
+
+    /**
+     * @brief Push the input samples of the current users into the input queue (capture thread).
+     */
+    void push_input(SensorFrame const & frame);
+
+    /**
+     * @brief Fill the cursors and call the click callbacks of the first user for the clicks that were not reported yet.
+     */
+    void check_for_clicks();
+
+    XnUInt32 x_res_; // the x resolution
+    XnUInt32 y_res_; // the y resolution
+    XnUInt32 z_res_; // the z resolution
+    FieldOfView field_of_view_; // the field of view of the depth camera
+    RayTable rays_; // the viewing rays of the depth pixels
+    size_t depth_id_; // number of depth updates (capture thread)
+    size_t user_id_; // number of user updates (capture thread)
+    FrameStats capture_stats_; // the counters of the published frame sets (capture thread)
+    XnUInt32 last_sensor_frame_; // the frame number of the previous depth (capture thread)
+
+    TripleBuffer<SensorFrame> frames_; // hands the frames from the capture thread to update()
+    size_t last_depth_id_; // depth id of the frame that was grabbed last
+    size_t last_user_id_; // user id of the frame that was grabbed last
+    FrameStats frame_stats_; // the counters up to the frame that was grabbed last
+    std::shared_ptr<FrameCallback> frame_callback_; // receives the captured frames (use atomic access)
+    std::shared_ptr<JointFilterOptions const> joint_filter_options_; // the selected joint filter (use atomic access)
+    std::shared_ptr<PredictionOptions const> prediction_options_; // the selected hand prediction (use atomic access)
+    std::shared_ptr<DepthPyramidOptions const> depth_pyramid_options_; // the selected depth pyramid (use atomic access)
+    std::shared_ptr<DepthFilterOptions const> depth_filter_options_; // the selected depth filter (use atomic access)
+    std::shared_ptr<SegmentationOptions const> segmentation_options_; // the selected user segmentation (use atomic access)
+    std::shared_ptr<InputQueue> input_queue_; // receives the input samples (use atomic access)
+    std::atomic<size_t> input_dropped_; // number of input samples that did not fit into the queue
+    std::atomic<bool> input_opened_; // set when a new queue was opened, so the current users are reported as entered
+
+    std::thread capture_thread_; // the capture thread
+    std::atomic<bool> running_; // cleared to stop the capture thread
+    std::atomic<bool> capture_failed_; // set if the capture thread stopped with an exception
+    std::exception_ptr capture_error_; // the exception of the capture thread
+
+    std::shared_ptr<JointFilterOptions const> applied_joint_filter_options_; // the joint filter in use (capture thread)
+    SkeletonFilter skeleton_filter_; // smoothes the joints (capture thread)
+    std::shared_ptr<PredictionOptions const> applied_prediction_options_; // the hand prediction in use (capture thread)
+    std::unique_ptr<ThreadPool> image_pool_; // splits the depth filter and the user segmentation among the cores (capture thread, see image_pool())
+    std::shared_ptr<DepthFilterOptions const> applied_depth_filter_options_; // the depth filter in use (capture thread)
+    DepthFilter depth_filter_; // denoises the depth (capture thread)
+    std::shared_ptr<SegmentationOptions const> applied_segmentation_options_; // the user segmentation in use (capture thread)
+    UserSegmentation segmentation_; // labels the users from the depth (capture thread)
+    std::vector<HandTracker> hand_trackers_; // the hand trackers, indexed by user id (capture thread)
+    std::vector<UserHands> hands_; // the hands of the current users (capture thread)
+    std::vector<XnLabel> tracked_users_; // the ids of the users of the previous user update (capture thread)
+    XnUInt64 last_user_timestamp_; // the timestamp of the previous user update (capture thread)
+    size_t click_sequence_; // number of detected clicks (capture thread)
+    size_t last_click_pushed_; // the highest click sequence number that was pushed into the input queue (capture thread)
+    RoiTracker roi_tracker_; // computes the region of interest from the label bounds (capture thread)
+    UserHands first_hands_; // the hands of the first user that was tracked last (capture thread)
+
+    std::function<void()> handle_click_left_; // called for clicks with the left hand of the first user
+    std::function<void()> handle_click_right_; // called for clicks with the right hand of the first user
+    std::atomic<bool> click_use_y_; // whether the click detectors use the depth
+    size_t last_click_seen_; // the highest click sequence number that was reported by the cursors
+    std::vector<Cursor> cursors_; // the cursors of the current users
+
+};
+
+Sensor::Sensor()
+    :
+      x_res_(0),
+      y_res_(0),
+      z_res_(0),
+      depth_id_(0),
+      user_id_(0),
+      last_sensor_frame_(0),
+      last_depth_id_(0),
+      last_user_id_(0),
+      depth_pyramid_options_(std::make_shared<DepthPyramidOptions const>()),
+      input_dropped_(0),
+      input_opened_(false),
+      running_(false),
+      capture_failed_(false),
+      last_user_timestamp_(0),
+      click_sequence_(0),
+      last_click_pushed_(0),
+      click_use_y_(true),
+      last_click_seen_(0)
+{}
+
+Sensor::~Sensor()
+{
+    stop();
+}
+
+void Sensor::start(XnUInt32 x_res, XnUInt32 y_res, XnUInt32 z_res)
+{
+    x_res_ = x_res;
+    y_res_ = y_res;
+    z_res_ = z_res;
+    rays_ = RayTable(x_res_, y_res_, field_of_view_);
+    SensorFrame empty;
+    empty.depth_data_.resize(x_res_, y_res_);
+    empty.user_data_.resize(x_res_, y_res_);
+    frames_.fill(empty);
+
+    running_ = true;
+    capture_thread_ = std::thread(&Sensor::capture_loop, this);
+}
+
+void Sensor::stop()
+{
+    running_ = false;
+    if (capture_thread_.joinable())
+        capture_thread_.join();
+}
+
+void Sensor::set_frame_callback(FrameCallback const & f)
+{
+    std::shared_ptr<FrameCallback> p;
+    if (f)
+        p = std::make_shared<FrameCallback>(f);
+    std::atomic_store(&frame_callback_, p);
+}
+
+void Sensor::set_joint_filter(JointFilterOptions const & options)
+{
+    std::shared_ptr<JointFilterOptions const> p = std::make_shared<JointFilterOptions>(options);
+    std::atomic_store(&joint_filter_options_, p);
+}
+
+void Sensor::set_hand_prediction(PredictionOptions const & options)
+{
+    std::shared_ptr<PredictionOptions const> p = std::make_shared<PredictionOptions>(options);
+    std::atomic_store(&prediction_options_, p);
+}
+
+void Sensor::set_depth_pyramid(DepthPyramidOptions const & options)
+{
+    std::shared_ptr<DepthPyramidOptions const> p = std::make_shared<DepthPyramidOptions>(options);
+    std::atomic_store(&depth_pyramid_options_, p);
+}
+
+void Sensor::set_depth_filter(DepthFilterOptions const & options)
+{
+    std::shared_ptr<DepthFilterOptions const> p = std::make_shared<DepthFilterOptions>(options);
+    std::atomic_store(&depth_filter_options_, p);
+}
+
+void Sensor::set_user_segmentation(SegmentationOptions const & options)
+{
+    std::shared_ptr<SegmentationOptions const> p = std::make_shared<SegmentationOptions>(options);
+    std::atomic_store(&segmentation_options_, p);
+}
+
+std::shared_ptr<InputQueue> Sensor::open_input_queue()
+{
+    auto const queue = std::make_shared<InputQueue>();
+    std::atomic_store(&input_queue_, queue);
+    input_opened_ = true;
+    return queue;
+}
+
+UpdateDetails Sensor::update(float /*elapsed_time*/)
+{
+    // Pass errors of the capture thread to the caller.
+    if (capture_failed_.load(std::memory_order_acquire))
+        std::rethrow_exception(capture_error_);
+
+    UpdateDetails updates;
+    for (auto & c : cursors_)
+    {
+        c.clicked_left_ = false;
+        c.clicked_right_ = false;
+    }
+    if (!frames_.update())
+        return updates;
+    frames_.front().timing_.mark(MarkGrabbed);
+
+    // Compare the update counters, so updates of skipped frames are reported, too.
+    auto const & frame = frames_.front();
+    updates.depth_ = frame.depth_id_ != last_depth_id_;
+    updates.user_ = frame.user_id_ != last_user_id_;
+    last_depth_id_ = frame.depth_id_;
+    last_user_id_ = frame.user_id_;
+
+    // The same for the frame counters. The frame sets in between were replaced in the triple buffer.
+    updates.synchronized_ = frame.synchronized_;
+    updates.sensor_frame_ = frame.sensor_frame_;
+    updates.timestamp_ = frame.timestamp_;
+    updates.sequence_ = frame.stats_.published_;
+    updates.skipped_ = frame.stats_.skipped_ - frame_stats_.skipped_;
+    updates.duplicated_ = frame.stats_.duplicated_ - frame_stats_.duplicated_;
+    updates.unsynchronized_ = frame.stats_.unsynchronized_ - frame_stats_.unsynchronized_;
+    updates.dropped_ = frame.stats_.published_ - frame_stats_.published_ - 1;
+    auto const dropped = frame_stats_.dropped_ + updates.dropped_;
+    frame_stats_ = frame.stats_;
+    frame_stats_.dropped_ = dropped;
+
+    // Report the clicks. This runs here, so the click callbacks are called in the thread of the caller.
+    if (updates.user_)
+        check_for_clicks();
+
+    return updates;
+}
+
+void Sensor::capture_loop()
+{
+    try
+    {
+        while (running_)
+        {
+            auto & frame = frames_.back();
+            frame.timing_.reset();
+            auto const updates = capture_impl(frame);
+            if (!updates.depth_ && !updates.user_)
+                continue;
+
+            // Sources that do not time stamp the single stages are measured from here.
+            if (!frame.timing_.has(MarkAcquired))
+                frame.timing_.mark(MarkAcquired);
+            if (!frame.timing_.has(MarkSkeleton))
+                frame.timing_.mark(MarkSkeleton);
+            frame.timing_.sensor_timestamp_ = frame.timestamp_;
+
+            if (updates.depth_)
+                ++depth_id_;
+            frame.depth_id_ = depth_id_;
+            frame.user_id_ = updates.user_ ? user_id_+1 : user_id_;
+
+            // Count the lost and repeated sensor frames by the frame numbers of the source. A frame
+            // number below the previous one means that the source restarted, e. g. a looped recording.
+            ++capture_stats_.published_;
+            if (!updates.depth_ || (updates.sensor_frame_ != 0 && updates.sensor_frame_ == last_sensor_frame_))
+                ++capture_stats_.duplicated_;
+            else if (updates.sensor_frame_ != 0 && last_sensor_frame_ != 0 && updates.sensor_frame_ > last_sensor_frame_)
+                capture_stats_.skipped_ += updates.sensor_frame_ - last_sensor_frame_ - 1;
+            if (!updates.synchronized_)
+                ++capture_stats_.unsynchronized_;
+            if (updates.sensor_frame_ != 0)
+                last_sensor_frame_ = updates.sensor_frame_;
+            frame.sensor_frame_ = updates.sensor_frame_;
+            frame.synchronized_ = updates.synchronized_;
+            frame.stats_ = capture_stats_;
+
+            // Pass the frame on before the joints are filtered, so recordings keep the sensor data.
+            auto const callback = std::atomic_load(&frame_callback_);
+            if (callback)
+                (*callback)(frame, updates);
+
+            // Switch the depth filter if a different one was selected. The slot holds the raw depth
+            // of the last sensor frame, so a label update gets the filtered depth of that frame again.
+            auto const depth_filter_options = std::atomic_load(&depth_filter_options_);
+            if (depth_filter_options && depth_filter_options != applied_depth_filter_options_)
+            {
+                depth_filter_.set_options(*depth_filter_options);
+                depth_filter_.set_pool(depth_filter_options->enabled() ? image_pool() : nullptr);
+                applied_depth_filter_options_ = depth_filter_options;
+            }
+            depth_filter_.apply(frame.depth_data_, updates.depth_);
+
+            // Learn the background from every new depth frame, except where the tracker sees users.
+            // capture_impl() copies the labels into every frame, so the segmentation replaces them
+            // in every frame while it is active, not only in user updates.
+            auto const segmentation_options = std::atomic_load(&segmentation_options_);
+            if (segmentation_options && segmentation_options != applied_segmentation_options_)
+            {
+                segmentation_.set_options(*segmentation_options);
+                segmentation_.set_pool(segmentation_options->enabled() ? image_pool() : nullptr);
+                applied_segmentation_options_ = segmentation_options;
+            }
+            frame.segmented_ = false;
+            if (segmentation_.options().enabled())
+            {
+                if (updates.depth_)
+                    segmentation_.learn(frame.depth_data_, &frame.user_data_);
+                if (segmentation_.options().mode_ == SegmentationOptions::Always || frame.label_bounds_.empty())
+                {
+                    segmentation_.segment(frame.depth_data_, frame.user_data_);
+                    frame.label_bounds_ = segmentation_.bounds();
+                    frame.segmented_ = true;
+                }
+            }
+
+            if (updates.user_)
+            {
+                ++user_id_;
+
+                // Switch the joint filter if a different one was selected.
+                auto const filter_options = std::atomic_load(&joint_filter_options_);
+                if (filter_options && filter_options != applied_joint_filter_options_)
+                {
+                    skeleton_filter_.set_options(*filter_options);
+                    applied_joint_filter_options_ = filter_options;
+                }
+
+                // Compute the hands of every user before and after filtering the joints.
+                hands_.resize(frame.users_.size());
+                for (size_t i = 0; i < frame.users_.size(); ++i)
+                {
+                    auto & h = hand_tracker(frame.users_[i].id_).hands_;
+                    compute_hand_positions(frame.users_[i], h.left_raw_, h.right_raw_, h.left_visible_, h.right_visible_);
+                }
+                skeleton_filter_.apply(frame.users_, frame.timestamp_);
+                for (auto & u : frame.users_)
+                    u.compute_base_change();
+
+                // Switch the hand prediction if a different one was selected.
+                auto const prediction_options = std::atomic_load(&prediction_options_);
+                if (prediction_options && prediction_options != applied_prediction_options_)
+                {
+                    for (auto & tracker : hand_trackers_)
+                    {
+                        tracker.predictor_left_ = MotionPredictor(*prediction_options);
+                        tracker.predictor_right_ = MotionPredictor(*prediction_options);
+                    }
+                    applied_prediction_options_ = prediction_options;
+                }
+
+                // The click detectors advance by the sensor time, so they do not depend on the frame rate.
+                float dt = 0.0f;
+                if (last_user_timestamp_ != 0 && frame.timestamp_ > last_user_timestamp_)
+                    dt = std::min(0.5f, static_cast<float>((frame.timestamp_ - last_user_timestamp_) / 1e6));
+                last_user_timestamp_ = frame.timestamp_;
+
+                // Extrapolate the filtered hands and detect the clicks.
+                auto const t = frame.timestamp_ / 1e6;
+                for (size_t i = 0; i < frame.users_.size(); ++i)
+                {
+                    auto const & u = frame.users_[i];
+                    auto & tracker = hand_trackers_[u.id_];
+                    auto & h = tracker.hands_;
+                    compute_hand_positions(u, h.left_, h.right_, h.left_visible_, h.right_visible_);
+                    if (h.left_visible_)
+                        tracker.predictor_left_.push(h.left_, t);
+                    else
+                        tracker.predictor_left_.reset();
+                    if (h.right_visible_)
+                        tracker.predictor_right_.push(h.right_, t);
+                    else
+                        tracker.predictor_right_.reset();
+                    h.left_predicted_ = h.left_visible_ ? tracker.predictor_left_.predict() : h.left_;
+                    h.right_predicted_ = h.right_visible_ ? tracker.predictor_right_.predict() : h.right_;
+                    detect_clicks(tracker, dt);
+                    hands_[i] = h;
+                }
+                if (!hands_.empty())
+                    first_hands_ = hands_.front();
+                push_input(frame);
+
+                roi_tracker_.update(frame.label_bounds_, x_res_, y_res_);
+            }
+            frame.roi_ = roi_tracker_.roi();
+            frame.hands_ = hands_;
+            frame.hand_left_visible_ = first_hands_.left_visible_;
+            frame.hand_right_visible_ = first_hands_.right_visible_;
+            frame.hand_left_ = first_hands_.left_;
+            frame.hand_right_ = first_hands_.right_;
+            frame.hand_left_raw_ = first_hands_.left_raw_;
+            frame.hand_right_raw_ = first_hands_.right_raw_;
+            frame.hand_left_predicted_ = first_hands_.left_predicted_;
+            frame.hand_right_predicted_ = first_hands_.right_predicted_;
+
+            // The slot may hold the pyramid of an old frame, so it is built for every frame.
+            frame.depth_pyramid_.build(frame.depth_data_, *std::atomic_load(&depth_pyramid_options_));
+            frame.timing_.mark(MarkFiltered);
+
+            frames_.publish();
+        }
+    }
+    catch (...)
+    {
+        capture_error_ = std::current_exception();
+        capture_failed_.store(true, std::memory_order_release);
+    }
+}
+
+Sensor::HandTracker & Sensor::hand_tracker(XnLabel id)
+{
+    if (id >= hand_trackers_.size())
+    {
+        HandTracker tracker;
+        if (applied_prediction_options_)
+        {
+            tracker.predictor_left_ = MotionPredictor(*applied_prediction_options_);
+            tracker.predictor_right_ = MotionPredictor(*applied_prediction_options_);
+        }
+        hand_trackers_.resize(id+1, tracker);
+    }
+
+    // A user that was not tracked in the previous update is a new user.
+    auto & tracker = hand_trackers_[id];
+    if (tracker.last_user_id_+1 != user_id_)
+    {
+        tracker.hands_ = UserHands();
+        tracker.predictor_left_.reset();
+        tracker.predictor_right_.reset();
+        tracker.click_left_.reset();
+        tracker.click_right_.reset();
+        tracker.entered_ = true;
+    }
+    tracker.hands_.id_ = id;
+    tracker.last_user_id_ = user_id_;
+    return tracker;
+}
+
+void Sensor::compute_hand_positions(User const & u, XnVector3D & left, XnVector3D & right, bool & left_visible, bool & right_visible)
+{
+    // Only track if the main joints are known.
+    if (!u.joints_.has(XN_SKEL_TORSO) ||
+        !u.joints_.has(XN_SKEL_LEFT_SHOULDER) ||
+        !u.joints_.has(XN_SKEL_RIGHT_SHOULDER))
+        return;
+    auto const torso = to_vec3(u.joints_.at(XN_SKEL_TORSO).real_position_);
+    auto const & base_change = u.base_change();
+
+    // Track the left hand: Transform the hand coordinates relative to the user plane position.
+    left_visible = u.joints_.has(XN_SKEL_LEFT_HAND);
+    if (left_visible)
+    {
+        left = to_xn(base_change * (to_vec3(u.joints_.at(XN_SKEL_LEFT_HAND).real_position_) - torso));
+        left.Y = 1.5 - left.Y;
+    }
+
+    // Track the right hand.
+    right_visible = u.joints_.has(XN_SKEL_RIGHT_HAND);
+    if (right_visible)
+    {
+        right = to_xn(base_change * (to_vec3(u.joints_.at(XN_SKEL_RIGHT_HAND).real_position_) - torso));
+        right.Y = 1.5 - right.Y;
+    }
+}
+
+void Sensor::detect_clicks(HandTracker & tracker, float elapsed_time)
+{
+    auto & h = tracker.hands_;
+    bool const use_y = click_use_y_.load(std::memory_order_relaxed);
+    tracker.click_left_.use_y_ = use_y;
+    tracker.click_right_.use_y_ = use_y;
+    if (h.left_visible_)
+    {
+        auto const was_clicked = tracker.click_left_.clicked();
+        tracker.click_left_.update(elapsed_time, h.left_raw_);
+        if (!was_clicked && tracker.click_left_.clicked())
+            h.click_left_ = ++click_sequence_;
+    }
+    else
+        tracker.click_left_.reset();
+    if (h.right_visible_)
+    {
+        auto const was_clicked = tracker.click_right_.clicked();
+        tracker.click_right_.update(elapsed_time, h.right_raw_);
+        if (!was_clicked && tracker.click_right_.clicked())
+            h.click_right_ = ++click_sequence_;
+    }
+    else
+        tracker.click_right_.reset();
+}
+
+void Sensor::push_input(SensorFrame const & frame)
+{
+    // Read the flag before the queue, so a new queue is seen together with its flag.
+    bool const opened = input_opened_.exchange(false);
+    auto const queue = std::atomic_load(&input_queue_);
+    auto const push = [&](InputSample const & s){
+        if (queue && !queue->push(s))
+            input_dropped_.fetch_add(1, std::memory_order_relaxed);
+    };
+
+    // Report the users that were lost since the previous update.
+    InputSample sample;
+    sample.timestamp_ = frame.timestamp_;
+    for (auto const id : tracked_users_)
+    {
+        auto const tracked = std::any_of(frame.users_.begin(), frame.users_.end(), [id](User const & u){
+            return u.id_ == id;
+        });
+        if (!tracked)
+        {
+            sample.type_ = InputSample::UserLeft;
+            sample.user_ = id;
+            sample.hand_ = InputSample::NoHand;
+            push(sample);
+        }
+    }
+    tracked_users_.clear();
+
+    for (auto const & u : frame.users_)
+    {
+        tracked_users_.push_back(u.id_);
+        auto & tracker = hand_trackers_[u.id_];
+        auto const & h = tracker.hands_;
+        sample.user_ = u.id_;
+        if (tracker.entered_ || opened)
+        {
+            sample.type_ = InputSample::UserEntered;
+            sample.hand_ = InputSample::NoHand;
+            push(sample);
+            tracker.entered_ = false;
+        }
+        if (h.left_visible_)
+        {
+            sample.hand_ = InputSample::LeftHand;
+            sample.position_ = normalize_hand_left(h.left_predicted_);
+            sample.type_ = InputSample::HandMoved;
+            push(sample);
+            if (h.click_left_ > last_click_pushed_)
+            {
+                sample.type_ = InputSample::Click;
+                push(sample);
+            }
+        }
+        if (h.right_visible_)
+        {
+            sample.hand_ = InputSample::RightHand;
+            sample.position_ = normalize_hand_right(h.right_predicted_);
+            sample.type_ = InputSample::HandMoved;
+            push(sample);
+            if (h.click_right_ > last_click_pushed_)
+            {
+                sample.type_ = InputSample::Click;
+                push(sample);
+            }
+        }
+    }
+    last_click_pushed_ = click_sequence_;
+}
+
+void Sensor::check_for_clicks()
+{
+    auto const & frame = frames_.front();
+
+    // Fill the cursors. The clicks are detected in the capture thread, a click sequence number
+    // that was not reported yet is a new click, even if the frame of the click was skipped.
+    cursors_.resize(frame.hands_.size());
+    auto last_click = last_click_seen_;
+    for (size_t i = 0; i < frame.hands_.size(); ++i)
+    {
+        auto const & h = frame.hands_[i];
+        auto & c = cursors_[i];
+        c.id_ = h.id_;
+        c.left_ = normalize_hand_left(h.left_predicted_);
+        c.right_ = normalize_hand_right(h.right_predicted_);
+        c.left_visible_ = h.left_visible_;
+        c.right_visible_ = h.right_visible_;
+        c.clicked_left_ = h.click_left_ > last_click_seen_;
+        c.clicked_right_ = h.click_right_ > last_click_seen_;
+        last_click = std::max(last_click, std::max(h.click_left_, h.click_right_));
+    }
+    last_click_seen_ = last_click;
+
+    // The click callbacks follow the first user, like the KinectClick events of the input queue.
+    if (!cursors_.empty())
+    {
+        auto const clicked_left = cursors_.front().clicked_left_;
+        auto const clicked_right = cursors_.front().clicked_right_;
+        if (clicked_left && handle_click_left_)
+            handle_click_left_();
+        if (clicked_right && handle_click_right_)
+            handle_click_right_();
+    }
+}
+
+
+
+} // namespace kin
+
+
+
+#endif
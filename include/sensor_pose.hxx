@@ -0,0 +1,99 @@
+#ifndef SENSOR_POSE_HXX
+#define SENSOR_POSE_HXX
+
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <cmath>
+
+#include "platform_support.hxx"
+#ifdef OPENNI_FOUND
+#include <XnCppWrapper.h>
+#endif
+
+#include "utility.hxx"
+#include "vecmath.hxx"
+
+namespace kin
+{
+
+/**
+ * @brief The SensorPose struct holds the extrinsic calibration of a sensor.
+ *
+ * It maps the real world coordinates of the sensor (mm) into the world space that is shared by
+ * all sensors: world = rotation_ * sensor + translation_.
+ */
+struct SensorPose
+{
+    SensorPose()
+        :
+          rotation_(),
+          translation_()
+    {}
+
+    /**
+     * @brief Create the pose of a sensor at the given position (mm) that is turned by yaw (around y), pitch (around x) and roll (around z) degrees.
+     */
+    static SensorPose from_angles(XnVector3D const & position, float yaw, float pitch = 0, float roll = 0);
+
+    /**
+     * @brief Map a point from sensor to world coordinates.
+     */
+    XnVector3D to_world(XnVector3D const & p) const
+    {
+        return to_xn(rotation_ * to_vec3(p) + translation_);
+    }
+
+    /**
+     * @brief Map a point from world to sensor coordinates.
+     */
+    XnVector3D to_sensor(XnVector3D const & p) const
+    {
+        return to_xn(rotation_.transposed() * (to_vec3(p) - translation_));
+    }
+
+    Mat3 rotation_; // the rotation matrix
+    Vec3 translation_; // the position of the sensor in the world (mm)
+};
+
+SensorPose SensorPose::from_angles(XnVector3D const & position, float yaw, float pitch, float roll)
+{
+    float const deg = 3.14159265f / 180.0f;
+    float const cy = std::cos(yaw * deg), sy = std::sin(yaw * deg);
+    float const cp = std::cos(pitch * deg), sp = std::sin(pitch * deg);
+    float const cr = std::cos(roll * deg), sr = std::sin(roll * deg);
+
+    // rotation = R_y(yaw) * R_x(pitch) * R_z(roll)
+    SensorPose pose;
+    pose.rotation_ = Mat3(
+        cy*cr + sy*sp*sr, -cy*sr + sy*sp*cr, sy*cp,
+        cp*sr, cp*cr, -sp,
+        -sy*cr + cy*sp*sr, sy*sr + cy*sp*cr, cy*cp
+    );
+    pose.translation_ = to_vec3(position);
+    return pose;
+}
+
+/**
+ * @brief Parse a pose of the form "x,y,z[,yaw[,pitch[,roll]]]" (position in mm, angles in degrees, see SensorPose::from_angles()).
+ */
+SensorPose parse_sensor_pose(std::string const & spec)
+{
+    std::vector<float> params;
+    std::string rest = spec;
+    while (!rest.empty())
+    {
+        auto const comma = rest.find(',');
+        params.push_back(std::stof(rest.substr(0, comma)));
+        rest = comma == std::string::npos ? "" : rest.substr(comma+1);
+    }
+    if (params.size() < 3 || params.size() > 6)
+        throw std::runtime_error("parse_sensor_pose(): Expected x,y,z[,yaw[,pitch[,roll]]]: " + spec);
+    params.resize(6, 0.0f);
+    XnVector3D const position = {params[0], params[1], params[2]};
+    return SensorPose::from_angles(position, params[3], params[4], params[5]);
+}
+
+} // namespace kin
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef SENSORS_HXX
+#define SENSORS_HXX
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "sensor.hxx"
+#include "recording.hxx"
+#include "replay_sensor.hxx"
+#include "synthetic_sensor.hxx"
+#include "multi_sensor.hxx"
+#include "logger.hxx"
+#ifdef OPENNI_FOUND
+#include "kinect.hxx"
+#endif
+
+namespace kin
+{
+
+/**
+ * @brief Create the sensor that is selected by the command line arguments.
+ *
+ * --replay <file>      play the given recording instead of using the kinect
+ * --fast               play the recording as fast as possible instead of in real time
+ * --synthetic <n>      generate n animated users instead of using the kinect
+ * --resolution <w>x<h> resolution of the synthetic sensor
+ * --fps <f>            frame rate of the synthetic sensor (0: as fast as possible)
+ * --kinect <i>         use the i-th kinect
+ * --acquisition <mode> synchronized (default) waits for depth and labels of the same kinect frame, any publishes every update
+ * --pose <x,y,z,yaw>   pose of the previous source in the world (see parse_sensor_pose())
+ * --merge-distance <d> merge users of different sources whose torsos are closer than d mm
+ * --record <file>      record the sensor frames into the given file; the sensor already captures while it is opened,
+ *                      so the frames before the recorder is attached (usually the first one or two) are lost
+ * --filter <spec>      joint filter, e. g. none, average:10, one-euro:1.0,0.007 or kalman:20000,10 (see parse_joint_filter())
+ * --predict <ms>       extrapolate the hand positions by the given time (0: no prediction)
+ * --pyramid <spec>     levels of the depth pyramid, e. g. 3,min or 2,median (see parse_depth_pyramid())
+ * --denoise <spec>     temporal depth filter and hole filling passes, e. g. median,2 or exp:0.4,1 (see parse_depth_filter())
+ * --segment <spec>     segment the users from the depth if the tracker labels none (fallback) or always, e. g. fallback,200 (see parse_user_segmentation())
+ * --log <file>         write the sensor log into the given file instead of the terminal
+ * --log-level <level>  minimum level of the logged messages: debug, info, warning or error
+ *
+ * Each --replay, --synthetic and --kinect adds a source. If several sources are given, their
+ * users are merged by a MultiSensor. A synthetic source with a pose sees the synthetic users
+ * from that pose, so two synthetic sources test the merging. A single source with a pose is
+ * wrapped by a MultiSensor as well, so its joints are in world coordinates, too.
+ *
+ * Unknown arguments are ignored, so the caller can use them for something else.
+ */
+std::unique_ptr<Sensor> open_sensor(int argc, char** argv)
+{
+    // A source that was selected on the command line.
+    struct SourceArgs
+    {
+        enum Type { Replay, Synthetic, Kinect } type_;
+        std::string file_; // the recording
+        size_t count_; // number of synthetic users or kinect index
+        SensorPose pose_; // the pose of the source
+    };
+
+    std::vector<SourceArgs> sources;
+    std::string record_file;
+    bool fast = false;
+#ifdef OPENNI_FOUND
+    bool any_update = false;
+#endif
+    SyntheticSensorOptions synthetic_options;
+    std::string filter;
+    float predict_ms = -1;
+    std::string pyramid;
+    std::string denoise;
+    std::string segment;
+    float merge_distance = 400.0f;
+    bool posed = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string const arg = argv[i];
+        if (arg == "--replay" && i+1 < argc)
+        {
+            SourceArgs source = {SourceArgs::Replay, argv[++i], 0, SensorPose()};
+            sources.push_back(source);
+        }
+        else if (arg == "--record" && i+1 < argc)
+            record_file = argv[++i];
+        else if (arg == "--fast")
+            fast = true;
+        else if (arg == "--synthetic" && i+1 < argc)
+        {
+            SourceArgs source = {SourceArgs::Synthetic, "", std::stoul(argv[++i]), SensorPose()};
+            sources.push_back(source);
+        }
+        else if (arg == "--kinect" && i+1 < argc)
+        {
+            SourceArgs source = {SourceArgs::Kinect, "", std::stoul(argv[++i]), SensorPose()};
+            sources.push_back(source);
+        }
+        else if (arg == "--acquisition" && i+1 < argc)
+        {
+            std::string const mode = argv[++i];
+            if (mode != "any" && mode != "synchronized")
+                throw std::runtime_error("open_sensor(): Unknown acquisition mode: " + mode);
+#ifdef OPENNI_FOUND
+            any_update = mode == "any";
+#endif
+        }
+        else if (arg == "--pose" && i+1 < argc)
+        {
+            if (sources.empty())
+                throw std::runtime_error("open_sensor(): --pose must follow a source.");
+            sources.back().pose_ = parse_sensor_pose(argv[++i]);
+            posed = true;
+        }
+        else if (arg == "--merge-distance" && i+1 < argc)
+            merge_distance = std::stof(argv[++i]);
+        else if (arg == "--resolution" && i+1 < argc)
+        {
+            std::string const res = argv[++i];
+            auto const pos = res.find('x');
+            if (pos == std::string::npos)
+                throw std::runtime_error("open_sensor(): Resolution must have the form <width>x<height>.");
+            synthetic_options.x_res_ = std::stoul(res.substr(0, pos));
+            synthetic_options.y_res_ = std::stoul(res.substr(pos+1));
+        }
+        else if (arg == "--fps" && i+1 < argc)
+            synthetic_options.fps_ = std::stof(argv[++i]);
+        else if (arg == "--filter" && i+1 < argc)
+            filter = argv[++i];
+        else if (arg == "--predict" && i+1 < argc)
+            predict_ms = std::stof(argv[++i]);
+        else if (arg == "--pyramid" && i+1 < argc)
+            pyramid = argv[++i];
+        else if (arg == "--denoise" && i+1 < argc)
+            denoise = argv[++i];
+        else if (arg == "--segment" && i+1 < argc)
+            segment = argv[++i];
+        else if (arg == "--log" && i+1 < argc)
+            Logger::instance().set_output(argv[++i]);
+        else if (arg == "--log-level" && i+1 < argc)
+            Logger::instance().set_level(parse_log_level(argv[++i]));
+    }
+    if (sources.empty())
+    {
+        SourceArgs source = {SourceArgs::Kinect, "", 0, SensorPose()};
+        sources.push_back(source);
+    }
+
+    // Create the sources.
+    std::vector<std::unique_ptr<Sensor> > sensors;
+    std::vector<SensorPose> poses;
+    for (auto const & source : sources)
+    {
+        std::unique_ptr<Sensor> sensor;
+        if (source.type_ == SourceArgs::Replay)
+        {
+            auto const mode = fast ? ReplaySensor::AsFastAsPossible : ReplaySensor::RealTime;
+            sensor.reset(new ReplaySensor(source.file_, mode));
+        }
+        else if (source.type_ == SourceArgs::Synthetic)
+        {
+            auto options = synthetic_options;
+            options.num_users_ = source.count_;
+            options.pose_ = source.pose_;
+            sensor.reset(new SyntheticSensor(options));
+        }
+        else
+        {
+#ifdef OPENNI_FOUND
+            auto const acquisition = any_update ? KinectSensor::AnyUpdate : KinectSensor::Synchronized;
+            sensor.reset(new KinectSensor(source.count_, acquisition));
+#else
+            throw std::runtime_error("open_sensor(): Compiled without OpenNI, only --replay and --synthetic are available.");
+#endif
+        }
+        sensors.push_back(std::move(sensor));
+        poses.push_back(source.pose_);
+    }
+
+    std::unique_ptr<Sensor> sensor;
+    if (sensors.size() == 1 && !posed)
+        sensor = std::move(sensors.front());
+    else
+        sensor.reset(new MultiSensor(std::move(sensors), poses, merge_distance));
+
+    if (!filter.empty())
+        sensor->set_joint_filter(parse_joint_filter(filter));
+    if (predict_ms >= 0)
+        sensor->set_hand_prediction(PredictionOptions(predict_ms / 1000.0f));
+    if (!pyramid.empty())
+        sensor->set_depth_pyramid(parse_depth_pyramid(pyramid));
+    if (!denoise.empty())
+        sensor->set_depth_filter(parse_depth_filter(denoise));
+    if (!segment.empty())
+        sensor->set_user_segmentation(parse_user_segmentation(segment));
+
+    if (!record_file.empty())
+    {
+        auto recorder = std::make_shared<SensorRecorder>(record_file, sensor->x_res(), sensor->y_res(), sensor->z_res(),
+                                                         sensor->field_of_view());
+        SensorRecorder::attach(*sensor, recorder);
+    }
+
+    return sensor;
+}
+
+} // namespace kin
+
+#endif
@@ -0,0 +1,314 @@
+#ifndef SKELETON_HXX
+#define SKELETON_HXX
+
+#include <stdexcept>
+#include <array>
+#include <bitset>
+#include <iterator>
+#include <cstddef>
+
+#include "platform_support.hxx"
+#ifdef OPENNI_FOUND
+#include <XnCppWrapper.h>
+#endif
+
+#include "utility.hxx"
+#include "vecmath.hxx"
+
+
+namespace kin
+{
+
+/**
+ * @brief Static constant array with all possible joints.
+ */
+static std::array<XnSkeletonJoint, 24> const skeleton_joints = {
+    XN_SKEL_HEAD,
+    XN_SKEL_NECK,
+    XN_SKEL_TORSO,
+    XN_SKEL_WAIST,
+    XN_SKEL_LEFT_COLLAR,
+    XN_SKEL_LEFT_SHOULDER,
+    XN_SKEL_LEFT_ELBOW,
+    XN_SKEL_LEFT_WRIST,
+    XN_SKEL_LEFT_HAND,
+    XN_SKEL_LEFT_FINGERTIP,
+    XN_SKEL_RIGHT_COLLAR,
+    XN_SKEL_RIGHT_SHOULDER,
+    XN_SKEL_RIGHT_ELBOW,
+    XN_SKEL_RIGHT_WRIST,
+    XN_SKEL_RIGHT_HAND,
+    XN_SKEL_RIGHT_FINGERTIP,
+    XN_SKEL_LEFT_HIP,
+    XN_SKEL_LEFT_KNEE,
+    XN_SKEL_LEFT_ANKLE,
+    XN_SKEL_LEFT_FOOT,
+    XN_SKEL_RIGHT_HIP,
+    XN_SKEL_RIGHT_KNEE,
+    XN_SKEL_RIGHT_ANKLE,
+    XN_SKEL_RIGHT_FOOT
+};
+
+/**
+ * @brief The JointInfo struct contains position and confidence values about a single joint.
+ */
+struct JointInfo
+{
+    XnSkeletonJoint joint_;
+    XnConfidence confidence_;
+    XnPoint3D real_position_;
+    XnPoint3D proj_position_;
+
+    explicit JointInfo(XnSkeletonJoint joint = XnSkeletonJoint(),
+                       XnConfidence confidence = 0,
+                       XnPoint3D const & real_position = XnPoint3D(),
+                       XnPoint3D const & proj_position = XnPoint3D())
+        :
+          joint_(joint),
+          confidence_(confidence),
+          real_position_(real_position),
+          proj_position_(proj_position)
+    {}
+};
+
+/**
+ * @brief Number of skeleton joints.
+ */
+static size_t const num_joints = 24;
+
+/**
+ * @brief Return the dense index (0, ..., num_joints-1) of the given joint.
+ * @note OpenNI numbers the joints from XN_SKEL_HEAD to XN_SKEL_RIGHT_FOOT in the order of skeleton_joints.
+ */
+inline size_t joint_index(XnSkeletonJoint joint)
+{
+    return static_cast<size_t>(joint) - static_cast<size_t>(XN_SKEL_HEAD);
+}
+
+/**
+ * @brief The JointSet class stores the joints of a user in a fixed array, indexed by joint_index().
+ *
+ * A bitmask marks the valid joints, so clearing and refilling the set never touches the heap.
+ * Iterating visits the valid joints in the order of skeleton_joints.
+ */
+class JointSet
+{
+public:
+
+    class const_iterator
+    {
+    public:
+
+        typedef std::forward_iterator_tag iterator_category;
+        typedef JointInfo value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef JointInfo const * pointer;
+        typedef JointInfo const & reference;
+
+        const_iterator(JointSet const * set, size_t i)
+            :
+              set_(set),
+              i_(i)
+        {
+            skip();
+        }
+
+        JointInfo const & operator*() const
+        {
+            return set_->joints_[i_];
+        }
+
+        JointInfo const * operator->() const
+        {
+            return &set_->joints_[i_];
+        }
+
+        const_iterator & operator++()
+        {
+            ++i_;
+            skip();
+            return *this;
+        }
+
+        const_iterator operator++(int)
+        {
+            auto tmp = *this;
+            ++*this;
+            return tmp;
+        }
+
+        bool operator==(const_iterator const & other) const
+        {
+            return i_ == other.i_;
+        }
+
+        bool operator!=(const_iterator const & other) const
+        {
+            return i_ != other.i_;
+        }
+
+    private:
+
+        /**
+         * @brief Advance to the next valid joint.
+         */
+        void skip()
+        {
+            while (i_ < num_joints && !set_->valid_[i_])
+                ++i_;
+        }
+
+        JointSet const * set_; // the joint set
+        size_t i_; // the current joint index
+
+    };
+
+    /**
+     * @brief Return whether the given joint is valid.
+     */
+    bool has(XnSkeletonJoint joint) const
+    {
+        auto const i = joint_index(joint);
+        return i < num_joints && valid_[i];
+    }
+
+    /**
+     * @brief Return the given joint. Throw if it is not valid.
+     */
+    JointInfo const & at(XnSkeletonJoint joint) const
+    {
+        if (!has(joint))
+            throw std::out_of_range("JointSet::at(): Joint not available.");
+        return joints_[joint_index(joint)];
+    }
+
+    /**
+     * @brief Store the given joint (joint.joint_ selects the slot) and mark it as valid.
+     */
+    void set(JointInfo const & joint)
+    {
+        auto const i = joint_index(joint.joint_);
+        if (i >= num_joints)
+            throw std::out_of_range("JointSet::set(): Invalid joint.");
+        joints_[i] = joint;
+        valid_.set(i);
+    }
+
+    /**
+     * @brief Mark the given joint as invalid.
+     */
+    void erase(XnSkeletonJoint joint)
+    {
+        auto const i = joint_index(joint);
+        if (i < num_joints)
+            valid_.reset(i);
+    }
+
+    /**
+     * @brief Mark all joints as invalid.
+     */
+    void clear()
+    {
+        valid_.reset();
+    }
+
+    /**
+     * @brief Return the number of valid joints.
+     */
+    size_t size() const
+    {
+        return valid_.count();
+    }
+
+    bool empty() const
+    {
+        return valid_.none();
+    }
+
+    const_iterator begin() const
+    {
+        return const_iterator(this, 0);
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator(this, num_joints);
+    }
+
+private:
+
+    std::array<JointInfo, num_joints> joints_; // the joints, indexed by joint_index()
+    std::bitset<num_joints> valid_; // the valid joints
+
+};
+
+/**
+ * @brief The User class stores user information, e. g. whether the user left the scene.
+ */
+struct User
+{
+public:
+
+    XnLabel id_;
+    bool visible_;
+    JointSet joints_;
+
+    explicit User(XnLabel id = 0, bool visible = true)
+        :
+          id_(id),
+          visible_(visible)
+    {}
+
+    /**
+     * @brief Compute the base change matrix (real coordinates -> user plane coordinates).
+     *
+     * The base is spanned by the shoulder axis, the vertical and the horizontal normal of the
+     * shoulder axis. The inverse base is multiplied by a matrix that has 1/(shoulder width) in
+     * every row of its middle column, so the transformed vector depends on its y component only:
+     * y is measured in shoulder widths, x and z get the row sums of the inverse base times y.
+     * The hand mapping depends on these values, so they are kept (sensor_tool check-math pins them).
+     */
+    void compute_base_change()
+    {
+        if (joints_.has(XN_SKEL_LEFT_SHOULDER) && joints_.has(XN_SKEL_RIGHT_SHOULDER))
+        {
+            auto const s0 = to_vec3(joints_.at(XN_SKEL_LEFT_SHOULDER).real_position_);
+            auto const s1 = to_vec3(joints_.at(XN_SKEL_RIGHT_SHOULDER).real_position_);
+            auto const d = s1 - s0;
+            auto const len = length(d);
+
+            Mat3 const base(d.x_, 0, d.z_, 0, 1, 0, d.z_, 0, -d.x_);
+            base_change_ = base.inverse();
+            if (len > 0)
+            {
+                auto const s = 1 / len;
+                base_change_ = base_change_ * Mat3(0, s, 0, 0, s, 0, 0, s, 0);
+            }
+        }
+    }
+
+    /**
+     * @brief Return the base change matrix (real coordinates -> user plane coordinates).
+     */
+    Mat3 const & base_change() const
+    {
+        return base_change_;
+    }
+
+    /**
+     * @brief Transform the given vector from real coordinates to user plane coordinates.
+     */
+    XnVector3D transform_vector(XnVector3D const & v) const
+    {
+        return to_xn(base_change_ * to_vec3(v));
+    }
+
+private:
+
+    Mat3 base_change_; // the base change matrix (identity until it is computed)
+
+};
+
+} // namespace kin
+
+#endif
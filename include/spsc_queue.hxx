@@ -0,0 +1,99 @@
+#ifndef SPSC_QUEUE_HXX
+#define SPSC_QUEUE_HXX
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+
+
+/**
+ * @brief Bounded wait-free queue that hands values from one producer thread to one consumer thread.
+ *
+ * push() and pop() never wait: push() fails if the queue is full, pop() fails if it is empty. Each
+ * side caches the last seen index of the other side, so the shared indices are only read when the
+ * cached one says that the queue is full or empty.
+ */
+template <typename T, size_t N>
+class SpscQueue
+{
+    static_assert(N >= 2 && (N & (N-1)) == 0, "SpscQueue: The capacity must be a power of two.");
+
+public:
+
+    typedef T value_type;
+
+    SpscQueue()
+        :
+          head_(0),
+          tail_cache_(0),
+          tail_(0),
+          head_cache_(0)
+    {}
+
+    /**
+     * @brief Append a value (producer only). Return false if the queue is full.
+     */
+    bool push(value_type const & v)
+    {
+        auto const head = head_.load(std::memory_order_relaxed);
+        if (head - tail_cache_ == N)
+        {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (head - tail_cache_ == N)
+                return false;
+        }
+        buffer_[head % N] = v;
+        head_.store(head+1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Remove the oldest value (consumer only). Return false if the queue is empty.
+     */
+    bool pop(value_type & v)
+    {
+        auto const tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_cache_)
+        {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (tail == head_cache_)
+                return false;
+        }
+        v = buffer_[tail % N];
+        tail_.store(tail+1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Return the number of queued values. It may be outdated as soon as it is returned.
+     */
+    size_t size() const
+    {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+    static size_t capacity()
+    {
+        return N;
+    }
+
+private:
+
+    std::array<value_type, N> buffer_; // the ring buffer
+
+    // The padding keeps the producer and the consumer data on different cache lines. It is used
+    // instead of alignas, because C++11 does not guarantee over-aligned heap allocations.
+    char pad0_[64];
+    std::atomic<size_t> head_; // the next position that is written (producer)
+    size_t tail_cache_; // the last seen value of tail_ (producer)
+    char pad1_[64];
+    std::atomic<size_t> tail_; // the next position that is read (consumer)
+    size_t head_cache_; // the last seen value of head_ (consumer)
+    char pad2_[64];
+
+};
+
+
+
+#endif
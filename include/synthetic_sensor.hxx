@@ -0,0 +1,334 @@
+#ifndef SYNTHETIC_SENSOR_HXX
+#define SYNTHETIC_SENSOR_HXX
+
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+
+#include "sensor.hxx"
+#include "sensor_pose.hxx"
+
+namespace kin
+{
+
+/**
+ * @brief The SyntheticSensorOptions struct configures the SyntheticSensor.
+ */
+struct SyntheticSensorOptions
+{
+    explicit SyntheticSensorOptions(
+            size_t num_users = 1,
+            XnUInt32 x_res = 640,
+            XnUInt32 y_res = 480,
+            float fps = 30.0f
+    )   :
+          num_users_(num_users),
+          x_res_(x_res),
+          y_res_(y_res),
+          z_res_(10000),
+          fps_(fps),
+          hfov_(1.0144f),
+          vfov_(0.7898f),
+          swing_period_(1.0f)
+    {}
+
+    size_t num_users_; // number of generated users
+    XnUInt32 x_res_; // the x resolution
+    XnUInt32 y_res_; // the y resolution
+    XnUInt32 z_res_; // the z resolution (maximum depth in mm plus one)
+    float fps_; // frames per second, 0 means as fast as update() grabs them
+    float hfov_; // horizontal field of view in radians (kinect default)
+    float vfov_; // vertical field of view in radians (kinect default)
+    float swing_period_; // time in seconds that a user needs to strike one mole field
+    SensorPose pose_; // the pose of the sensor in the world (the users are placed in world coordinates)
+};
+
+/**
+ * @brief The SyntheticSensor class fabricates depth maps, user labels and animated skeletons.
+ *
+ * Each user stands in front of a wall and strikes the 3x3 mole fields one after another with
+ * the right hand: The hand moves to the field, goes up and quickly comes down again. Users are
+ * placed side by side in rows that move away from the origin as more users are added. The users
+ * live in world coordinates, so several synthetic sensors with different poses see the same
+ * users from different points of view. It has the same interface as the KinectSensor, so it
+ * can replace it for load tests.
+ */
+class SyntheticSensor : public Sensor
+{
+public:
+
+    /**
+     * @brief Start the generator thread.
+     */
+    explicit SyntheticSensor(SyntheticSensorOptions const & options = SyntheticSensorOptions());
+
+    /**
+     * @brief Join the generator thread.
+     */
+    ~SyntheticSensor();
+
+    /**
+     * @brief Return the options.
+     */
+    SyntheticSensorOptions const & options() const
+    {
+        return options_;
+    }
+
+protected:
+
+    /**
+     * @brief Wait until the next frame is due and generate it.
+     */
+    UpdateDetails capture_impl(SensorFrame & frame);
+
+private:
+
+    /**
+     * @brief Project a real world point (mm) into the depth image.
+     */
+    XnPoint3D project(XnPoint3D const & p) const;
+
+    /**
+     * @brief Fill the background (wall and floor).
+     */
+    void draw_background(SensorFrame & frame) const;
+
+    /**
+     * @brief Draw a capsule between the two real world points with the given radius (mm).
+     */
+    void draw_capsule(SensorFrame & frame, XnPoint3D const & a, XnPoint3D const & b, float radius, XnLabel label) const;
+
+    /**
+     * @brief Create the skeleton of user i at time t.
+     */
+    void create_user(size_t i, double t, User & user) const;
+
+    typedef std::chrono::steady_clock Clock;
+
+    SyntheticSensorOptions options_; // the options
+    float fx_; // focal length in x (pixels)
+    float fy_; // focal length in y (pixels)
+    size_t frame_count_; // number of generated frames
+    Clock::time_point start_time_; // the time of the first frame
+
+};
+
+SyntheticSensor::SyntheticSensor(SyntheticSensorOptions const & options)
+    :
+      options_(options),
+      fx_(0),
+      fy_(0),
+      frame_count_(0)
+{
+    if (options_.x_res_ == 0 || options_.y_res_ == 0)
+        throw std::runtime_error("SyntheticSensor::SyntheticSensor(): Resolution must be greater than zero.");
+    if (options_.num_users_ >= 0xFFFF)
+        throw std::runtime_error("SyntheticSensor::SyntheticSensor(): Too many users.");
+    fx_ = options_.x_res_ / (2 * std::tan(options_.hfov_ / 2));
+    fy_ = options_.y_res_ / (2 * std::tan(options_.vfov_ / 2));
+    start_time_ = Clock::now();
+    set_field_of_view(FieldOfView(options_.hfov_, options_.vfov_));
+    start(options_.x_res_, options_.y_res_, options_.z_res_);
+}
+
+SyntheticSensor::~SyntheticSensor()
+{
+    stop();
+}
+
+XnPoint3D SyntheticSensor::project(XnPoint3D const & p) const
+{
+    XnPoint3D q;
+    q.X = options_.x_res_ / 2.0f + fx_ * p.X / p.Z;
+    q.Y = options_.y_res_ / 2.0f - fy_ * p.Y / p.Z;
+    q.Z = p.Z;
+    return q;
+}
+
+void SyntheticSensor::draw_background(SensorFrame & frame) const
+{
+    // A wall at 4 m. The lower third of the image shows the floor that comes closer to the sensor.
+    XnDepthPixel const wall = 4000;
+    XnDepthPixel const floor_min = 1500;
+    size_t const horizon = 2 * options_.y_res_ / 3;
+    for (size_t y = 0; y < options_.y_res_; ++y)
+    {
+        XnDepthPixel d = wall;
+        if (y > horizon)
+            d = static_cast<XnDepthPixel>(wall - (wall - floor_min) * (y - horizon) / (options_.y_res_ - horizon));
+        std::fill(&frame.depth_data_(0, y), &frame.depth_data_(0, y) + options_.x_res_, d);
+    }
+    std::fill(frame.user_data_.begin(), frame.user_data_.end(), 0);
+    frame.label_bounds_ = Roi();
+}
+
+void SyntheticSensor::draw_capsule(SensorFrame & frame, XnPoint3D const & a, XnPoint3D const & b, float radius, XnLabel label) const
+{
+    if (a.Z <= 0 || b.Z <= 0)
+        return;
+    auto const pa = project(a);
+    auto const pb = project(b);
+    auto const r = radius * fx_ / std::min(a.Z, b.Z);
+
+    // Only visit the bounding box of the capsule.
+    int const w = static_cast<int>(options_.x_res_);
+    int const h = static_cast<int>(options_.y_res_);
+    int const x0 = std::max(0, static_cast<int>(std::floor(std::min(pa.X, pb.X) - r)));
+    int const x1 = std::min(w-1, static_cast<int>(std::ceil(std::max(pa.X, pb.X) + r)));
+    int const y0 = std::max(0, static_cast<int>(std::floor(std::min(pa.Y, pb.Y) - r)));
+    int const y1 = std::min(h-1, static_cast<int>(std::ceil(std::max(pa.Y, pb.Y) + r)));
+
+    if (x0 > x1 || y0 > y1)
+        return;
+
+    // The bounding box of the capsules is a cheap upper bound of the label bounds.
+    frame.label_bounds_ = frame.label_bounds_.united(Roi(x0, y0, x1+1, y1+1));
+
+    float const dx = pb.X - pa.X;
+    float const dy = pb.Y - pa.Y;
+    float const len2 = dx*dx + dy*dy;
+    for (int y = y0; y <= y1; ++y)
+    {
+        for (int x = x0; x <= x1; ++x)
+        {
+            // Distance to the segment and interpolated depth.
+            float t = 0;
+            if (len2 > 0)
+                t = std::min(1.0f, std::max(0.0f, ((x - pa.X) * dx + (y - pa.Y) * dy) / len2));
+            float const ex = x - (pa.X + t * dx);
+            float const ey = y - (pa.Y + t * dy);
+            if (ex*ex + ey*ey > r*r)
+                continue;
+            auto const d = static_cast<XnDepthPixel>(pa.Z + t * (pb.Z - pa.Z));
+            auto & depth = frame.depth_data_(x, y);
+            if (d < depth)
+            {
+                depth = d;
+                frame.user_data_(x, y) = label;
+            }
+        }
+    }
+}
+
+void SyntheticSensor::create_user(size_t i, double t, User & user) const
+{
+    // Place the users in rows of four, each row half a meter further away.
+    size_t const per_row = 4;
+    size_t const row = i / per_row;
+    size_t const col = i % per_row;
+    size_t const in_row = std::min(per_row, options_.num_users_ - row * per_row);
+    float const z = 2000.0f + 500.0f * row;
+    float const x = (col + 0.5f - in_row / 2.0f) * 700.0f;
+    float const L = 350.0f; // shoulder width
+
+    auto const phase_offset = 0.37 * i;
+    auto const swing = (t / options_.swing_period_) + phase_offset;
+    auto const field = static_cast<size_t>(std::floor(swing)) % 9;
+    auto const phase = static_cast<float>(swing - std::floor(swing));
+
+    // Hand offsets in shoulder units: u goes right, v goes up, w goes towards the sensor.
+    // The column of the field selects u, the row selects w (the depth control of the game).
+    float const u = -0.25f + 1.75f * (0.17f + 0.33f * (field % 3));
+    float const w = 1.5f - 1.5f * (0.15f + 0.3f * (field / 3));
+    float v;
+    if (phase < 0.8f)
+        v = -0.2f + phase;
+    else if (phase < 0.9f)
+        v = 0.6f - 8.0f * (phase - 0.8f);
+    else
+        v = -0.2f;
+
+    auto const P = [&](float px, float py, float pz){
+        XnPoint3D p = {x + px, py, z + pz};
+        return options_.pose_.to_sensor(p);
+    };
+    auto const torso = P(0, 0, 0);
+    auto const hand_right = P(u * L, v * L, -w * L);
+    auto const shoulder_right = P(0.5f * L, 0.9f * L, 0);
+    auto const elbow_right = P(0.5f * (0.5f * L + u * L), 0.5f * (0.9f * L + v * L) - 0.2f * L, -0.5f * w * L);
+
+    user.joints_.clear();
+    auto const add = [&](XnSkeletonJoint j, XnPoint3D const & p){
+        user.joints_.set(JointInfo(j, 1, p, project(p)));
+    };
+    add(XN_SKEL_HEAD, P(0, 1.6f * L, 0));
+    add(XN_SKEL_NECK, P(0, 1.0f * L, 0));
+    add(XN_SKEL_TORSO, torso);
+    add(XN_SKEL_LEFT_SHOULDER, P(-0.5f * L, 0.9f * L, 0));
+    add(XN_SKEL_LEFT_ELBOW, P(-0.7f * L, 0.1f * L, 0));
+    add(XN_SKEL_LEFT_HAND, P(-0.75f * L, -0.7f * L, 0));
+    add(XN_SKEL_RIGHT_SHOULDER, shoulder_right);
+    add(XN_SKEL_RIGHT_ELBOW, elbow_right);
+    add(XN_SKEL_RIGHT_HAND, hand_right);
+    add(XN_SKEL_LEFT_HIP, P(-0.3f * L, -1.0f * L, 0));
+    add(XN_SKEL_LEFT_KNEE, P(-0.3f * L, -2.2f * L, 0));
+    add(XN_SKEL_LEFT_FOOT, P(-0.3f * L, -3.4f * L, 0));
+    add(XN_SKEL_RIGHT_HIP, P(0.3f * L, -1.0f * L, 0));
+    add(XN_SKEL_RIGHT_KNEE, P(0.3f * L, -2.2f * L, 0));
+    add(XN_SKEL_RIGHT_FOOT, P(0.3f * L, -3.4f * L, 0));
+    user.compute_base_change();
+}
+
+UpdateDetails SyntheticSensor::capture_impl(SensorFrame & frame)
+{
+    // Wait until the next frame is due.
+    double t;
+    if (options_.fps_ > 0)
+    {
+        auto const due = start_time_ + std::chrono::microseconds(static_cast<long long>(frame_count_ * 1e6 / options_.fps_));
+        std::this_thread::sleep_until(due);
+        t = frame_count_ / options_.fps_;
+    }
+    else
+    {
+        while (frame_pending() && running())
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        t = std::chrono::duration<double>(Clock::now() - start_time_).count();
+    }
+    ++frame_count_;
+    frame.timestamp_ = static_cast<XnUInt64>(t * 1e6);
+
+    // Create the skeletons and draw the users. The depth test resolves overlapping users.
+    // Users whose torso is outside of the field of view are not tracked.
+    frame.users_.resize(options_.num_users_);
+    draw_background(frame);
+    size_t n_tracked = 0;
+    for (size_t i = 0; i < options_.num_users_; ++i)
+    {
+        auto & user = frame.users_[n_tracked];
+        user = User(static_cast<XnLabel>(i+1), true);
+        create_user(i, t, user);
+        auto const & torso = user.joints_.at(XN_SKEL_TORSO);
+        if (torso.real_position_.Z <= 0 ||
+                torso.proj_position_.X < 0 || torso.proj_position_.X >= options_.x_res_ ||
+                torso.proj_position_.Y < 0 || torso.proj_position_.Y >= options_.y_res_)
+            continue;
+        ++n_tracked;
+        auto const label = user.id_;
+        auto const & j = user.joints_;
+        draw_capsule(frame, j.at(XN_SKEL_HEAD).real_position_, j.at(XN_SKEL_NECK).real_position_, 110, label);
+        draw_capsule(frame, j.at(XN_SKEL_NECK).real_position_, j.at(XN_SKEL_TORSO).real_position_, 180, label);
+        draw_capsule(frame, j.at(XN_SKEL_TORSO).real_position_, j.at(XN_SKEL_LEFT_HIP).real_position_, 150, label);
+        draw_capsule(frame, j.at(XN_SKEL_TORSO).real_position_, j.at(XN_SKEL_RIGHT_HIP).real_position_, 150, label);
+        draw_capsule(frame, j.at(XN_SKEL_LEFT_SHOULDER).real_position_, j.at(XN_SKEL_LEFT_ELBOW).real_position_, 50, label);
+        draw_capsule(frame, j.at(XN_SKEL_LEFT_ELBOW).real_position_, j.at(XN_SKEL_LEFT_HAND).real_position_, 45, label);
+        draw_capsule(frame, j.at(XN_SKEL_RIGHT_SHOULDER).real_position_, j.at(XN_SKEL_RIGHT_ELBOW).real_position_, 50, label);
+        draw_capsule(frame, j.at(XN_SKEL_RIGHT_ELBOW).real_position_, j.at(XN_SKEL_RIGHT_HAND).real_position_, 45, label);
+        draw_capsule(frame, j.at(XN_SKEL_LEFT_HIP).real_position_, j.at(XN_SKEL_LEFT_KNEE).real_position_, 70, label);
+        draw_capsule(frame, j.at(XN_SKEL_LEFT_KNEE).real_position_, j.at(XN_SKEL_LEFT_FOOT).real_position_, 60, label);
+        draw_capsule(frame, j.at(XN_SKEL_RIGHT_HIP).real_position_, j.at(XN_SKEL_RIGHT_KNEE).real_position_, 70, label);
+        draw_capsule(frame, j.at(XN_SKEL_RIGHT_KNEE).real_position_, j.at(XN_SKEL_RIGHT_FOOT).real_position_, 60, label);
+    }
+    frame.users_.resize(n_tracked);
+
+    UpdateDetails updates(true, true);
+    updates.sensor_frame_ = static_cast<XnUInt32>(frame_count_);
+    return updates;
+}
+
+} // namespace kin
+
+#endif
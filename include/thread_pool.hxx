@@ -0,0 +1,182 @@
+#ifndef THREAD_POOL_HXX
+#define THREAD_POOL_HXX
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+
+
+
+/**
+ * @brief A fixed set of worker threads that split loops over index ranges.
+ *
+ * parallel_for() cuts the range into chunks. The workers and the calling thread take the chunks
+ * one after another until all are done, then parallel_for() returns. The threads are started once
+ * and sleep between the loops, so a loop per frame does not create threads.
+ */
+class ThreadPool
+{
+public:
+
+    typedef std::function<void(size_t, size_t)> Task;
+
+    /**
+     * @brief Start the given number of worker threads. The calling thread of parallel_for() works as well.
+     */
+    explicit ThreadPool(size_t num_workers = default_workers());
+
+    ~ThreadPool();
+
+    ThreadPool(ThreadPool const &) = delete;
+    ThreadPool & operator=(ThreadPool const &) = delete;
+
+    /**
+     * @brief Return the number of threads that work on a loop (the workers and the calling thread).
+     */
+    size_t size() const
+    {
+        return workers_.size() + 1;
+    }
+
+    /**
+     * @brief Call task(chunk_begin, chunk_end) for chunks of [begin, end) that have at most chunk_size elements and wait until all are done.
+     *
+     * The pool runs one loop at a time, parallel_for() must not be called from several threads at once.
+     */
+    void parallel_for(size_t begin, size_t end, size_t chunk_size, Task const & task);
+
+    /**
+     * @brief Return one worker less than the number of cores, the calling thread is the last one.
+     */
+    static size_t default_workers()
+    {
+        auto const n = std::thread::hardware_concurrency();
+        return n > 1 ? n-1 : 0;
+    }
+
+private:
+
+    /**
+     * @brief Take chunks of the current loop until none is left.
+     */
+    void run_chunks();
+
+    /**
+     * @brief The worker thread: Wait for a loop, work on it and report that it is done.
+     */
+    void work_loop();
+
+    std::vector<std::thread> workers_; // the worker threads
+    std::mutex mutex_; // guards the loop data and the counters below
+    std::condition_variable start_; // signals a new loop or the stop to the workers
+    std::condition_variable done_; // signals the calling thread that all workers are done
+    size_t generation_; // number of started loops
+    size_t busy_; // number of workers that did not finish the current loop
+    bool stop_; // set when the pool is destroyed
+
+    Task const * task_; // the task of the current loop
+    size_t begin_; // the range of the current loop
+    size_t end_;
+    size_t chunk_size_; // the size of the chunks of the current loop
+    std::atomic<size_t> next_chunk_; // the next chunk that is taken
+
+};
+
+ThreadPool::ThreadPool(size_t num_workers)
+    :
+      generation_(0),
+      busy_(0),
+      stop_(false),
+      task_(nullptr),
+      begin_(0),
+      end_(0),
+      chunk_size_(1),
+      next_chunk_(0)
+{
+    for (size_t i = 0; i < num_workers; ++i)
+        workers_.emplace_back(&ThreadPool::work_loop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    start_.notify_all();
+    for (auto & t : workers_)
+        t.join();
+}
+
+void ThreadPool::parallel_for(size_t begin, size_t end, size_t chunk_size, Task const & task)
+{
+    if (begin >= end)
+        return;
+    chunk_size = std::max(chunk_size, size_t(1));
+
+    // Small loops are not worth waking the workers.
+    if (workers_.empty() || end - begin <= chunk_size)
+    {
+        task(begin, end);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task_ = &task;
+        begin_ = begin;
+        end_ = end;
+        chunk_size_ = chunk_size;
+        next_chunk_.store(0, std::memory_order_relaxed);
+        busy_ = workers_.size();
+        ++generation_;
+    }
+    start_.notify_all();
+    run_chunks();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this](){ return busy_ == 0; });
+    task_ = nullptr;
+}
+
+void ThreadPool::run_chunks()
+{
+    auto const num_chunks = (end_ - begin_ + chunk_size_ - 1) / chunk_size_;
+    while (true)
+    {
+        auto const chunk = next_chunk_.fetch_add(1, std::memory_order_relaxed);
+        if (chunk >= num_chunks)
+            break;
+        auto const b = begin_ + chunk * chunk_size_;
+        (*task_)(b, std::min(b + chunk_size_, end_));
+    }
+}
+
+void ThreadPool::work_loop()
+{
+    size_t seen = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            start_.wait(lock, [&](){ return stop_ || generation_ != seen; });
+            if (stop_)
+                return;
+            seen = generation_;
+        }
+        run_chunks();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --busy_;
+        }
+        done_.notify_one();
+    }
+}
+
+
+
+#endif
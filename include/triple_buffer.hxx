@@ -0,0 +1,106 @@
+#ifndef TRIPLE_BUFFER_HXX
+#define TRIPLE_BUFFER_HXX
+
+#include <array>
+#include <atomic>
+
+
+
+/**
+ * @brief Lock-free triple buffer that hands complete values from one writer thread to one reader thread.
+ *
+ * The writer fills back() and calls publish(). The reader calls update() to grab the latest
+ * published value and then reads front(). Neither side ever waits for the other: the writer
+ * always has a free slot and the reader always sees a complete value. Values that are published
+ * faster than the reader grabs them are dropped.
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+
+    typedef T value_type;
+
+    TripleBuffer()
+        :
+          middle_(1),
+          back_(0),
+          front_(2)
+    {}
+
+    /**
+     * @brief Assign the given value to all slots.
+     * @note Only call this while neither the reader nor the writer is active.
+     */
+    void fill(value_type const & v)
+    {
+        for (auto & b : buffers_)
+            b = v;
+        middle_.store(1);
+        back_ = 0;
+        front_ = 2;
+    }
+
+    /**
+     * @brief Return the slot that is currently owned by the writer.
+     */
+    value_type & back()
+    {
+        return buffers_[back_];
+    }
+
+    /**
+     * @brief Make the back slot available to the reader and take over a free slot.
+     */
+    void publish()
+    {
+        back_ = middle_.exchange(back_ | fresh_bit, std::memory_order_acq_rel) & index_mask;
+    }
+
+    /**
+     * @brief Grab the latest published value. Returns false if nothing was published since the last call.
+     */
+    bool update()
+    {
+        if ((middle_.load(std::memory_order_relaxed) & fresh_bit) == 0)
+            return false;
+        front_ = middle_.exchange(front_, std::memory_order_acq_rel) & index_mask;
+        return true;
+    }
+
+    /**
+     * @brief Return whether a published value was not grabbed by the reader yet.
+     */
+    bool pending() const
+    {
+        return (middle_.load(std::memory_order_acquire) & fresh_bit) != 0;
+    }
+
+    /**
+     * @brief Return the slot that is currently owned by the reader.
+     */
+    value_type const & front() const
+    {
+        return buffers_[front_];
+    }
+
+    value_type & front()
+    {
+        return buffers_[front_];
+    }
+
+private:
+
+    static unsigned int const index_mask = 3;
+    static unsigned int const fresh_bit = 4;
+
+    std::array<value_type, 3> buffers_; // the three slots
+    std::atomic<unsigned int> middle_; // index of the shared slot, with fresh_bit set if it holds an unread value
+    unsigned int back_; // index of the writer slot
+    unsigned int front_; // index of the reader slot
+
+};
+
+
+
+#endif
@@ -0,0 +1,579 @@
+#ifndef USER_SEGMENTATION_HXX
+#define USER_SEGMENTATION_HXX
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+
+#include "platform_support.hxx"
+#ifdef OPENNI_FOUND
+#include <XnCppWrapper.h>
+#endif
+
+#include "ndarray.hxx"
+#include "utility.hxx"
+#include "roi.hxx"
+#include "thread_pool.hxx"
+
+namespace kin
+{
+
+/**
+ * @brief The SegmentationOptions struct selects when the depth is segmented and the thresholds of the UserSegmentation.
+ */
+struct SegmentationOptions
+{
+    /**
+     * @brief When the labels of the tracker are replaced by the segmentation of the depth.
+     */
+    enum Mode
+    {
+        Off, // only the tracker labels the users
+        Fallback, // segment the depth when the labels of the tracker show no user
+        Always // always segment the depth (the labels do not match the ids of the skeletons)
+    };
+
+    explicit SegmentationOptions(Mode mode = Off)
+        :
+          mode_(mode),
+          foreground_(150),
+          max_jump_(60),
+          confirm_frames_(3),
+          absorb_frames_(0),
+          min_size_(0.005f),
+          max_users_(6)
+    {}
+
+    bool enabled() const
+    {
+        return mode_ != Off;
+    }
+
+    Mode mode_; // when the depth is segmented
+    XnDepthPixel foreground_; // pixels that are this much (mm) in front of the background are foreground
+    XnDepthPixel max_jump_; // neighboring foreground pixels are connected if their depth differs by at most this (mm)
+    size_t confirm_frames_; // a farther background is learned after it was seen in this many frames in a row (at most 32767)
+    size_t absorb_frames_; // foreground that stays for this many frames becomes background (0: never, at most 32767)
+    float min_size_; // components smaller than this fraction of the frame are no users
+    size_t max_users_; // at most this many of the largest components are labelled (at most 255)
+};
+
+/**
+ * @brief The UserSegmentation class labels the users from the depth alone.
+ *
+ * A background model keeps the farthest depth that was confirmed for each pixel. Pixels in front of
+ * it are foreground, and neighboring foreground pixels of similar depth are connected. The
+ * components are labelled with a union-find in two passes: each thread labels a strip of rows on
+ * its own, then the labels are merged along the strip borders and resolved. The largest components
+ * become the users, a user keeps its label while it overlaps its component of the previous frame.
+ * There is a strip per thread of the pool that the owner passes in (e. g. the pool of the Sensor).
+ */
+class UserSegmentation
+{
+public:
+
+    explicit UserSegmentation(SegmentationOptions const & options = SegmentationOptions(), ThreadPool * pool = nullptr)
+        :
+          options_(options)
+    {
+        set_options(options);
+        set_pool(pool);
+    }
+
+    /**
+     * @brief Select other options. The background is learned anew.
+     */
+    void set_options(SegmentationOptions const & options);
+
+    SegmentationOptions const & options() const
+    {
+        return options_;
+    }
+
+    /**
+     * @brief Label a strip per thread of the given pool (nullptr: the calling thread labels a single strip).
+     *
+     * The pool is not owned, it must live until it is replaced or the segmentation is destroyed.
+     */
+    void set_pool(ThreadPool * pool)
+    {
+        pool_ = pool;
+        strips_.resize(pool ? pool->size() : 1);
+    }
+
+    /**
+     * @brief Learn the background from a new depth frame.
+     *
+     * Pixels that are labelled in labels (e. g. by the tracker) are not learned. Pass nullptr if
+     * there are no labels of this frame.
+     */
+    void learn(Array2D<XnDepthPixel> const & depth, Array2D<XnLabel> const * labels = nullptr);
+
+    /**
+     * @brief Label the users of the depth (1 to max_users_, 0: no user) and return their number.
+     */
+    size_t segment(Array2D<XnDepthPixel> const & depth, Array2D<XnLabel> & labels);
+
+    /**
+     * @brief Return the bounding box of the labels of the last segment() (see label_bounds()).
+     */
+    Roi const & bounds() const
+    {
+        return bounds_;
+    }
+
+    /**
+     * @brief Return the learned background depth (0: not seen yet).
+     */
+    Array2D<XnDepthPixel> const & background() const
+    {
+        return background_;
+    }
+
+    /**
+     * @brief Forget the background and the previous labels.
+     */
+    void reset()
+    {
+        background_.resize(0, 0);
+        previous_.resize(0, 0);
+    }
+
+private:
+
+    /**
+     * @brief A strip of rows that is labelled by one thread.
+     */
+    struct Strip
+    {
+        size_t y0_; // the first row
+        size_t y1_; // one past the last row
+        uint32_t first_label_; // the first provisional label of the strip
+        uint32_t end_label_; // one past the last provisional label that was used
+        std::vector<uint32_t> sizes_; // the pixels per component
+        std::vector<uint32_t> overlap_; // the pixels per user and previous label
+        Roi bounds_; // the bounding box of the labels
+    };
+
+    /**
+     * @brief Call f(begin, end) on the strips, using the pool if there is one.
+     */
+    void for_strips(ThreadPool::Task const & f);
+
+    /**
+     * @brief Return whether depth d in front of background b is foreground.
+     */
+    bool foreground(XnDepthPixel d, XnDepthPixel b) const
+    {
+        return d != 0 && b != 0 && d + options_.foreground_ < b;
+    }
+
+    /**
+     * @brief Return whether two foreground depths belong to the same component.
+     */
+    bool connected(XnDepthPixel a, XnDepthPixel b) const
+    {
+        return (a > b ? a - b : b - a) <= options_.max_jump_;
+    }
+
+    /**
+     * @brief Return the root of label l and halve the path to it.
+     */
+    uint32_t find(uint32_t l)
+    {
+        while (parent_[l] != l)
+        {
+            parent_[l] = parent_[parent_[l]];
+            l = parent_[l];
+        }
+        return l;
+    }
+
+    /**
+     * @brief Join the components of the labels a and b. The smaller root becomes the root.
+     */
+    void unite(uint32_t a, uint32_t b)
+    {
+        a = find(a);
+        b = find(b);
+        if (a < b)
+            parent_[b] = a;
+        else if (b < a)
+            parent_[a] = b;
+    }
+
+    /**
+     * @brief Label the foreground of a strip with provisional labels.
+     */
+    void label_strip(Strip & s, Array2D<XnDepthPixel> const & depth);
+
+    /**
+     * @brief Give the users the labels of the components they overlap most in the previous frame.
+     */
+    void match_labels(size_t num_users);
+
+    SegmentationOptions options_; // the options
+    ThreadPool * pool_; // the threads that label the strips (not owned, nullptr: the calling thread only)
+    std::vector<Strip> strips_; // the strips of rows
+    Array2D<XnDepthPixel> background_; // the farthest confirmed depth of each pixel
+    Array2D<int16_t> streak_; // frames in a row that the depth was farther (> 0) or in front (< 0) of the background
+    Array2D<uint32_t> provisional_; // the provisional labels, then the components, then the users
+    std::vector<uint32_t> parent_; // the union-find forest of the provisional labels, then their components
+    std::vector<uint32_t> user_; // the user index of each component (0: no user)
+    std::vector<XnLabel> user_label_; // the label of each user index
+    Array2D<XnLabel> previous_; // the labels of the previous segment()
+    Roi bounds_; // the bounding box of the labels
+
+};
+
+void UserSegmentation::set_options(SegmentationOptions const & options)
+{
+    if (options.confirm_frames_ > 32767 || options.absorb_frames_ > 32767)
+        throw std::runtime_error("UserSegmentation::set_options(): The frame counts must not exceed 32767.");
+    if (options.max_users_ == 0 || options.max_users_ > 255)
+        throw std::runtime_error("UserSegmentation::set_options(): The number of users must be in [1, 255].");
+    options_ = options;
+    reset();
+}
+
+void UserSegmentation::for_strips(ThreadPool::Task const & f)
+{
+    if (pool_)
+        pool_->parallel_for(0, strips_.size(), 1, f);
+    else
+        f(0, strips_.size());
+}
+
+void UserSegmentation::learn(Array2D<XnDepthPixel> const & depth, Array2D<XnLabel> const * labels)
+{
+    auto const w = depth.width();
+    auto const h = depth.height();
+    if (labels && (labels->width() != w || labels->height() != h))
+        throw std::runtime_error("UserSegmentation::learn(): Shape mismatch.");
+    if (background_.width() != w || background_.height() != h)
+    {
+        background_.resize(w, h);
+        streak_.resize(w, h);
+        std::fill(background_.begin(), background_.end(), 0);
+        std::fill(streak_.begin(), streak_.end(), 0);
+    }
+
+    auto const confirm = static_cast<int16_t>(std::max<size_t>(options_.confirm_frames_, 1));
+    auto const absorb = static_cast<int16_t>(options_.absorb_frames_);
+    auto const n = strips_.size();
+    for_strips([&](size_t begin, size_t end){
+        for (size_t i = h * begin / n * w, last = h * end / n * w; i < last; ++i)
+        {
+            auto const d = depth.data()[i];
+            auto & b = background_.data()[i];
+            auto & s = streak_.data()[i];
+            if (d == 0 || (labels && labels->data()[i] != 0))
+                continue;
+            if (b == 0)
+            {
+                b = d;
+                s = 0;
+            }
+            else if (d > b + options_.foreground_ / 2)
+            {
+                // Farther than the background: something moved away. Outliers do not last.
+                s = s > 0 ? s+1 : 1;
+                if (s >= confirm)
+                {
+                    b = d;
+                    s = 0;
+                }
+            }
+            else if (foreground(d, b))
+            {
+                s = s < 0 ? s-1 : -1;
+                if (absorb > 0 && -s >= absorb)
+                {
+                    b = d;
+                    s = 0;
+                }
+            }
+            else
+            {
+                s = 0;
+            }
+        }
+    });
+}
+
+void UserSegmentation::label_strip(Strip & s, Array2D<XnDepthPixel> const & depth)
+{
+    auto const w = depth.width();
+    auto next = s.first_label_;
+    for (size_t y = s.y0_; y < s.y1_; ++y)
+    {
+        auto const d = &depth(0, y);
+        auto const b = &background_(0, y);
+        auto const l = &provisional_(0, y);
+        auto const d_up = y > s.y0_ ? &depth(0, y-1) : nullptr;
+        auto const l_up = y > s.y0_ ? &provisional_(0, y-1) : nullptr;
+        for (size_t x = 0; x < w; ++x)
+        {
+            if (!foreground(d[x], b[x]))
+            {
+                l[x] = 0;
+                continue;
+            }
+            bool const left = x > 0 && l[x-1] != 0 && connected(d[x], d[x-1]);
+            bool const up = l_up && l_up[x] != 0 && connected(d[x], d_up[x]);
+            if (left)
+            {
+                l[x] = l[x-1];
+                if (up && l_up[x] != l[x])
+                    unite(l[x], l_up[x]);
+            }
+            else if (up)
+            {
+                l[x] = l_up[x];
+            }
+            else
+            {
+                parent_[next] = next;
+                l[x] = next++;
+            }
+        }
+    }
+    s.end_label_ = next;
+}
+
+size_t UserSegmentation::segment(Array2D<XnDepthPixel> const & depth, Array2D<XnLabel> & labels)
+{
+    auto const w = depth.width();
+    auto const h = depth.height();
+    if (labels.width() != w || labels.height() != h)
+        throw std::runtime_error("UserSegmentation::segment(): Shape mismatch.");
+    bounds_ = Roi();
+    if (background_.width() != w || background_.height() != h)
+    {
+        std::fill(labels.begin(), labels.end(), 0);
+        return 0;
+    }
+    if (provisional_.width() != w || provisional_.height() != h)
+    {
+        provisional_.resize(w, h);
+        parent_.resize(w * h + 1);
+    }
+    if (previous_.width() != w || previous_.height() != h)
+    {
+        previous_.resize(w, h);
+        std::fill(previous_.begin(), previous_.end(), 0);
+    }
+
+    // First pass: Each strip labels its rows with labels from its own range. A strip of rows
+    // starting at y0 has at most as many components as pixels, so y0 * w + 1 is a free first label.
+    auto const n = strips_.size();
+    for (size_t i = 0; i < n; ++i)
+    {
+        auto & s = strips_[i];
+        s.y0_ = h * i / n;
+        s.y1_ = h * (i+1) / n;
+        s.first_label_ = static_cast<uint32_t>(s.y0_ * w + 1);
+    }
+    for_strips([&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; ++i)
+            label_strip(strips_[i], depth);
+    });
+
+    // Join the components that touch across the strip borders.
+    for (size_t i = 1; i < n; ++i)
+    {
+        auto const y = strips_[i].y0_;
+        if (y == 0 || y >= h)
+            continue;
+        for (size_t x = 0; x < w; ++x)
+        {
+            auto const a = provisional_(x, y);
+            auto const b = provisional_(x, y-1);
+            if (a != 0 && b != 0 && connected(depth(x, y), depth(x, y-1)))
+                unite(a, b);
+        }
+    }
+
+    // Number the components. A parent is always a smaller label, so going up through the labels
+    // finds each root before its children. The parents are replaced by the component numbers.
+    uint32_t num_components = 0;
+    for (auto const & s : strips_)
+    {
+        for (auto l = s.first_label_; l < s.end_label_; ++l)
+        {
+            auto const p = parent_[l];
+            parent_[l] = p == l ? ++num_components : parent_[p];
+        }
+    }
+
+    // Second pass: Replace the labels by the components and count their pixels.
+    for_strips([&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; ++i)
+        {
+            auto & s = strips_[i];
+            s.sizes_.assign(num_components+1, 0);
+            for (auto it = &provisional_(0, s.y0_), last = it + (s.y1_ - s.y0_) * w; it != last; ++it)
+            {
+                if (*it != 0)
+                {
+                    *it = parent_[*it];
+                    ++s.sizes_[*it];
+                }
+            }
+        }
+    });
+
+    // The largest components that are large enough are the users.
+    auto const min_pixels = static_cast<uint32_t>(options_.min_size_ * w * h);
+    user_.assign(num_components+1, 0);
+    std::vector<std::pair<uint32_t, uint32_t> > candidates; // pixels and component
+    for (uint32_t c = 1; c <= num_components; ++c)
+    {
+        uint32_t size = 0;
+        for (auto const & s : strips_)
+            size += s.sizes_[c];
+        if (size >= min_pixels && size > 0)
+            candidates.emplace_back(size, c);
+    }
+    auto const num_users = std::min(candidates.size(), options_.max_users_);
+    std::partial_sort(candidates.begin(), candidates.begin() + num_users, candidates.end(),
+                      [](std::pair<uint32_t, uint32_t> const & a, std::pair<uint32_t, uint32_t> const & b){
+        return a.first > b.first;
+    });
+    for (size_t k = 0; k < num_users; ++k)
+        user_[candidates[k].second] = static_cast<uint32_t>(k+1);
+
+    // Third pass: Replace the components by the user indices and count the overlap with the previous labels.
+    auto const num_labels = options_.max_users_ + 1;
+    for_strips([&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; ++i)
+        {
+            auto & s = strips_[i];
+            s.overlap_.assign((num_users+1) * num_labels, 0);
+            auto const offset = s.y0_ * w;
+            for (size_t k = offset, last = s.y1_ * w; k < last; ++k)
+            {
+                auto & l = provisional_.data()[k];
+                if (l == 0)
+                    continue;
+                l = user_[l];
+                auto const p = previous_.data()[k];
+                if (l != 0 && p != 0 && p < num_labels)
+                    ++s.overlap_[l * num_labels + p];
+            }
+        }
+    });
+    match_labels(num_users);
+
+    // Write the labels and their bounding box.
+    for_strips([&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; ++i)
+        {
+            auto & s = strips_[i];
+            size_t x0 = w, y0 = h, x1 = 0, y1 = 0;
+            for (size_t y = s.y0_; y < s.y1_; ++y)
+            {
+                auto const in = &provisional_(0, y);
+                auto const out = &labels(0, y);
+                auto const prev = &previous_(0, y);
+                for (size_t x = 0; x < w; ++x)
+                {
+                    auto const l = user_label_[in[x]];
+                    out[x] = l;
+                    prev[x] = l;
+                    if (l != 0)
+                    {
+                        x0 = std::min(x0, x);
+                        x1 = std::max(x1, x+1);
+                        y0 = std::min(y0, y);
+                        y1 = y+1;
+                    }
+                }
+            }
+            s.bounds_ = x1 > 0 ? Roi(x0, y0, x1, y1) : Roi();
+        }
+    });
+    for (auto const & s : strips_)
+    {
+        if (s.bounds_.empty())
+            continue;
+        if (bounds_.empty())
+            bounds_ = s.bounds_;
+        else
+            bounds_ = Roi(std::min(bounds_.x0_, s.bounds_.x0_), std::min(bounds_.y0_, s.bounds_.y0_),
+                          std::max(bounds_.x1_, s.bounds_.x1_), std::max(bounds_.y1_, s.bounds_.y1_));
+    }
+    return num_users;
+}
+
+void UserSegmentation::match_labels(size_t num_users)
+{
+    // Sum the overlaps of the strips and assign the largest overlaps first.
+    auto const num_labels = options_.max_users_ + 1;
+    std::vector<std::pair<uint32_t, size_t> > overlaps; // pixels and user * num_labels + label
+    for (size_t u = 1; u <= num_users; ++u)
+    {
+        for (size_t l = 1; l < num_labels; ++l)
+        {
+            uint32_t sum = 0;
+            for (auto const & s : strips_)
+                sum += s.overlap_[u * num_labels + l];
+            if (sum > 0)
+                overlaps.emplace_back(sum, u * num_labels + l);
+        }
+    }
+    std::sort(overlaps.begin(), overlaps.end(), [](std::pair<uint32_t, size_t> const & a, std::pair<uint32_t, size_t> const & b){
+        return a.first > b.first;
+    });
+    user_label_.assign(num_users+1, 0);
+    std::vector<bool> taken(num_labels, false);
+    for (auto const & o : overlaps)
+    {
+        auto const u = o.second / num_labels;
+        auto const l = o.second % num_labels;
+        if (user_label_[u] == 0 && !taken[l])
+        {
+            user_label_[u] = static_cast<XnLabel>(l);
+            taken[l] = true;
+        }
+    }
+
+    // The new users get the smallest free labels.
+    size_t next = 1;
+    for (size_t u = 1; u <= num_users; ++u)
+    {
+        if (user_label_[u] != 0)
+            continue;
+        while (taken[next])
+            ++next;
+        user_label_[u] = static_cast<XnLabel>(next);
+        taken[next] = true;
+    }
+}
+
+/**
+ * @brief Parse a segmentation of the form "mode[,foreground]", where mode is off, fallback or always and foreground is in mm (see SegmentationOptions).
+ */
+SegmentationOptions parse_user_segmentation(std::string const & spec)
+{
+    auto const comma = spec.find(',');
+    auto const mode = spec.substr(0, comma);
+    SegmentationOptions options;
+    if (mode == "off")
+        options.mode_ = SegmentationOptions::Off;
+    else if (mode == "fallback")
+        options.mode_ = SegmentationOptions::Fallback;
+    else if (mode == "always")
+        options.mode_ = SegmentationOptions::Always;
+    else
+        throw std::runtime_error("parse_user_segmentation(): Unknown mode: " + mode);
+    if (comma != std::string::npos)
+        options.foreground_ = static_cast<XnDepthPixel>(std::stoul(spec.substr(comma+1)));
+    return options;
+}
+
+} // namespace kin
+
+#endif
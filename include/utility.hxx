@@ -5,11 +5,14 @@
 #include <numeric>
 #include <memory>
 #include <functional>
-#include <list>
+#include <array>
+#include <vector>
+#include <algorithm>
 #include <utility>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fstream>
+#include <cstdint>
 #ifdef _MSC_VER
 #include <direct.h>
 #endif
@@ -23,12 +26,20 @@
 
 #include "platform_support.hxx"
 #include "ndarray.hxx"
+#include "roi.hxx"
+#include "vecmath.hxx"
 
 
 #ifndef OPENNI_FOUND
 
+    typedef uint16_t XnUInt16;
     typedef uint32_t XnUInt32;
+    typedef uint64_t XnUInt64;
     typedef float XnFloat;
+    typedef XnFloat XnConfidence;
+    typedef XnUInt16 XnDepthPixel;
+    typedef XnUInt16 XnLabel;
+    typedef XnUInt32 XnUserID;
 
     typedef struct XnVector3D
     {
@@ -39,6 +50,34 @@
 
     typedef XnVector3D XnPoint3D;
 
+    typedef enum XnSkeletonJoint
+    {
+        XN_SKEL_HEAD = 1,
+        XN_SKEL_NECK = 2,
+        XN_SKEL_TORSO = 3,
+        XN_SKEL_WAIST = 4,
+        XN_SKEL_LEFT_COLLAR = 5,
+        XN_SKEL_LEFT_SHOULDER = 6,
+        XN_SKEL_LEFT_ELBOW = 7,
+        XN_SKEL_LEFT_WRIST = 8,
+        XN_SKEL_LEFT_HAND = 9,
+        XN_SKEL_LEFT_FINGERTIP = 10,
+        XN_SKEL_RIGHT_COLLAR = 11,
+        XN_SKEL_RIGHT_SHOULDER = 12,
+        XN_SKEL_RIGHT_ELBOW = 13,
+        XN_SKEL_RIGHT_WRIST = 14,
+        XN_SKEL_RIGHT_HAND = 15,
+        XN_SKEL_RIGHT_FINGERTIP = 16,
+        XN_SKEL_LEFT_HIP = 17,
+        XN_SKEL_LEFT_KNEE = 18,
+        XN_SKEL_LEFT_ANKLE = 19,
+        XN_SKEL_LEFT_FOOT = 20,
+        XN_SKEL_RIGHT_HIP = 21,
+        XN_SKEL_RIGHT_KNEE = 22,
+        XN_SKEL_RIGHT_ANKLE = 23,
+        XN_SKEL_RIGHT_FOOT = 24
+    } XnSkeletonJoint;
+
 #endif
 
 
@@ -167,23 +206,37 @@ private:
 };
 
 /**
- * @brief Convert the depth data to RGBA using a depth histogram.
+ * @brief Convert the depth data inside of roi to RGBA using a depth histogram of the region.
+ *
+ * The pixels outside of roi are set to opaque black. Only the pixels inside of dirty (the region
+ * of the previous call, or the whole image for the first call) are filled, and dirty is set to roi
+ * afterwards.
  */
 template <typename DEPTHARRAY, typename RGBAARRAY>
 void depth_to_rgba(
         DEPTHARRAY const & depth_data,
         XnUInt32 z_res,
-        RGBAARRAY & depth_rgba
+        RGBAARRAY & depth_rgba,
+        Roi const & roi,
+        Roi & dirty
 ){
     if (depth_data.width() != depth_rgba.width() || depth_data.height() != depth_rgba.height())
         throw std::runtime_error("depth_to_rgba(): Shape mismatch.");
+    if (roi.x1_ > depth_data.width() || roi.y1_ > depth_data.height())
+        throw std::runtime_error("depth_to_rgba(): ROI out of range.");
+
+    typedef typename RGBAARRAY::value_type RGBA;
+    fill_outside(depth_rgba, roi, RGBA{0, 0, 0, 255}, dirty);
+    dirty = roi;
+    if (roi.empty())
+        return;
 
     // Create the accumulative depth histogram.
     std::vector<double> histo(z_res, 0.0);
     size_t num_points = 0;
-    for (size_t y = 0; y < depth_data.height(); ++y)
+    for (size_t y = roi.y0_; y < roi.y1_; ++y)
     {
-        for (size_t x = 0; x < depth_data.width(); ++x)
+        for (size_t x = roi.x0_; x < roi.x1_; ++x)
         {
             if (depth_data(x, y) != 0)
             {
@@ -205,9 +258,9 @@ void depth_to_rgba(
     }
 
     // Convert the depth data to RGBA.
-    for (size_t y = 0; y < depth_data.height(); ++y)
+    for (size_t y = roi.y0_; y < roi.y1_; ++y)
     {
-        for (size_t x = 0; x < depth_data.width(); ++x)
+        for (size_t x = roi.x0_; x < roi.x1_; ++x)
         {
             auto const v = histo[depth_data(x, y)];
             depth_rgba(x, y).r = v;
@@ -219,15 +272,36 @@ void depth_to_rgba(
 }
 
 /**
- * @brief Convert the user labels to RGBA using a (hardcoded) colormap.
+ * @brief Convert the depth data to RGBA using a depth histogram.
+ */
+template <typename DEPTHARRAY, typename RGBAARRAY>
+void depth_to_rgba(
+        DEPTHARRAY const & depth_data,
+        XnUInt32 z_res,
+        RGBAARRAY & depth_rgba
+){
+    auto const roi = Roi::full(depth_data.width(), depth_data.height());
+    Roi dirty;
+    depth_to_rgba(depth_data, z_res, depth_rgba, roi, dirty);
+}
+
+/**
+ * @brief Convert the user labels inside of roi to RGBA using a (hardcoded) colormap. The colors repeat for more than six users.
+ *
+ * The pixels outside of roi are set to transparent, see the ROI version of depth_to_rgba() for
+ * the meaning of dirty.
  */
 template <typename USERARRAY, typename RGBAARRAY>
 void user_to_rgba(
         USERARRAY const & user_data,
-        RGBAARRAY & user_rgba
+        RGBAARRAY & user_rgba,
+        Roi const & roi,
+        Roi & dirty
 ){
     if (user_data.width() != user_rgba.width() || user_data.height() != user_rgba.height())
         throw std::runtime_error("user_to_rgba(): Shape mismatch.");
+    if (roi.x1_ > user_data.width() || roi.y1_ > user_data.height())
+        throw std::runtime_error("user_to_rgba(): ROI out of range.");
 
     typedef typename RGBAARRAY::value_type RGBA;
 
@@ -241,9 +315,113 @@ void user_to_rgba(
         {0, 255, 255, 255}
     };
 
-    for (size_t y = 0; y < user_data.height(); ++y)
-        for (size_t x = 0; x < user_data.width(); ++x)
-            user_rgba(x, y) = colors[user_data(x, y)];
+    fill_outside(user_rgba, roi, colors[0], dirty);
+    dirty = roi;
+
+    auto const num_colors = colors.size() - 1;
+    for (size_t y = roi.y0_; y < roi.y1_; ++y)
+    {
+        for (size_t x = roi.x0_; x < roi.x1_; ++x)
+        {
+            auto const label = user_data(x, y);
+            if (label == 0)
+                user_rgba(x, y) = colors[0];
+            else
+                user_rgba(x, y) = colors[1 + (label-1) % num_colors];
+        }
+    }
+}
+
+/**
+ * @brief Convert the user labels to RGBA using a (hardcoded) colormap. The colors repeat for more than six users.
+ */
+template <typename USERARRAY, typename RGBAARRAY>
+void user_to_rgba(
+        USERARRAY const & user_data,
+        RGBAARRAY & user_rgba
+){
+    auto const roi = Roi::full(user_data.width(), user_data.height());
+    Roi dirty;
+    user_to_rgba(user_data, user_rgba, roi, dirty);
+}
+
+/**
+ * @brief Convert the pixels of a user (0: all users) to an anti-aliased silhouette in the given color.
+ *
+ * A pixel belongs to the user if it has the label and a valid depth. The alpha of each pixel is the
+ * share of the user in its 3x3 neighbourhood (binomial weights), scaled by the alpha of the color,
+ * so the edges are smooth and single noisy pixels are faint. The mask rows are computed once and
+ * kept in a rolling buffer of three rows, so the image is read in a single pass.
+ *
+ * Only the region roi grown by one pixel is converted, the labels outside of roi must be 0 (see
+ * Sensor::roi()). The pixels of the previous region (dirty) that lie outside are made transparent.
+ */
+template <typename USERARRAY, typename DEPTHARRAY, typename RGBAARRAY>
+void silhouette_to_rgba(
+        USERARRAY const & user_data,
+        DEPTHARRAY const & depth_data,
+        XnLabel user,
+        sf::Color const & color,
+        RGBAARRAY & rgba,
+        Roi const & roi,
+        Roi & dirty
+){
+    auto const w = user_data.width();
+    auto const h = user_data.height();
+    if (depth_data.width() != w || depth_data.height() != h || rgba.width() != w || rgba.height() != h)
+        throw std::runtime_error("silhouette_to_rgba(): Shape mismatch.");
+    if (roi.x1_ > w || roi.y1_ > h)
+        throw std::runtime_error("silhouette_to_rgba(): ROI out of range.");
+
+    typedef typename RGBAARRAY::value_type RGBA;
+    auto const region = roi.expanded(1, w, h);
+    fill_outside(rgba, region, RGBA{color.r, color.g, color.b, 0}, dirty);
+    dirty = region;
+    if (region.empty())
+        return;
+
+    // The rows of the mask with a border of one pixel. Rows and columns outside of the region are empty.
+    auto const rw = region.width();
+    std::vector<unsigned int> rows(3 * (rw+2), 0);
+    auto prev = &rows[0];
+    auto cur = &rows[rw+2];
+    auto next = &rows[2*(rw+2)];
+    auto const mask_row = [&](size_t y, unsigned int * m){
+        for (size_t i = 0; i < rw; ++i)
+        {
+            auto const label = user_data(region.x0_+i, y);
+            m[i+1] = label != 0 && (user == 0 || label == user) && depth_data(region.x0_+i, y) != 0;
+        }
+    };
+
+    mask_row(region.y0_, cur);
+    for (size_t y = region.y0_; y < region.y1_; ++y)
+    {
+        if (y+1 < region.y1_)
+            mask_row(y+1, next);
+        else
+            std::fill(next, next+rw+2, 0u);
+
+        // Weight the rows with 1 2 1, then the columns with 1 2 1. The weights sum up to 16.
+        auto const column = [&](size_t i){
+            return prev[i] + 2*cur[i] + next[i];
+        };
+        auto left = column(0);
+        auto center = column(1);
+        for (size_t i = 0; i < rw; ++i)
+        {
+            auto const right = column(i+2);
+            auto const sum = left + 2*center + right;
+            rgba(region.x0_+i, y) = RGBA{color.r, color.g, color.b, static_cast<sf::Uint8>(sum * color.a / 16)};
+            left = center;
+            center = right;
+        }
+
+        auto const tmp = prev;
+        prev = cur;
+        cur = next;
+        next = tmp;
+    }
 }
 
 /**
@@ -320,12 +498,32 @@ void insert_line_breaks(sf::Text & str, double max_width)
     str.setString(result);
 }
 
+/**
+ * @brief Convert an OpenNI vector to a Vec3.
+ */
+Vec3 to_vec3(XnVector3D const & v)
+{
+    return Vec3(v.X, v.Y, v.Z);
+}
+
+/**
+ * @brief Convert a Vec3 to an OpenNI vector.
+ */
+XnVector3D to_xn(Vec3 const & v)
+{
+    XnVector3D r;
+    r.X = v.x_;
+    r.Y = v.y_;
+    r.Z = v.z_;
+    return r;
+}
+
 /**
  * @brief Return the length of the vector.
  */
 double length(XnVector3D const & a)
 {
-    return std::sqrt(a.X*a.X + a.Y*a.Y + a.Z*a.Z);
+    return length(to_vec3(a));
 }
 
 /**
@@ -333,10 +531,7 @@ double length(XnVector3D const & a)
  */
 XnVector3D & operator-=(XnVector3D & a, XnVector3D const & b)
 {
-    a.X -= b.X;
-    a.Y -= b.Y;
-    a.Z -= b.Z;
-    return a;
+    return a = to_xn(to_vec3(a) - to_vec3(b));
 }
 
 /**
@@ -352,10 +547,7 @@ XnVector3D operator-(XnVector3D a, XnVector3D const & b)
  */
 XnVector3D & operator+=(XnVector3D & a, XnVector3D const & b)
 {
-    a.X += b.X;
-    a.Y += b.Y;
-    a.Z += b.Z;
-    return a;
+    return a = to_xn(to_vec3(a) + to_vec3(b));
 }
 
 /**
@@ -371,10 +563,7 @@ XnVector3D operator+(XnVector3D a, XnVector3D const & b)
  */
 XnVector3D & operator/=(XnVector3D & a, float b)
 {
-    a.X /= b;
-    a.Y /= b;
-    a.Z /= b;
-    return a;
+    return a = to_xn(to_vec3(a) / b);
 }
 
 /**
@@ -385,6 +574,30 @@ XnVector3D operator/(XnVector3D a, float b)
     return a /= b;
 }
 
+/**
+ * @brief operator*= for vectors.
+ */
+XnVector3D & operator*=(XnVector3D & a, float b)
+{
+    return a = to_xn(to_vec3(a) * b);
+}
+
+/**
+ * @brief operator* for vectors.
+ */
+XnVector3D operator*(XnVector3D a, float b)
+{
+    return a *= b;
+}
+
+/**
+ * @brief operator* for vectors.
+ */
+XnVector3D operator*(float a, XnVector3D b)
+{
+    return b *= a;
+}
+
 /**
  * @brief Return true if the given string is an existing directory.
  */
@@ -427,6 +640,12 @@ bool file_exist(std::string const & f)
 
 /**
  * @brief A detector for kinect clicks.
+ *
+ * A click is a movement of at least threshold_ into the positive direction (y or z) within
+ * max_delay_ seconds. The movement of the window is the sum of all steps that reach a new maximum,
+ * which is the maximum of the window minus its first position. The positions are kept in a fixed
+ * ring buffer together with a monotone queue of the window maxima, so update() takes constant
+ * (amortized) time and never allocates.
  */
 class ClickDetector
 {
@@ -438,34 +657,29 @@ public:
           use_y_(use_y),
           max_delay_(0.1f),
           threshold_(0.4f),
+          begin_(0),
+          end_(0),
+          max_begin_(0),
+          max_end_(0),
           elapsed_time_(0.0f),
           clicked_(false)
     {}
 
     void update(float p_elapsed_time, XnPoint3D point)
     {
-        // Update the elapsed time and add the new point to the queue.
+        // Update the elapsed time and add the new point to the window. If the ring buffer is full, the
+        // oldest point is dropped (this takes more than 64 updates within max_delay_).
         elapsed_time_ += p_elapsed_time;
-        if (use_y_)
-            positions_.emplace_back(elapsed_time_, point.Y);
-        else
-            positions_.emplace_back(elapsed_time_, point.Z);
+        if (end_ - begin_ == capacity)
+            pop_front();
+        push_back(elapsed_time_, use_y_ ? point.Y : point.Z);
 
         // Remove all points that are too old.
-        while (!positions_.empty() && positions_.front().first+max_delay_ < elapsed_time_)
-            positions_.pop_front();
+        while (positions_[begin_ % capacity].first+max_delay_ < elapsed_time_)
+            pop_front();
 
-        // Check if enough movement happened
-        float sum = 0.0;
-        float prev = positions_.front().second;
-        for (auto const & p : positions_)
-        {
-            if (p.second > prev)
-            {
-                sum += std::abs(p.second - prev);
-                prev = p.second;
-            }
-        }
+        // Check if enough movement happened.
+        float const sum = positions_[maxima_[max_begin_ % capacity] % capacity].second - positions_[begin_ % capacity].second;
 
         if (clicked_)
         {
@@ -489,19 +703,60 @@ public:
 
     void reset()
     {
-        positions_.clear();
+        begin_ = 0;
+        end_ = 0;
+        max_begin_ = 0;
+        max_end_ = 0;
         elapsed_time_ = 0;
         clicked_ = false;
     }
 
+    /**
+     * @brief Return whether the last click is still in progress.
+     */
+    bool clicked() const
+    {
+        return clicked_;
+    }
+
     std::function<void()> handle_click_;
     bool use_y_;
 
 private:
 
-    float const max_delay_;
-    float const threshold_;
-    std::list<std::pair<float, float> > positions_; // contains the pairs (timestamp, click position)
+    static size_t const capacity = 64; // the size of the ring buffers
+
+    /**
+     * @brief Append a point. Remove the maxima that are not larger, they can not be the maximum of a later window.
+     */
+    void push_back(float time, float value)
+    {
+        positions_[end_ % capacity] = std::make_pair(time, value);
+        while (max_end_ != max_begin_ && positions_[maxima_[(max_end_-1) % capacity] % capacity].second <= value)
+            --max_end_;
+        maxima_[max_end_ % capacity] = end_;
+        ++max_end_;
+        ++end_;
+    }
+
+    /**
+     * @brief Remove the first point of the window.
+     */
+    void pop_front()
+    {
+        if (maxima_[max_begin_ % capacity] == begin_)
+            ++max_begin_;
+        ++begin_;
+    }
+
+    float max_delay_;
+    float threshold_;
+    std::array<std::pair<float, float>, capacity> positions_; // ring buffer with the pairs (timestamp, click position)
+    std::array<size_t, capacity> maxima_; // ring buffer with the points whose position is larger than all later ones in the window
+    size_t begin_; // the first point of the window
+    size_t end_; // one past the last point of the window
+    size_t max_begin_; // the first entry of maxima_ (the point with the maximum position)
+    size_t max_end_; // one past the last entry of maxima_
     float elapsed_time_;
     bool clicked_;
 
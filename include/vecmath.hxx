@@ -0,0 +1,292 @@
+#ifndef VECMATH_HXX
+#define VECMATH_HXX
+
+#include <cmath>
+#include <cstddef>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+
+/**
+ * @brief A 3D vector of floats.
+ *
+ * The vector is padded to 16 bytes, so it fits into one SSE register. All operations except the
+ * length are constexpr, so vectors and matrices can be used in constant expressions.
+ */
+struct alignas(16) Vec3
+{
+    constexpr Vec3()
+        :
+          x_(0),
+          y_(0),
+          z_(0),
+          w_(0)
+    {}
+
+    constexpr Vec3(float x, float y, float z)
+        :
+          x_(x),
+          y_(y),
+          z_(z),
+          w_(0)
+    {}
+
+    /**
+     * @brief Return the i-th component (0: x, 1: y, 2: z).
+     */
+    constexpr float operator[](size_t i) const
+    {
+        return i == 0 ? x_ : i == 1 ? y_ : z_;
+    }
+
+    float x_;
+    float y_;
+    float z_;
+    float w_; // padding, always 0
+};
+
+constexpr Vec3 operator+(Vec3 const & a, Vec3 const & b)
+{
+    return Vec3(a.x_ + b.x_, a.y_ + b.y_, a.z_ + b.z_);
+}
+
+constexpr Vec3 operator-(Vec3 const & a, Vec3 const & b)
+{
+    return Vec3(a.x_ - b.x_, a.y_ - b.y_, a.z_ - b.z_);
+}
+
+constexpr Vec3 operator-(Vec3 const & a)
+{
+    return Vec3(-a.x_, -a.y_, -a.z_);
+}
+
+constexpr Vec3 operator*(Vec3 const & a, float s)
+{
+    return Vec3(a.x_ * s, a.y_ * s, a.z_ * s);
+}
+
+constexpr Vec3 operator*(float s, Vec3 const & a)
+{
+    return Vec3(s * a.x_, s * a.y_, s * a.z_);
+}
+
+constexpr Vec3 operator/(Vec3 const & a, float s)
+{
+    return Vec3(a.x_ / s, a.y_ / s, a.z_ / s);
+}
+
+constexpr bool operator==(Vec3 const & a, Vec3 const & b)
+{
+    return a.x_ == b.x_ && a.y_ == b.y_ && a.z_ == b.z_;
+}
+
+constexpr bool operator!=(Vec3 const & a, Vec3 const & b)
+{
+    return !(a == b);
+}
+
+constexpr float dot(Vec3 const & a, Vec3 const & b)
+{
+    return a.x_*b.x_ + a.y_*b.y_ + a.z_*b.z_;
+}
+
+constexpr Vec3 cross(Vec3 const & a, Vec3 const & b)
+{
+    return Vec3(a.y_*b.z_ - a.z_*b.y_, a.z_*b.x_ - a.x_*b.z_, a.x_*b.y_ - a.y_*b.x_);
+}
+
+inline float length(Vec3 const & a)
+{
+    return std::sqrt(dot(a, a));
+}
+
+/**
+ * @brief A 3x3 matrix of floats, stored as three padded columns.
+ *
+ * The constructor takes the elements row by row, like they are written down. A matrix times a
+ * vector is the sum of the columns weighted by the vector components.
+ */
+struct Mat3
+{
+    /**
+     * @brief Create the identity.
+     */
+    constexpr Mat3()
+        :
+          c0_(1, 0, 0),
+          c1_(0, 1, 0),
+          c2_(0, 0, 1)
+    {}
+
+    /**
+     * @brief Create the matrix with the given elements (row major).
+     */
+    constexpr Mat3(
+            float a00, float a01, float a02,
+            float a10, float a11, float a12,
+            float a20, float a21, float a22
+    )
+        :
+          c0_(a00, a10, a20),
+          c1_(a01, a11, a21),
+          c2_(a02, a12, a22)
+    {}
+
+    /**
+     * @brief Create the matrix with the given columns.
+     */
+    constexpr Mat3(Vec3 const & c0, Vec3 const & c1, Vec3 const & c2)
+        :
+          c0_(c0),
+          c1_(c1),
+          c2_(c2)
+    {}
+
+    /**
+     * @brief Return the element in the given row and column.
+     */
+    constexpr float operator()(size_t row, size_t col) const
+    {
+        return col == 0 ? c0_[row] : col == 1 ? c1_[row] : c2_[row];
+    }
+
+    /**
+     * @brief Return the column i.
+     */
+    constexpr Vec3 col(size_t i) const
+    {
+        return i == 0 ? c0_ : i == 1 ? c1_ : c2_;
+    }
+
+    /**
+     * @brief Return the row i.
+     */
+    constexpr Vec3 row(size_t i) const
+    {
+        return Vec3(c0_[i], c1_[i], c2_[i]);
+    }
+
+    constexpr Mat3 transposed() const
+    {
+        return Mat3(row(0), row(1), row(2));
+    }
+
+    constexpr float determinant() const
+    {
+        return dot(c0_, cross(c1_, c2_));
+    }
+
+    /**
+     * @brief Return the inverse. A singular matrix gives the identity, like sf::Transform::getInverse().
+     */
+    Mat3 inverse() const;
+
+    Vec3 c0_; // the columns
+    Vec3 c1_;
+    Vec3 c2_;
+};
+
+constexpr Vec3 operator*(Mat3 const & m, Vec3 const & v)
+{
+    return m.c0_ * v.x_ + m.c1_ * v.y_ + m.c2_ * v.z_;
+}
+
+constexpr Mat3 operator*(Mat3 const & a, Mat3 const & b)
+{
+    return Mat3(a * b.c0_, a * b.c1_, a * b.c2_);
+}
+
+constexpr Mat3 operator*(Mat3 const & m, float s)
+{
+    return Mat3(m.c0_ * s, m.c1_ * s, m.c2_ * s);
+}
+
+constexpr bool operator==(Mat3 const & a, Mat3 const & b)
+{
+    return a.c0_ == b.c0_ && a.c1_ == b.c1_ && a.c2_ == b.c2_;
+}
+
+Mat3 Mat3::inverse() const
+{
+    // The rows of the inverse are the cross products of the columns, divided by the determinant.
+    auto const det = determinant();
+    if (det == 0)
+        return Mat3();
+    return Mat3(cross(c1_, c2_), cross(c2_, c0_), cross(c0_, c1_)).transposed() * (1.0f / det);
+}
+
+namespace vecmath
+{
+
+#ifdef __SSE2__
+/**
+ * @brief Store (x0 x1 x2 x3), (y0 ...), (z0 ...) as the packed points x0 y0 z0 x1 y1 z1 ... (12 floats).
+ */
+inline void store_xyz(__m128 x, __m128 y, __m128 z, float * out)
+{
+    auto const xy_lo = _mm_unpacklo_ps(x, y); // x0 y0 x1 y1
+    auto const xy_hi = _mm_unpackhi_ps(x, y); // x2 y2 x3 y3
+    auto const zx_0 = _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)); // z0 z0 x1 x1
+    auto const yz_1 = _mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)); // y1 y1 z1 z1
+    auto const zx_2 = _mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)); // z2 z2 x3 x3
+    auto const yz_3 = _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)); // y3 y3 z3 z3
+    _mm_storeu_ps(out, _mm_shuffle_ps(xy_lo, zx_0, _MM_SHUFFLE(2, 0, 1, 0)));
+    _mm_storeu_ps(out + 4, _mm_shuffle_ps(yz_1, xy_hi, _MM_SHUFFLE(1, 0, 2, 0)));
+    _mm_storeu_ps(out + 8, _mm_shuffle_ps(zx_2, yz_3, _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+/**
+ * @brief Load the packed points x0 y0 z0 x1 ... (12 floats) as (x0 x1 x2 x3), (y0 ...), (z0 ...).
+ */
+inline void load_xyz(float const * in, __m128 & x, __m128 & y, __m128 & z)
+{
+    auto const a = _mm_loadu_ps(in); // x0 y0 z0 x1
+    auto const b = _mm_loadu_ps(in + 4); // y1 z1 x2 y2
+    auto const c = _mm_loadu_ps(in + 8); // z2 x3 y3 z3
+    x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+    y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+    z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), c, _MM_SHUFFLE(3, 0, 2, 0));
+}
+#endif
+
+} // namespace vecmath
+
+/**
+ * @brief Compute out = m * in + t for n packed points (x0 y0 z0 x1 ...). in and out may be the same.
+ *
+ * With SSE2, four points are transformed at once. Both paths compute the same sums in the same
+ * order, so the results do not depend on the alignment or on n.
+ */
+inline void transform_points(Mat3 const & m, Vec3 const & t, float const * in, size_t n, float * out)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    auto const m00 = _mm_set1_ps(m.c0_.x_), m01 = _mm_set1_ps(m.c1_.x_), m02 = _mm_set1_ps(m.c2_.x_);
+    auto const m10 = _mm_set1_ps(m.c0_.y_), m11 = _mm_set1_ps(m.c1_.y_), m12 = _mm_set1_ps(m.c2_.y_);
+    auto const m20 = _mm_set1_ps(m.c0_.z_), m21 = _mm_set1_ps(m.c1_.z_), m22 = _mm_set1_ps(m.c2_.z_);
+    auto const tx = _mm_set1_ps(t.x_), ty = _mm_set1_ps(t.y_), tz = _mm_set1_ps(t.z_);
+    for (; i+4 <= n; i += 4)
+    {
+        __m128 x, y, z;
+        vecmath::load_xyz(in + 3*i, x, y, z);
+        auto const ox = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, x), _mm_mul_ps(m01, y)), _mm_mul_ps(m02, z)), tx);
+        auto const oy = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m10, x), _mm_mul_ps(m11, y)), _mm_mul_ps(m12, z)), ty);
+        auto const oz = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m20, x), _mm_mul_ps(m21, y)), _mm_mul_ps(m22, z)), tz);
+        vecmath::store_xyz(ox, oy, oz, out + 3*i);
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        auto const p = m * Vec3(in[3*i], in[3*i+1], in[3*i+2]) + t;
+        out[3*i] = p.x_;
+        out[3*i+1] = p.y_;
+        out[3*i+2] = p.z_;
+    }
+}
+
+
+
+#endif
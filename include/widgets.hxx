@@ -956,6 +956,115 @@ private:
 
 };
 
+/**
+ * @brief A widget that shows the anti-aliased silhouette of a user (see silhouette_to_rgba()).
+ *
+ * The silhouette is kept in a streaming texture: set_silhouette() converts the labels and uploads
+ * the changed rows once per label frame, render_impl() only draws the texture.
+ */
+class SilhouetteWidget : public Widget
+{
+public:
+
+    template <typename... Args>
+    SilhouetteWidget(
+            sf::Color const & color,
+            Args&& ... args
+    )
+        :
+          Widget(args...),
+          color_(color)
+    {
+        hoverable_ = false;
+    }
+
+    /**
+     * @brief Show the given user (0: all users) of a new label frame. Only the pixels inside of roi are converted.
+     */
+    template <typename USERARRAY, typename DEPTHARRAY>
+    void set_silhouette(
+            USERARRAY const & user_data,
+            DEPTHARRAY const & depth_data,
+            XnLabel user,
+            Roi const & roi
+    );
+
+    /**
+     * @brief Remove the silhouette.
+     */
+    void clear_silhouette();
+
+    sf::Color color_; // the color and the opacity of the silhouette
+
+protected:
+
+    /**
+     * @brief Render the texture.
+     */
+    void render_impl(sf::RenderTarget & target);
+
+private:
+
+    /**
+     * @brief Upload the rows of the given region. The rows are contiguous in rgba_, the columns are not.
+     */
+    void upload(Roi const & rows);
+
+    Array2D<sf::Color> rgba_; // the silhouette
+    sf::Texture texture_; // the streaming texture with the silhouette
+    Roi dirty_; // the region that was converted last
+
+};
+
+template <typename USERARRAY, typename DEPTHARRAY>
+void SilhouetteWidget::set_silhouette(
+        USERARRAY const & user_data,
+        DEPTHARRAY const & depth_data,
+        XnLabel user,
+        Roi const & roi
+){
+    auto const w = user_data.width();
+    auto const h = user_data.height();
+    if (rgba_.width() != w || rgba_.height() != h)
+    {
+        // The whole new texture is cleared and uploaded.
+        rgba_.resize(w, h);
+        texture_.create(w, h);
+        dirty_ = Roi::full(w, h);
+    }
+    auto const previous = dirty_;
+    silhouette_to_rgba(user_data, depth_data, user, color_, rgba_, roi, dirty_);
+    upload(previous.united(dirty_));
+}
+
+void SilhouetteWidget::clear_silhouette()
+{
+    if (rgba_.width() == 0)
+        return;
+    auto const previous = dirty_;
+    fill_outside(rgba_, Roi(), sf::Color(color_.r, color_.g, color_.b, 0), dirty_);
+    dirty_ = Roi();
+    upload(previous);
+}
+
+void SilhouetteWidget::upload(Roi const & rows)
+{
+    if (rows.empty())
+        return;
+    auto const w = static_cast<unsigned int>(rgba_.width());
+    texture_.update(&rgba_(0, rows.y0_).r, w, static_cast<unsigned int>(rows.height()), 0, static_cast<unsigned int>(rows.y0_));
+}
+
+void SilhouetteWidget::render_impl(sf::RenderTarget & target)
+{
+    if (rgba_.width() == 0)
+        return;
+    sf::Sprite spr(texture_);
+    spr.setPosition(static_cast<float>(render_rect_.left), static_cast<float>(render_rect_.top));
+    spr.setScale(render_rect_.width / static_cast<float>(rgba_.width()), render_rect_.height / static_cast<float>(rgba_.height()));
+    target.draw(spr);
+}
+
 /**
  * @brief A widget for displaying text.
  */
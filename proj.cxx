@@ -2,14 +2,16 @@
 #include <stdexcept>
 #include <cstdlib>
 #include <string>
+#include <algorithm>
 
 #include <SFML/Graphics.hpp>
 
 #include "menu_overlay.hxx"
+#include "gestures.hxx"
 #include "utility.hxx"
 #include "widgets.hxx"
 #include "options.hxx"
-#include "kinect.hxx"
+#include "sensors.hxx"
 
 
 class DrawOptions
@@ -20,13 +22,17 @@ public:
             bool draw_fps = false,
             bool draw_users = true,
             bool draw_joints = true,
-            bool draw_menu = false
+            bool draw_menu = false,
+            bool roi_only = true,
+            size_t preview_level = 1
     )   :
           draw_depth_(draw_depth),
           draw_fps_(draw_fps),
           draw_users_(draw_users),
           draw_joints_(draw_joints),
-          draw_menu_(draw_menu)
+          draw_menu_(draw_menu),
+          roi_only_(roi_only),
+          preview_level_(preview_level)
     {}
 
     bool draw_depth() const
@@ -89,12 +95,32 @@ public:
         draw_menu_ = draw_menu;
     }
 
+    bool roi_only() const
+    {
+        return roi_only_;
+    }
+    void set_roi_only(bool roi_only)
+    {
+        roi_only_ = roi_only;
+    }
+
+    size_t preview_level() const
+    {
+        return preview_level_;
+    }
+    void set_preview_level(size_t preview_level)
+    {
+        preview_level_ = preview_level;
+    }
+
 private:
     bool draw_depth_;
     bool draw_fps_;
     bool draw_users_;
     bool draw_joints_;
     bool draw_menu_;
+    bool roi_only_; // only convert the pixels around the users
+    size_t preview_level_; // the depth pyramid level of the depth preview (0: full resolution)
 };
 
 
@@ -103,8 +129,8 @@ int main(int argc, char** argv)
     using namespace std;
     using namespace kin;
 
-    // Read the xml file from command line.
-    if (argc != 2)
+    // Read the xml file from command line. The remaining arguments select the sensor (see open_sensor()).
+    if (argc < 2)
         throw runtime_error("Wrong number of arguments.");
     string xml_filename = argv[1];
 
@@ -125,7 +151,8 @@ int main(int argc, char** argv)
     }
 
     // Create the kinect sensor.
-    kin::KinectSensor k;
+    auto sensor = kin::open_sensor(argc, argv);
+    auto & k = *sensor;
     double const SCALE_X = WIDTH / (double) k.x_res();
     double const SCALE_Y = HEIGHT / (double) k.y_res();
 
@@ -152,6 +179,20 @@ int main(int argc, char** argv)
         clicked_item = true;
     };
 
+    // Swipe up or down to scroll the menu. The gestures are recognized from the hand samples of the sensor.
+    auto input = k.open_input_queue();
+    GestureEngine gestures;
+    gestures.handle_gesture_ = [&](Event const & ev)
+    {
+        auto const & g = ev.gesture_;
+        if (!draw_opts.draw_menu())
+            return;
+        if (g.gesture_ == Event::GestureEvent::SwipeUp)
+            overlay.fling(-g.value_);
+        else if (g.gesture_ == Event::GestureEvent::SwipeDown)
+            overlay.fling(g.value_);
+    };
+
     // Measure the FPS.
     FPS fps_measure(1.0f);
     sf::Text fps_text;
@@ -172,6 +213,10 @@ int main(int argc, char** argv)
     sf::Sprite user_sprite(user_texture);
     user_sprite.setScale(SCALE_X, SCALE_Y);
 
+    // The regions that were converted last, so only those pixels are cleared when the ROI moves.
+    auto depth_dirty = Roi::full(k.x_res(), k.y_res());
+    auto user_dirty = Roi::full(k.x_res(), k.y_res());
+
     // Create the texture for the user joints.
     sf::Image joint_texture;
     joint_texture.create(3, 3, sf::Color(255, 255, 255, 255));
@@ -219,6 +264,10 @@ int main(int argc, char** argv)
                         draw_opts.set_draw_joints(!draw_opts.draw_joints());
                     if (tolower(event.text.unicode) == 'm')
                         draw_opts.set_draw_menu(!draw_opts.draw_menu());
+                    if (tolower(event.text.unicode) == 'r')
+                        draw_opts.set_roi_only(!draw_opts.roi_only());
+                    if (tolower(event.text.unicode) == 'p')
+                        draw_opts.set_preview_level((draw_opts.preview_level() + 1) % (k.depth_levels() + 1));
                 }
             }
 
@@ -240,24 +289,39 @@ int main(int argc, char** argv)
 
             // Update the kinect data.
             auto updates = k.update(elapsed_time);
+            InputSample sample;
+            while (input->pop(sample))
+                gestures.add(sample);
+            auto const roi = draw_opts.roi_only() ? k.roi() : Roi::full(k.x_res(), k.y_res());
             if (updates.depth_)
             {
-                depth_to_rgba(k.depth_data(), k.z_res(), depth_rgba);
-                depth_texture.loadFromPixels(k.x_res(), k.y_res(), uint8_ptr(depth_rgba));
+                // The preview is scaled up anyway, so it is computed from a level of the depth pyramid.
+                auto const level = std::min(draw_opts.preview_level(), k.depth_levels());
+                auto const depth = k.depth_data(level);
+                if (depth.width() != depth_rgba.width() || depth.height() != depth_rgba.height())
+                {
+                    depth_rgba.resize(depth.width(), depth.height());
+                    depth_texture.create(depth.width(), depth.height());
+                    depth_sprite.setTexture(depth_texture, true);
+                    depth_sprite.setScale(WIDTH / (double) depth.width(), HEIGHT / (double) depth.height());
+                    depth_dirty = Roi::full(depth.width(), depth.height());
+                }
+                depth_to_rgba(depth, k.z_res(), depth_rgba, roi.reduced(size_t(1) << level), depth_dirty);
+                depth_texture.loadFromPixels(depth.width(), depth.height(), uint8_ptr(depth_rgba));
             }
             if (updates.user_)
             {
-                user_to_rgba(k.user_data(), user_rgba);
+                user_to_rgba(k.user_data(), user_rgba, roi, user_dirty);
                 user_texture.create(k.x_res(), k.y_res());
                 user_texture.update(uint8_ptr(user_rgba));
                 joint_sprites.clear();
                 for (auto const & user : k.users())
                 {
-                    for (auto const & p : user.joints_)
+                    for (auto const & j : user.joints_)
                     {
                         joint_sprites.emplace_back(joint_texture);
-                        joint_sprites.back().setPosition(SCALE_X*p.second.proj_position_.X,
-                                                         SCALE_Y*p.second.proj_position_.Y);
+                        joint_sprites.back().setPosition(SCALE_X*j.proj_position_.X,
+                                                         SCALE_Y*j.proj_position_.Y);
                     }
                 }
             }
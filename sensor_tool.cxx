@@ -0,0 +1,1344 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <list>
+#include <chrono>
+#include <stdexcept>
+#include <random>
+#include <iomanip>
+#include <cmath>
+#include <thread>
+
+#include "sensor.hxx"
+#include "recording.hxx"
+#include "depth_codec.hxx"
+#include "joint_filter.hxx"
+#include "synthetic_sensor.hxx"
+#include "replay_sensor.hxx"
+#include "gestures.hxx"
+#include "depth_filter.hxx"
+#include "sensor_pose.hxx"
+#include "vecmath.hxx"
+#include "interaction_volumes.hxx"
+#include "user_segmentation.hxx"
+
+using namespace kin;
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * @brief Return the seconds since t.
+ */
+double seconds_since(Clock::time_point const & t)
+{
+    return std::chrono::duration<double>(Clock::now() - t).count();
+}
+
+/**
+ * @brief Print the header and the size of a recording.
+ */
+void info(std::string const & filename)
+{
+    Recording rec(filename);
+    std::ifstream f(filename, std::ios::binary | std::ios::ate);
+    double const bytes = static_cast<double>(f.tellg());
+    double const duration = rec.size() > 1 ? (rec.timestamp(rec.size()-1) - rec.timestamp(0)) / 1e6 : 0.0;
+    std::cout << "resolution: " << rec.x_res() << "x" << rec.y_res() << " (max depth " << rec.z_res() << ")" << std::endl;
+    std::cout << "field of view: " << rec.field_of_view().horizontal_ << " x " << rec.field_of_view().vertical_ << " rad" << std::endl;
+    std::cout << "frames: " << rec.size() << std::endl;
+    std::cout << "duration: " << duration << " s" << std::endl;
+    std::cout << "size: " << bytes / (1024.0*1024.0) << " MB";
+    if (duration > 0.0)
+        std::cout << " (" << bytes / (1024.0*1024.0) / duration << " MB/s)";
+    std::cout << std::endl;
+}
+
+/**
+ * @brief Rewrite a recording with (or without) compression.
+ */
+void convert(std::string const & in_file, std::string const & out_file, bool compress)
+{
+    Recording in(in_file);
+    SensorRecorder out(out_file, in.x_res(), in.y_res(), in.z_res(), in.field_of_view(), compress);
+    SensorFrame frame;
+    for (size_t i = 0; i < in.size(); ++i)
+    {
+        auto const updates = in.read(i, frame);
+        out.write(frame, updates);
+    }
+    out.close();
+    std::cout << "wrote " << out.size() << " frames to " << out_file << std::endl;
+}
+
+/**
+ * @brief Measure the encode and decode throughput and the compression ratio of the depth and label codecs.
+ */
+void bench_codec(std::vector<SensorFrame> const & frames)
+{
+    if (frames.empty())
+        throw std::runtime_error("bench_codec(): No frames.");
+    auto const w = frames.front().depth_data_.width();
+    auto const h = frames.front().depth_data_.height();
+    double const raw_depth = static_cast<double>(frames.size() * w * h * sizeof(XnDepthPixel));
+    double const raw_labels = static_cast<double>(frames.size() * w * h * sizeof(XnLabel));
+
+    // Encode.
+    DepthEncoder encoder;
+    std::vector<std::vector<uint8_t> > depth(frames.size());
+    std::vector<std::vector<uint8_t> > labels(frames.size());
+    std::vector<bool> keyframe(frames.size());
+    auto t = Clock::now();
+    for (size_t i = 0; i < frames.size(); ++i)
+        keyframe[i] = encoder.encode(frames[i].depth_data_, depth[i]);
+    double const depth_encode = seconds_since(t);
+    t = Clock::now();
+    for (size_t i = 0; i < frames.size(); ++i)
+        encode_labels(frames[i].user_data_, labels[i]);
+    double const label_encode = seconds_since(t);
+
+    // Decode and verify.
+    DepthDecoder decoder;
+    Array2D<XnDepthPixel> depth_out(w, h);
+    Array2D<XnLabel> labels_out(w, h);
+    double depth_decode = 0.0;
+    double label_decode = 0.0;
+    size_t depth_bytes = 0;
+    size_t label_bytes = 0;
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+        t = Clock::now();
+        decoder.decode(depth[i].data(), depth[i].size(), keyframe[i], depth_out);
+        depth_decode += seconds_since(t);
+        t = Clock::now();
+        decode_labels(labels[i].data(), labels[i].size(), labels_out);
+        label_decode += seconds_since(t);
+        if (!std::equal(depth_out.begin(), depth_out.end(), frames[i].depth_data_.begin()) ||
+            !std::equal(labels_out.begin(), labels_out.end(), frames[i].user_data_.begin()))
+            throw std::runtime_error("bench_codec(): Decoded frame differs from the original.");
+        depth_bytes += depth[i].size();
+        label_bytes += labels[i].size();
+    }
+
+    auto const mb = 1024.0 * 1024.0;
+    auto const fps = [&](double s){ return frames.size() / s; };
+    std::cout << frames.size() << " frames, " << w << "x" << h << std::endl;
+    std::cout << "depth:  ratio " << raw_depth / depth_bytes
+              << ", encode " << raw_depth / mb / depth_encode << " MB/s (" << fps(depth_encode) << " fps)"
+              << ", decode " << raw_depth / mb / depth_decode << " MB/s (" << fps(depth_decode) << " fps)" << std::endl;
+    std::cout << "labels: ratio " << raw_labels / label_bytes
+              << ", encode " << raw_labels / mb / label_encode << " MB/s (" << fps(label_encode) << " fps)"
+              << ", decode " << raw_labels / mb / label_decode << " MB/s (" << fps(label_decode) << " fps)" << std::endl;
+}
+
+/**
+ * @brief Load all frames of a recording.
+ */
+std::vector<SensorFrame> load_frames(std::string const & filename)
+{
+    Recording rec(filename);
+    std::vector<SensorFrame> frames(rec.size());
+    for (size_t i = 0; i < rec.size(); ++i)
+        rec.read(i, frames[i]);
+    return frames;
+}
+
+/**
+ * @brief Grab the given number of frames from a lockstep synthetic sensor.
+ */
+std::vector<SensorFrame> synthetic_frames(size_t count, size_t num_users = 4)
+{
+    SyntheticSensorOptions options(num_users, 640, 480, 0.0f);
+    SyntheticSensor sensor(options);
+    std::vector<SensorFrame> frames;
+    while (frames.size() < count)
+    {
+        if (!sensor.update(1.0f/30.0f).depth_)
+            continue;
+        SensorFrame f;
+        f.depth_data_.resize(sensor.x_res(), sensor.y_res());
+        f.user_data_.resize(sensor.x_res(), sensor.y_res());
+        std::copy(sensor.depth_data().begin(), sensor.depth_data().end(), f.depth_data_.begin());
+        std::copy(sensor.user_data().begin(), sensor.user_data().end(), f.user_data_.begin());
+        f.label_bounds_ = sensor.frame().label_bounds_;
+        f.users_ = sensor.frame().users_;
+        frames.push_back(f);
+    }
+    return frames;
+}
+
+/**
+ * @brief A joint trajectory: positions and their times in seconds.
+ */
+struct Trace
+{
+    std::vector<double> t_;
+    std::vector<XnVector3D> x_;
+
+    /**
+     * @brief Return the linearly interpolated position at time t.
+     */
+    XnVector3D at(double t) const
+    {
+        auto const it = std::lower_bound(t_.begin(), t_.end(), t);
+        if (it == t_.begin())
+            return x_.front();
+        if (it == t_.end())
+            return x_.back();
+        auto const i = static_cast<size_t>(it - t_.begin());
+        auto const a = static_cast<float>((t - t_[i-1]) / (t_[i] - t_[i-1]));
+        return x_[i-1] + a * (x_[i] - x_[i-1]);
+    }
+};
+
+/**
+ * @brief Extract the trajectory of the given joint of the first tracked user.
+ */
+Trace load_trace(std::string const & filename, XnSkeletonJoint joint)
+{
+    Recording rec(filename);
+    Trace trace;
+    SensorFrame frame;
+    for (size_t i = 0; i < rec.size(); ++i)
+    {
+        auto const updates = rec.read(i, frame);
+        if (!updates.user_ || frame.users_.empty() || !frame.users_.front().joints_.has(joint))
+            continue;
+        auto const t = frame.timestamp_ / 1e6;
+        if (!trace.t_.empty() && t <= trace.t_.back())
+            continue;
+        trace.t_.push_back(t);
+        trace.x_.push_back(frame.users_.front().joints_.at(joint).real_position_);
+    }
+    if (trace.t_.size() < 2)
+        throw std::runtime_error("load_trace(): The recording has no joint trajectory.");
+    return trace;
+}
+
+/**
+ * @brief Run the given filters on the (noisy) trace and report the added latency and the remaining jitter.
+ *
+ * If predict is positive, the filtered positions are extrapolated by predict seconds (see MotionPredictor).
+ * The latency is the time shift of the reference trace that fits the filtered trace best, the
+ * jitter is the RMS distance between the filtered trace and the shifted reference.
+ */
+void bench_filter(Trace const & reference, float noise, float predict, std::vector<std::string> const & specs)
+{
+    // Add white noise to the measurements.
+    Trace input = reference;
+    std::mt19937 rng(1);
+    std::normal_distribution<float> dist(0.0f, noise);
+    if (noise > 0)
+        for (auto & x : input.x_)
+            x = x + XnVector3D({dist(rng), dist(rng), dist(rng)});
+
+    auto const duration = reference.t_.back() - reference.t_.front();
+    std::cout << reference.t_.size() << " samples, " << duration << " s, noise " << noise << " mm, prediction " << 1000*predict << " ms" << std::endl;
+    std::cout << std::setw(28) << std::left << "filter" << std::right
+              << std::setw(14) << "latency [ms]" << std::setw(14) << "jitter [mm]" << std::setw(14) << "error [mm]" << std::endl;
+    for (auto const & spec : specs)
+    {
+        JointFilter filter(parse_joint_filter(spec));
+        PredictionOptions prediction(predict);
+        prediction.max_offset_ = 1e9f; // the trace is in millimeters, the default clamping is meant for the hand coordinates
+        MotionPredictor predictor(prediction);
+        std::vector<XnVector3D> out(input.x_.size());
+        for (size_t i = 0; i < out.size(); ++i)
+        {
+            out[i] = filter(input.x_[i], input.t_[i]);
+            if (predict > 0)
+            {
+                predictor.push(out[i], input.t_[i]);
+                out[i] = predictor.predict();
+            }
+        }
+
+        // Find the time shift of the reference that fits best. The first half second is skipped, so the filter can settle.
+        auto const rms = [&](double shift){
+            double sum = 0;
+            size_t n = 0;
+            for (size_t i = 0; i < out.size(); ++i)
+            {
+                if (input.t_[i] - input.t_.front() < 0.5)
+                    continue;
+                auto const d = length(out[i] - reference.at(input.t_[i] - shift));
+                sum += d*d;
+                ++n;
+            }
+            return n > 0 ? std::sqrt(sum / n) : 0.0;
+        };
+        double best_shift = -0.2;
+        double best = rms(best_shift);
+        for (double shift = -0.199; shift <= 0.5; shift += 0.001)
+        {
+            auto const e = rms(shift);
+            if (e < best)
+            {
+                best = e;
+                best_shift = shift;
+            }
+        }
+        std::cout << std::setw(28) << std::left << spec << std::right
+                  << std::setw(14) << 1000*best_shift << std::setw(14) << best << std::setw(14) << rms(0) << std::endl;
+    }
+}
+
+/**
+ * @brief Compare the time of the depth and label conversions on whole frames and on the region of interest around the users.
+ *
+ * Also measure the silhouette mask that the game shows, which is computed on the region only.
+ */
+void bench_roi(std::vector<SensorFrame> const & frames)
+{
+    if (frames.empty())
+        throw std::runtime_error("bench_roi(): No frames.");
+    auto const w = frames.front().depth_data_.width();
+    auto const h = frames.front().depth_data_.height();
+    XnUInt32 const z_res = 10000;
+
+    // Compute the regions like the capture thread.
+    RoiTracker tracker;
+    std::vector<Roi> rois;
+    double area = 0.0;
+    for (auto const & f : frames)
+    {
+        rois.push_back(tracker.update(f.label_bounds_, w, h));
+        area += rois.back().area();
+    }
+
+    Array2D<sf::Color> depth_full(w, h);
+    Array2D<sf::Color> user_full(w, h);
+    Array2D<sf::Color> depth_roi(w, h);
+    Array2D<sf::Color> user_roi(w, h);
+    Array2D<sf::Color> silhouette(w, h);
+    auto depth_dirty = Roi::full(w, h);
+    auto user_dirty = Roi::full(w, h);
+    auto silhouette_dirty = Roi::full(w, h);
+    double full_time = 0.0;
+    double roi_time = 0.0;
+    double silhouette_time = 0.0;
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+        auto const & f = frames[i];
+        auto t = Clock::now();
+        depth_to_rgba(f.depth_data_, z_res, depth_full);
+        user_to_rgba(f.user_data_, user_full);
+        full_time += seconds_since(t);
+        t = Clock::now();
+        depth_to_rgba(f.depth_data_, z_res, depth_roi, rois[i], depth_dirty);
+        user_to_rgba(f.user_data_, user_roi, rois[i], user_dirty);
+        roi_time += seconds_since(t);
+        t = Clock::now();
+        silhouette_to_rgba(f.user_data_, f.depth_data_, 0, sf::Color(255, 255, 255, 110), silhouette, rois[i], silhouette_dirty);
+        silhouette_time += seconds_since(t);
+
+        // Every labelled pixel must be inside of the region.
+        if (!std::equal(user_full.begin(), user_full.end(), user_roi.begin()))
+            throw std::runtime_error("bench_roi(): The region misses labelled pixels.");
+    }
+
+    auto const ms = [&](double s){ return 1000.0 * s / frames.size(); };
+    std::cout << frames.size() << " frames, " << w << "x" << h
+              << ", mean region " << 100.0 * area / (frames.size() * w * h) << " % of the frame" << std::endl;
+    std::cout << "full: " << ms(full_time) << " ms/frame" << std::endl;
+    std::cout << "roi:  " << ms(roi_time) << " ms/frame (" << full_time / roi_time << "x)" << std::endl;
+    std::cout << "silhouette (roi): " << ms(silhouette_time) << " ms/frame" << std::endl;
+}
+
+/**
+ * @brief Measure the time to build the depth pyramid and to convert the depth of each level to RGBA.
+ */
+void bench_pyramid(std::vector<SensorFrame> const & frames, size_t levels)
+{
+    if (frames.empty())
+        throw std::runtime_error("bench_pyramid(): No frames.");
+    XnUInt32 const z_res = 10000;
+    auto const ms = [&](double s){ return 1000.0 * s / frames.size(); };
+    std::cout << frames.size() << " frames, " << frames.front().depth_data_.width() << "x" << frames.front().depth_data_.height() << std::endl;
+
+    DepthPyramid pyramid;
+    for (auto const reduction : {DepthPyramidOptions::Min, DepthPyramidOptions::Median})
+    {
+        DepthPyramidOptions const options(levels, reduction);
+        auto const t = Clock::now();
+        for (auto const & f : frames)
+            pyramid.build(f.depth_data_, options);
+        std::cout << (reduction == DepthPyramidOptions::Min ? "build min:    " : "build median: ")
+                  << ms(seconds_since(t)) << " ms/frame" << std::endl;
+    }
+
+    // Convert every level to RGBA, level 0 is the full resolution.
+    std::vector<Array2D<sf::Color> > rgba(levels+1);
+    std::vector<double> times(levels+1, 0.0);
+    for (auto const & f : frames)
+    {
+        pyramid.build(f.depth_data_, DepthPyramidOptions(levels, DepthPyramidOptions::Median));
+        for (size_t level = 0; level <= levels; ++level)
+        {
+            auto const & depth = level == 0 ? f.depth_data_ : pyramid.level(level);
+            rgba[level].resize(depth.width(), depth.height());
+            auto const t = Clock::now();
+            depth_to_rgba(depth, z_res, rgba[level]);
+            times[level] += seconds_since(t);
+        }
+    }
+    for (size_t level = 0; level <= levels; ++level)
+        std::cout << "level " << level << " (" << rgba[level].width() << "x" << rgba[level].height() << "): depth_to_rgba "
+                  << ms(times[level]) << " ms/frame" << std::endl;
+}
+
+/**
+ * @brief Return the normalized position of a hand at the given time (0 to 5 seconds) of the gesture script.
+ *
+ * The hand swipes right, left, up and down with pauses longer than the cooldown, pushes, holds
+ * still and draws a circle, so each gesture happens once per script.
+ */
+XnPoint3D gesture_script(float phase)
+{
+    XnPoint3D p = {0.5f, 0.5f, 0.0f};
+    if (phase < 0.3f)
+        p.X += 1.5f * phase; // swipe right
+    else if (phase < 0.65f)
+        p.X += 0.45f;
+    else if (phase < 0.95f)
+        p.X += 0.45f - 1.5f * (phase - 0.65f); // swipe left
+    else if (phase >= 1.3f && phase < 1.6f)
+        p.Y -= 1.5f * (phase - 1.3f); // swipe up
+    else if (phase >= 1.6f && phase < 1.95f)
+        p.Y -= 0.45f;
+    else if (phase >= 1.95f && phase < 2.25f)
+        p.Y -= 0.45f - 1.5f * (phase - 1.95f); // swipe down
+    else if (phase >= 2.6f && phase < 2.9f)
+        p.Z += phase - 2.6f; // push
+    else if (phase >= 2.9f && phase < 3.4f)
+        p.Z += 0.3f * (3.4f - phase) / 0.5f; // way back
+    else if (phase >= 4.0f)
+    {
+        // The hold ends with 1.4 turns of a circle: A full turn is recognized even if the hand
+        // turned by up to 90 degrees the other way before, the rest is less than a full turn.
+        auto const a = 1.4f * 2.0f * 3.14159265f * (phase - 4.0f);
+        p.X += 0.1f * std::cos(a) - 0.1f;
+        p.Y += 0.1f * std::sin(a);
+    }
+    return p;
+}
+
+/**
+ * @brief Measure the time of the gesture recognizers and check that every hand makes each gesture of the script once per run.
+ *
+ * Each hand repeats the five second script (see gesture_script()) seconds/5 times. The hands start
+ * a few frames after each other, so they do not gesture at the same samples.
+ */
+void bench_gestures(size_t num_users, size_t seconds)
+{
+    static char const * const names[] = {"swipe left", "swipe right", "swipe up", "swipe down", "push", "hold", "circle"};
+    size_t counts[7] = {0, 0, 0, 0, 0, 0, 0};
+    GestureEngine engine;
+    engine.handle_gesture_ = [&](Event const & ev){
+        ++counts[ev.gesture_.gesture_];
+    };
+
+    // 30 samples per second with some noise.
+    size_t const script_frames = 5*30;
+    size_t const runs = seconds / 5;
+    std::mt19937 rng(42);
+    std::normal_distribution<float> noise(0.0f, 0.003f);
+    std::vector<InputSample> samples;
+    for (size_t frame = 0; frame < runs*script_frames + script_frames; ++frame)
+    {
+        for (size_t u = 0; u < num_users; ++u)
+        {
+            for (int hand = 0; hand < 2; ++hand)
+            {
+                auto const first = (7 * (2*u + hand)) % script_frames;
+                if (frame < first || frame >= first + runs*script_frames)
+                    continue;
+                InputSample s;
+                s.timestamp_ = static_cast<XnUInt64>(1e6 * frame / 30.0);
+                s.user_ = static_cast<XnLabel>(u+1);
+                s.hand_ = hand == 0 ? InputSample::LeftHand : InputSample::RightHand;
+                s.position_ = gesture_script(((frame - first) % script_frames) / 30.0f);
+                s.position_.X += noise(rng);
+                s.position_.Y += noise(rng);
+                s.position_.Z += noise(rng);
+                samples.push_back(s);
+            }
+        }
+    }
+
+    auto const t = Clock::now();
+    for (auto const & s : samples)
+        engine.add(s);
+    auto const elapsed = seconds_since(t);
+    std::cout << samples.size() << " samples of " << 2*num_users << " hands: "
+              << 1e9 * elapsed / samples.size() << " ns/sample" << std::endl;
+    auto const expected = 2 * num_users * runs;
+    size_t mismatches = 0;
+    for (size_t i = 0; i < 7; ++i)
+    {
+        std::cout << std::setw(12) << names[i] << ": " << counts[i] << " of " << expected << std::endl;
+        if (counts[i] != expected)
+            ++mismatches;
+    }
+    if (mismatches > 0)
+        throw std::runtime_error("bench_gestures(): " + std::to_string(mismatches) + " gestures were not recognized once per script.");
+    std::cout << "Every gesture was recognized once per script." << std::endl;
+}
+
+/**
+ * @brief The click detector before it used a ring buffer: It stores the points in a list and rescans the window on every update.
+ */
+class ListClickDetector
+{
+public:
+
+    explicit ListClickDetector(bool use_y)
+        :
+          use_y_(use_y),
+          max_delay_(0.1f),
+          threshold_(0.4f),
+          elapsed_time_(0.0f),
+          clicked_(false)
+    {}
+
+    void update(float p_elapsed_time, XnPoint3D point)
+    {
+        elapsed_time_ += p_elapsed_time;
+        positions_.emplace_back(elapsed_time_, use_y_ ? point.Y : point.Z);
+        while (!positions_.empty() && positions_.front().first+max_delay_ < elapsed_time_)
+            positions_.pop_front();
+        float sum = 0.0;
+        float prev = positions_.front().second;
+        for (auto const & p : positions_)
+        {
+            if (p.second > prev)
+            {
+                sum += std::abs(p.second - prev);
+                prev = p.second;
+            }
+        }
+        if (clicked_ && sum < threshold_)
+            reset();
+        else if (!clicked_ && sum >= threshold_)
+            clicked_ = true;
+    }
+
+    void reset()
+    {
+        positions_.clear();
+        elapsed_time_ = 0;
+        clicked_ = false;
+    }
+
+    bool clicked() const
+    {
+        return clicked_;
+    }
+
+private:
+
+    bool use_y_;
+    float max_delay_;
+    float threshold_;
+    std::list<std::pair<float, float> > positions_;
+    float elapsed_time_;
+    bool clicked_;
+
+};
+
+/**
+ * @brief The hands of the first user in one user update, relative to the user plane like the click detectors of the sensor see them.
+ */
+struct HandFrame
+{
+    float elapsed_time_; // seconds since the previous update
+    XnVector3D left_;
+    XnVector3D right_;
+    bool left_visible_;
+    bool right_visible_;
+};
+
+/**
+ * @brief Extract the hands of the first tracked user from a recording.
+ */
+std::vector<HandFrame> load_hands(std::string const & filename)
+{
+    Recording rec(filename);
+    std::vector<HandFrame> hands;
+    SensorFrame frame;
+    XnUInt64 last_timestamp = 0;
+    for (size_t i = 0; i < rec.size(); ++i)
+    {
+        if (!rec.read(i, frame).user_)
+            continue;
+        HandFrame h = {0.0f, {0, 0, 0}, {0, 0, 0}, false, false};
+        if (!frame.users_.empty())
+        {
+            auto u = frame.users_.front();
+            u.compute_base_change();
+            Sensor::compute_hand_positions(u, h.left_, h.right_, h.left_visible_, h.right_visible_);
+        }
+        if (last_timestamp != 0 && frame.timestamp_ > last_timestamp)
+            h.elapsed_time_ = std::min(0.5f, static_cast<float>((frame.timestamp_ - last_timestamp) / 1e6));
+        last_timestamp = frame.timestamp_;
+        hands.push_back(h);
+    }
+    if (hands.empty())
+        throw std::runtime_error("load_hands(): The recording has no user updates.");
+    return hands;
+}
+
+/**
+ * @brief Create hands that wander around with noise, strike down or forward every second and get lost now and then.
+ */
+std::vector<HandFrame> synthetic_hands(size_t count)
+{
+    std::mt19937 rng(7);
+    std::normal_distribution<float> noise(0.0f, 0.01f);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    std::vector<HandFrame> hands(count);
+    XnVector3D rest = {0.0f, 1.0f, 0.5f};
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto & h = hands[i];
+        h.elapsed_time_ = 1.0f / 30.0f + 0.003f * noise(rng);
+        auto const phase = std::fmod(i / 30.0f, 1.0f);
+        rest.X += noise(rng);
+        rest.Y += noise(rng);
+        rest.Z += noise(rng);
+
+        // The strokes have different speeds, so some of them are too slow to click.
+        auto const speed = 2.0f + 4.0f * std::sin(0.37f * i / 30.0f);
+        auto const stroke = phase < 0.2f ? speed * phase : 0.0f;
+        h.left_ = {rest.X, rest.Y + stroke, rest.Z + noise(rng)};
+        h.right_ = {rest.X + 0.5f, rest.Y + noise(rng), rest.Z + stroke};
+        h.left_visible_ = uniform(rng) > 0.01f;
+        h.right_visible_ = uniform(rng) > 0.01f;
+    }
+    return hands;
+}
+
+/**
+ * @brief Feed the given hand of all updates into the detector like Sensor::detect_clicks() and return the seconds it took.
+ */
+template <typename DETECTOR>
+double run_clicks(DETECTOR & detector, std::vector<HandFrame> const & hands, bool left, std::vector<char> & clicked)
+{
+    auto const t = Clock::now();
+    for (size_t i = 0; i < hands.size(); ++i)
+    {
+        auto const & h = hands[i];
+        if (left ? h.left_visible_ : h.right_visible_)
+            detector.update(h.elapsed_time_, left ? h.left_ : h.right_);
+        else
+            detector.reset();
+        clicked[i] = detector.clicked();
+    }
+    return seconds_since(t);
+}
+
+/**
+ * @brief Run the ring buffer and the list click detector on both hands and check that they click at the same updates.
+ */
+void bench_clicks(std::vector<HandFrame> const & hands)
+{
+    std::cout << hands.size() << " user updates" << std::endl;
+    size_t mismatches = 0;
+    for (bool const use_y : {true, false})
+    {
+        size_t clicks = 0;
+        double list_time = 0.0;
+        double ring_time = 0.0;
+        for (bool const left : {true, false})
+        {
+            ListClickDetector list_detector(use_y);
+            ClickDetector ring_detector(use_y);
+            std::vector<char> list_clicked(hands.size());
+            std::vector<char> ring_clicked(hands.size());
+            list_time += run_clicks(list_detector, hands, left, list_clicked);
+            ring_time += run_clicks(ring_detector, hands, left, ring_clicked);
+            for (size_t i = 0; i < hands.size(); ++i)
+            {
+                if (list_clicked[i] != ring_clicked[i])
+                    ++mismatches;
+                if (ring_clicked[i] && (i == 0 || !ring_clicked[i-1]))
+                    ++clicks;
+            }
+        }
+        auto const ns = [&](double s){ return 1e9 * s / (2 * hands.size()); };
+        std::cout << (use_y ? "y clicks: " : "z clicks: ") << clicks
+                  << ", list " << ns(list_time) << " ns/update, ring " << ns(ring_time) << " ns/update" << std::endl;
+    }
+    if (mismatches > 0)
+        throw std::runtime_error("bench_clicks(): The detectors differ in " + std::to_string(mismatches) + " updates.");
+    std::cout << "The click decisions are identical." << std::endl;
+}
+
+/**
+ * @brief Convert the depth like ConvertProjectiveToRealWorld() of OpenNI: Fill a buffer with the projective points (x, y, depth) of all pixels and convert them one by one.
+ */
+void projective_to_real_world(Array2D<XnDepthPixel> const & depth, FieldOfView const & fov, std::vector<XnPoint3D> & projective, std::vector<XnPoint3D> & real)
+{
+    auto const w = depth.width();
+    auto const h = depth.height();
+    projective.resize(w * h);
+    real.resize(w * h);
+    for (size_t y = 0; y < h; ++y)
+        for (size_t x = 0; x < w; ++x)
+            projective[y*w+x] = {static_cast<float>(x), static_cast<float>(y), static_cast<float>(depth(x, y))};
+
+    auto const x_to_z = static_cast<float>(2.0 * std::tan(fov.horizontal_ / 2.0));
+    auto const y_to_z = static_cast<float>(2.0 * std::tan(fov.vertical_ / 2.0));
+    for (size_t i = 0; i < projective.size(); ++i)
+    {
+        auto const & p = projective[i];
+        real[i].X = (p.X / w - 0.5f) * p.Z * x_to_z;
+        real[i].Y = (0.5f - p.Y / h) * p.Z * y_to_z;
+        real[i].Z = p.Z;
+    }
+}
+
+/**
+ * @brief Compare the point cloud conversion with the ray table to the per point conversion of OpenNI.
+ */
+void bench_points(std::vector<SensorFrame> const & frames)
+{
+    if (frames.empty())
+        throw std::runtime_error("bench_points(): No frames.");
+    auto const w = frames.front().depth_data_.width();
+    auto const h = frames.front().depth_data_.height();
+    FieldOfView const fov;
+    auto const ms = [&](double s){ return 1000.0 * s / frames.size(); };
+    std::cout << frames.size() << " frames, " << w << "x" << h << std::endl;
+
+    // The OpenNI path.
+    std::vector<XnPoint3D> projective;
+    std::vector<XnPoint3D> real;
+    auto t = Clock::now();
+    for (auto const & f : frames)
+        projective_to_real_world(f.depth_data_, fov, projective, real);
+    std::cout << "projective to real world: " << ms(seconds_since(t)) << " ms/frame" << std::endl;
+
+    // The ray table must give the same points.
+    t = Clock::now();
+    RayTable const rays(w, h, fov);
+    std::cout << "ray table:                " << 1000.0 * seconds_since(t) << " ms (once)" << std::endl;
+    PointCloud cloud;
+    float max_error = 0.0f;
+    for (auto const & f : frames)
+    {
+        projective_to_real_world(f.depth_data_, fov, projective, real);
+        depth_to_points(f.depth_data_, rays, cloud);
+        for (size_t i = 0; i < real.size(); ++i)
+        {
+            auto const & a = real[i];
+            auto const & b = cloud(i % w, i / w);
+            max_error = std::max(max_error, std::max(std::abs(a.X - b.X), std::max(std::abs(a.Y - b.Y), std::abs(a.Z - b.Z))));
+        }
+    }
+    if (max_error > 0.01f)
+        throw std::runtime_error("bench_points(): The points differ by " + std::to_string(max_error) + " mm.");
+
+    t = Clock::now();
+    for (auto const & f : frames)
+        depth_to_points(f.depth_data_, rays, cloud);
+    std::cout << "rays:                     " << ms(seconds_since(t)) << " ms/frame (max difference " << max_error << " mm)" << std::endl;
+
+    t = Clock::now();
+    for (auto const & f : frames)
+        depth_to_points(f.depth_data_, rays, Roi::full(w, h), 2, cloud);
+    std::cout << "rays, every 2nd pixel:    " << ms(seconds_since(t)) << " ms/frame" << std::endl;
+
+    RoiTracker tracker;
+    double roi_time = 0.0;
+    for (auto const & f : frames)
+    {
+        auto const roi = tracker.update(f.label_bounds_, w, h);
+        t = Clock::now();
+        depth_to_points(f.depth_data_, rays, roi, 1, cloud);
+        roi_time += seconds_since(t);
+    }
+    std::cout << "rays, region of interest: " << ms(roi_time) << " ms/frame" << std::endl;
+
+    ThreadPool pool;
+    t = Clock::now();
+    for (auto const & f : frames)
+        depth_to_points(f.depth_data_, rays, cloud, &pool);
+    std::cout << "rays, parallel:           " << ms(seconds_since(t)) << " ms/frame (" << pool.size() << " threads)" << std::endl;
+}
+
+/**
+ * @brief Add kinect like noise to the depth: Gaussian noise that grows with the squared depth, random holes and flickering holes at depth edges.
+ */
+void add_depth_noise(Array2D<XnDepthPixel> const & clean, Array2D<XnDepthPixel> & noisy, std::mt19937 & rng)
+{
+    std::normal_distribution<float> gauss(0.0f, 1.0f);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    auto const w = clean.width();
+    auto const h = clean.height();
+    noisy.resize(w, h);
+    for (size_t y = 0; y < h; ++y)
+    {
+        for (size_t x = 0; x < w; ++x)
+        {
+            auto const d = clean(x, y);
+            auto const next = clean(std::min(x+1, w-1), y);
+            auto const edge = std::abs(static_cast<int>(d) - static_cast<int>(next)) > 50;
+            if (d == 0 || uniform(rng) < 0.02f || (edge && uniform(rng) < 0.5f))
+            {
+                noisy(x, y) = 0;
+                continue;
+            }
+            auto const sigma = 1.5e-6f * d * d;
+            noisy(x, y) = static_cast<XnDepthPixel>(std::max(1.0f, std::round(d + sigma * gauss(rng))));
+        }
+    }
+}
+
+/**
+ * @brief Measure the depth filters and their quality: holes, flicker between frames and, if the clean depth is known, the error.
+ *
+ * If truth is not empty, it holds the clean depth of the frames.
+ */
+void bench_denoise(std::vector<SensorFrame> const & frames, std::vector<Array2D<XnDepthPixel> > const & truth)
+{
+    if (frames.empty())
+        throw std::runtime_error("bench_denoise(): No frames.");
+    auto const w = frames.front().depth_data_.width();
+    auto const h = frames.front().depth_data_.height();
+    ThreadPool pool;
+    std::cout << frames.size() << " frames, " << w << "x" << h << ", " << pool.size() << " threads" << std::endl;
+
+    struct Config
+    {
+        std::string spec_;
+        bool single_thread_;
+    };
+    std::vector<Config> const configs = {
+        {"none", false}, {"exp", false}, {"median", false}, {"none,2", false}, {"exp,2", false}, {"median,2", false}, {"median,2", true}
+    };
+    Array2D<XnDepthPixel> depth(w, h);
+    Array2D<XnDepthPixel> previous(w, h);
+    for (auto const & config : configs)
+    {
+        DepthFilter filter(parse_depth_filter(config.spec_), config.single_thread_ ? nullptr : &pool);
+        double time = 0.0;
+        double holes = 0.0;
+        double flicker = 0.0;
+        size_t flicker_pixels = 0;
+        double error = 0.0;
+        size_t error_pixels = 0;
+        for (size_t i = 0; i < frames.size(); ++i)
+        {
+            std::copy(frames[i].depth_data_.begin(), frames[i].depth_data_.end(), depth.begin());
+            auto const t = Clock::now();
+            filter.apply(depth);
+            time += seconds_since(t);
+
+            auto const out = depth.data();
+            auto const last = previous.data();
+            auto const clean = truth.empty() ? nullptr : truth[i].data();
+            for (size_t k = 0; k < w*h; ++k)
+            {
+                if (clean && clean[k] == 0)
+                    continue;
+                if (out[k] == 0)
+                {
+                    holes += 1.0;
+                    continue;
+                }
+                if (i > 0 && last[k] != 0)
+                {
+                    flicker += std::abs(static_cast<int>(out[k]) - static_cast<int>(last[k]));
+                    ++flicker_pixels;
+                }
+                if (clean)
+                {
+                    error += std::abs(static_cast<int>(out[k]) - static_cast<int>(clean[k]));
+                    ++error_pixels;
+                }
+            }
+            std::swap(depth, previous);
+        }
+
+        std::cout << std::left << std::setw(9) << config.spec_ << (config.single_thread_ ? " 1 thread" : "         ") << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(7) << 1000.0 * time / frames.size() << " ms/frame, holes "
+                  << std::setw(6) << 100.0 * holes / (frames.size() * w * h) << " %, flicker "
+                  << std::setw(6) << flicker / std::max<size_t>(flicker_pixels, 1) << " mm";
+        if (!truth.empty())
+            std::cout << ", error " << std::setw(6) << error / std::max<size_t>(error_pixels, 1) << " mm";
+        std::cout << std::endl;
+    }
+}
+
+/**
+ * @brief The former base change of User: the 3x3 matrix (row major) of an sf::Transform, inverted like sf::Transform::getInverse() and multiplied by the scale matrix.
+ */
+std::array<float, 9> legacy_base_change(XnVector3D const & s0, XnVector3D const & s1)
+{
+    auto const len = length(s1 - s0);
+    float const b[9] = {s1.X - s0.X, 0, s1.Z - s0.Z, 0, 1, 0, s1.Z - s0.Z, 0, s0.X - s1.X};
+    std::array<float, 9> m = {{1, 0, 0, 0, 1, 0, 0, 0, 1}};
+    float const det = b[0]*(b[8]*b[4] - b[5]*b[7]) - b[1]*(b[8]*b[3] - b[5]*b[6]) + b[2]*(b[7]*b[3] - b[4]*b[6]);
+    if (det != 0)
+    {
+        m = {{
+            (b[8]*b[4] - b[5]*b[7]) / det, -(b[8]*b[1] - b[2]*b[7]) / det, (b[5]*b[1] - b[2]*b[4]) / det,
+            -(b[8]*b[3] - b[5]*b[6]) / det, (b[8]*b[0] - b[2]*b[6]) / det, -(b[5]*b[0] - b[2]*b[3]) / det,
+            (b[7]*b[3] - b[4]*b[6]) / det, -(b[7]*b[0] - b[1]*b[6]) / det, (b[4]*b[0] - b[1]*b[3]) / det
+        }};
+    }
+    if (len > 0)
+    {
+        float const s = 1 / len;
+        float const scale[9] = {0, s, 0, 0, s, 0, 0, s, 0};
+        std::array<float, 9> p;
+        for (size_t i = 0; i < 3; ++i)
+            for (size_t j = 0; j < 3; ++j)
+                p[3*i+j] = m[3*i] * scale[j] + m[3*i+1] * scale[3+j] + m[3*i+2] * scale[6+j];
+        m = p;
+    }
+    return m;
+}
+
+/**
+ * @brief Check the vector math against pinned values and the former base change, and compare the batch transform of point clouds with the one by one transform.
+ */
+void check_math(std::vector<SensorFrame> const & frames)
+{
+    // The basic operations are constexpr.
+    constexpr Mat3 rot(0, -1, 0, 1, 0, 0, 0, 0, 1);
+    static_assert(rot * Vec3(1, 2, 3) == Vec3(-2, 1, 3), "check_math(): Mat3 * Vec3");
+    static_assert(rot * rot.transposed() == Mat3(), "check_math(): Mat3 * Mat3");
+    static_assert(cross(Vec3(1, 0, 0), Vec3(0, 1, 0)) == Vec3(0, 0, 1), "check_math(): cross");
+    static_assert(rot.determinant() == 1, "check_math(): determinant");
+
+    size_t failures = 0;
+    auto const check = [&](std::string const & what, XnVector3D const & a, XnVector3D const & b){
+        auto const tolerance = 1e-5f * (1.0f + std::max(std::abs(b.X), std::max(std::abs(b.Y), std::abs(b.Z))));
+        if (std::abs(a.X - b.X) > tolerance || std::abs(a.Y - b.Y) > tolerance || std::abs(a.Z - b.Z) > tolerance)
+        {
+            if (failures < 10)
+                std::cerr << what << ": (" << a.X << ", " << a.Y << ", " << a.Z << ") != (" << b.X << ", " << b.Y << ", " << b.Z << ")" << std::endl;
+            ++failures;
+        }
+    };
+
+    // Values of the former sf::Transform based base change.
+    XnVector3D const s0 = {-180, 300, 2000};
+    XnVector3D const s1 = {170, 310, 2050};
+    XnVector3D const torso = {-5, 0, 2030};
+    XnVector3D const left = {-400, 250, 1700};
+    XnVector3D const right = {350, 600, 1650};
+    User pinned(1);
+    pinned.joints_.set(JointInfo(XN_SKEL_LEFT_SHOULDER, 1, s0));
+    pinned.joints_.set(JointInfo(XN_SKEL_RIGHT_SHOULDER, 1, s1));
+    pinned.compute_base_change();
+    check("pinned left", pinned.transform_vector(left - torso), {0.00226183701f, 0.706824064f, -0.00169637764f});
+    check("pinned right", pinned.transform_vector(right - torso), {0.00542840874f, 1.69637775f, -0.00407130644f});
+    User singular(2);
+    singular.joints_.set(JointInfo(XN_SKEL_LEFT_SHOULDER, 1, s0));
+    singular.joints_.set(JointInfo(XN_SKEL_RIGHT_SHOULDER, 1, s0));
+    singular.compute_base_change();
+    check("pinned singular", singular.transform_vector(left), left);
+
+    // The base change of every user must transform all joints like the former one.
+    size_t num_users = 0;
+    for (auto const & f : frames)
+    {
+        for (auto u : f.users_)
+        {
+            if (!u.joints_.has(XN_SKEL_LEFT_SHOULDER) || !u.joints_.has(XN_SKEL_RIGHT_SHOULDER) || !u.joints_.has(XN_SKEL_TORSO))
+                continue;
+            u.compute_base_change();
+            auto const m = legacy_base_change(u.joints_.at(XN_SKEL_LEFT_SHOULDER).real_position_, u.joints_.at(XN_SKEL_RIGHT_SHOULDER).real_position_);
+            auto const t = u.joints_.at(XN_SKEL_TORSO).real_position_;
+            for (auto const & j : u.joints_)
+            {
+                auto const v = j.real_position_ - t;
+                XnVector3D const expected = {
+                    m[0] * v.X + m[1] * v.Y + m[2] * v.Z,
+                    m[3] * v.X + m[4] * v.Y + m[5] * v.Z,
+                    m[6] * v.X + m[7] * v.Y + m[8] * v.Z
+                };
+                check("user " + std::to_string(u.id_), u.transform_vector(v), expected);
+            }
+            ++num_users;
+        }
+    }
+    if (failures > 0)
+        throw std::runtime_error("check_math(): " + std::to_string(failures) + " vectors differ from the former base change.");
+    std::cout << "The base change of " << num_users << " users matches the former one." << std::endl;
+
+    // Move the point clouds into the world of a turned sensor.
+    if (frames.empty())
+        return;
+    auto const w = frames.front().depth_data_.width();
+    auto const h = frames.front().depth_data_.height();
+    RayTable const rays(w, h, FieldOfView());
+    auto const pose = SensorPose::from_angles({1500, 0, 0}, -30, 10, 0);
+    PointCloud cloud;
+    std::vector<XnPoint3D> single(w * h);
+    std::vector<XnPoint3D> batch(w * h);
+    double single_time = 0.0;
+    double batch_time = 0.0;
+    float max_error = 0.0f;
+    for (auto const & f : frames)
+    {
+        depth_to_points(f.depth_data_, rays, cloud);
+        auto t = Clock::now();
+        for (size_t i = 0; i < cloud.size(); ++i)
+            single[i] = pose.to_world(cloud(i % w, i / w));
+        single_time += seconds_since(t);
+        t = Clock::now();
+        transform_points(pose.rotation_, pose.translation_, cloud.data(), cloud.size(), &batch.front().X);
+        batch_time += seconds_since(t);
+        for (size_t i = 0; i < cloud.size(); ++i)
+            max_error = std::max(max_error, static_cast<float>(length(single[i] - batch[i])));
+    }
+    if (max_error > 0.01f)
+        throw std::runtime_error("check_math(): The batch transform differs by " + std::to_string(max_error) + " mm.");
+    auto const ms = [&](double s){ return 1000.0 * s / frames.size(); };
+    std::cout << "transform " << w << "x" << h << " points: one by one " << ms(single_time) << " ms/frame, batch "
+              << ms(batch_time) << " ms/frame (max difference " << max_error << " mm)" << std::endl;
+}
+
+/**
+ * @brief Compare the grid lookup of the interaction volumes with a linear scan over all boxes.
+ *
+ * The board has n x n tilted holes with gaps between them, the hands wander randomly over it.
+ */
+void bench_volumes(size_t n, size_t hands)
+{
+    if (n == 0 || hands == 0)
+        throw std::runtime_error("bench_volumes(): The board needs holes and hands.");
+    float const tilt = 0.3f;
+    Mat3 const axes(1, 0, 0,
+                    0, std::cos(tilt), -std::sin(tilt),
+                    0, std::sin(tilt), std::cos(tilt));
+    float const pitch = 1.0f / n;
+    std::vector<InteractionBox> boxes;
+    for (size_t y = 0; y < n; ++y)
+        for (size_t x = 0; x < n; ++x)
+            boxes.emplace_back(Vec3((x + 0.5f) * pitch, (y + 0.5f) * pitch, 1.0f + 0.3f * y * pitch),
+                               Vec3(0.4f * pitch, 0.4f * pitch, 0.1f), axes);
+    InteractionVolumes const volumes(boxes);
+
+    // The random walks of the hands.
+    size_t const num_frames = 2000;
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> start(-0.1f, 1.1f);
+    std::normal_distribution<float> step(0.0f, 0.02f);
+    std::vector<Vec3> positions;
+    positions.reserve(num_frames * hands);
+    for (size_t h = 0; h < hands; ++h)
+    {
+        Vec3 p(start(rng), start(rng), 1.1f);
+        for (size_t f = 0; f < num_frames; ++f)
+        {
+            p = p + Vec3(step(rng), step(rng), step(rng));
+            p = Vec3(std::min(std::max(p.x_, -0.1f), 1.1f), std::min(std::max(p.y_, -0.1f), 1.1f), std::min(std::max(p.z_, 0.9f), 1.3f));
+            positions.push_back(p);
+        }
+    }
+
+    std::vector<int> grid(positions.size());
+    std::vector<int> linear(positions.size());
+    auto t = Clock::now();
+    for (size_t i = 0; i < positions.size(); ++i)
+        grid[i] = volumes.find(positions[i]);
+    auto const grid_time = seconds_since(t);
+    t = Clock::now();
+    for (size_t i = 0; i < positions.size(); ++i)
+    {
+        linear[i] = -1;
+        for (size_t b = 0; b < boxes.size(); ++b)
+        {
+            if (boxes[b].contains(positions[i]))
+            {
+                linear[i] = static_cast<int>(b);
+                break;
+            }
+        }
+    }
+    auto const linear_time = seconds_since(t);
+    if (grid != linear)
+        throw std::runtime_error("bench_volumes(): The grid lookup differs from the linear scan.");
+    auto const inside = positions.size() - std::count(grid.begin(), grid.end(), -1);
+
+    // The engine with all hands, frame by frame.
+    InteractionEngine engine(volumes);
+    size_t events = 0;
+    engine.handle_interaction_ = [&](Event const &){ ++events; };
+    t = Clock::now();
+    for (size_t f = 0; f < num_frames; ++f)
+    {
+        for (size_t h = 0; h < hands; ++h)
+        {
+            auto const & p = positions[h * num_frames + f];
+            XnVector3D const pos = {p.x_, p.y_, p.z_};
+            engine.move_hand(static_cast<int>(h / 2), static_cast<int>(h % 2), f * 33333, pos);
+        }
+    }
+    auto const engine_time = seconds_since(t);
+
+    auto const ns = [&](double s){ return 1e9 * s / positions.size(); };
+    std::cout << "board " << n << "x" << n << " (" << volumes.size() << " volumes, " << volumes.num_cells() << " cells), "
+              << hands << " hands, " << positions.size() << " positions (" << 100.0 * inside / positions.size() << " % inside)" << std::endl;
+    std::cout << "  grid lookup: " << ns(grid_time) << " ns per position" << std::endl;
+    std::cout << "  linear scan: " << ns(linear_time) << " ns per position" << std::endl;
+    std::cout << "  engine:      " << ns(engine_time) << " ns per hand update, " << events << " enter/leave events" << std::endl;
+}
+
+/**
+ * @brief Measure the user segmentation with one and with all threads and compare its labels with the labels of the tracker.
+ *
+ * The background is learned from the warmup frames first. The labels of all thread counts must be equal.
+ */
+void bench_segment(std::vector<SensorFrame> const & frames, std::vector<SensorFrame> const & warmup)
+{
+    if (frames.empty())
+        throw std::runtime_error("bench_segment(): No frames.");
+    auto const w = frames.front().depth_data_.width();
+    auto const h = frames.front().depth_data_.height();
+    // At least four strips, so the merging of the strips is checked on every machine.
+    auto const threads = std::max<size_t>(ThreadPool::default_workers() + 1, 4);
+    std::cout << frames.size() << " frames, " << w << "x" << h << ", " << warmup.size() << " warmup frames" << std::endl;
+
+    std::vector<Array2D<XnLabel> > reference(frames.size());
+    Array2D<XnLabel> labels(w, h);
+    ThreadPool pool(threads - 1);
+    for (size_t const n : {size_t(1), threads})
+    {
+        UserSegmentation segmentation(SegmentationOptions(SegmentationOptions::Always), n == 1 ? nullptr : &pool);
+        for (auto const & f : warmup)
+            segmentation.learn(f.depth_data_);
+
+        double learn_time = 0.0;
+        double segment_time = 0.0;
+        size_t users = 0;
+        size_t tracked = 0;
+        size_t both = 0;
+        size_t segmented_pixels = 0;
+        size_t tracked_pixels = 0;
+        size_t mismatches = 0;
+        for (size_t i = 0; i < frames.size(); ++i)
+        {
+            auto const & f = frames[i];
+            auto t = Clock::now();
+            segmentation.learn(f.depth_data_);
+            learn_time += seconds_since(t);
+            t = Clock::now();
+            users += segmentation.segment(f.depth_data_, labels);
+            segment_time += seconds_since(t);
+            if (segmentation.bounds() != label_bounds(labels))
+                throw std::runtime_error("bench_segment(): Wrong label bounds.");
+
+            std::vector<bool> seen(65536, false);
+            for (size_t k = 0; k < w*h; ++k)
+            {
+                auto const s = labels.data()[k];
+                auto const l = f.user_data_.data()[k];
+                segmented_pixels += s != 0;
+                tracked_pixels += l != 0;
+                both += s != 0 && l != 0;
+                if (l != 0 && !seen[l])
+                {
+                    seen[l] = true;
+                    ++tracked;
+                }
+            }
+            if (n == 1)
+                reference[i] = labels;
+            else if (!std::equal(labels.begin(), labels.end(), reference[i].begin()))
+                ++mismatches;
+        }
+
+        std::cout << n << (n == 1 ? " thread:  " : " threads: ") << std::fixed << std::setprecision(2)
+                  << "learn " << 1000.0 * learn_time / frames.size() << " ms/frame, segment "
+                  << 1000.0 * segment_time / frames.size() << " ms/frame, "
+                  << static_cast<double>(users) / frames.size() << " users/frame (tracker "
+                  << static_cast<double>(tracked) / frames.size() << "), precision "
+                  << 100.0 * both / std::max<size_t>(segmented_pixels, 1) << " %, recall "
+                  << 100.0 * both / std::max<size_t>(tracked_pixels, 1) << " %";
+        if (n != 1)
+            std::cout << ", " << mismatches << " frames differ from 1 thread";
+        std::cout << std::endl;
+    }
+}
+
+/**
+ * @brief Grab the frames of a running sensor at the given rate and check the frame counters of the updates.
+ *
+ * A consumer that is slower than the sensor misses frame sets, they must show up as dropped.
+ */
+void frame_stats(Sensor & sensor, float consumer_fps, double duration)
+{
+    auto const period = std::chrono::microseconds(static_cast<long long>(1e6 / consumer_fps));
+    size_t grabbed = 0;
+    size_t dropped = 0;
+    size_t first_sequence = 0;
+    size_t last_sequence = 0;
+    size_t last_frame = 0;
+    size_t backwards = 0;
+    auto const t = Clock::now();
+    while (seconds_since(t) < duration)
+    {
+        std::this_thread::sleep_for(period);
+        auto const updates = sensor.update(0);
+        if (!updates.depth_ && !updates.user_)
+            continue;
+        if (grabbed == 0)
+            first_sequence = updates.sequence_;
+        else
+            dropped += updates.dropped_;
+        if (updates.sequence_ <= last_sequence)
+            throw std::runtime_error("frame_stats(): The sequence numbers do not increase.");
+        if (updates.sensor_frame_ < last_frame)
+            ++backwards;
+        last_sequence = updates.sequence_;
+        last_frame = updates.sensor_frame_;
+        ++grabbed;
+    }
+    if (grabbed > 0 && first_sequence + grabbed + dropped != last_sequence + 1)
+        throw std::runtime_error("frame_stats(): The dropped frame sets do not add up.");
+
+    auto const & stats = sensor.frame_stats();
+    std::cout << "grabbed " << grabbed << " of " << stats.published_ << " frame sets in " << duration << " s ("
+              << consumer_fps << " updates/s)" << std::endl;
+    std::cout << "  dropped:        " << stats.dropped_ << std::endl;
+    std::cout << "  skipped:        " << stats.skipped_ << std::endl;
+    std::cout << "  repeated:       " << stats.duplicated_ << std::endl;
+    std::cout << "  unsynchronized: " << stats.unsynchronized_ << std::endl;
+    if (backwards > 0)
+        std::cout << "  restarts:       " << backwards << std::endl;
+}
+
+void usage()
+{
+    std::cout << "Usage:" << std::endl
+              << "  sensor_tool info <recording>" << std::endl
+              << "  sensor_tool compress <in> <out>" << std::endl
+              << "  sensor_tool decompress <in> <out>" << std::endl
+              << "  sensor_tool bench-codec [recording]" << std::endl
+              << "  sensor_tool bench-roi [recording]" << std::endl
+              << "  sensor_tool bench-pyramid [recording]" << std::endl
+              << "  sensor_tool bench-points [recording]" << std::endl
+              << "  sensor_tool bench-denoise [recording]" << std::endl
+              << "  sensor_tool bench-segment [recording]" << std::endl
+              << "  sensor_tool check-math [recording]" << std::endl
+              << "  sensor_tool frame-stats [recording]" << std::endl
+              << "  sensor_tool bench-volumes [holes per side] [hands]" << std::endl
+              << "  sensor_tool bench-gestures [users]" << std::endl
+              << "  sensor_tool bench-clicks [recording]" << std::endl
+              << "  sensor_tool bench-filter <recording> [--noise <mm>] [--predict <ms>] [filter ...]" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        usage();
+        return 1;
+    }
+    std::string const cmd = argv[1];
+    try
+    {
+        if (cmd == "info" && argc == 3)
+            info(argv[2]);
+        else if (cmd == "compress" && argc == 4)
+            convert(argv[2], argv[3], true);
+        else if (cmd == "decompress" && argc == 4)
+            convert(argv[2], argv[3], false);
+        else if (cmd == "bench-codec" && argc == 3)
+            bench_codec(load_frames(argv[2]));
+        else if (cmd == "bench-codec" && argc == 2)
+            bench_codec(synthetic_frames(150));
+        else if (cmd == "bench-roi" && argc == 3)
+            bench_roi(load_frames(argv[2]));
+        else if (cmd == "bench-roi" && argc == 2)
+            bench_roi(synthetic_frames(150, 1));
+        else if (cmd == "bench-pyramid" && argc == 3)
+            bench_pyramid(load_frames(argv[2]), 3);
+        else if (cmd == "bench-pyramid" && argc == 2)
+            bench_pyramid(synthetic_frames(150), 3);
+        else if (cmd == "bench-points" && argc == 3)
+            bench_points(load_frames(argv[2]));
+        else if (cmd == "bench-points" && argc == 2)
+            bench_points(synthetic_frames(150));
+        else if (cmd == "bench-denoise" && argc == 3)
+            bench_denoise(load_frames(argv[2]), {});
+        else if (cmd == "bench-denoise" && argc == 2)
+        {
+            // The synthetic depth is clean, so it is the truth for noisy copies.
+            auto frames = synthetic_frames(150);
+            std::vector<Array2D<XnDepthPixel> > truth(frames.size());
+            std::mt19937 rng(42);
+            for (size_t i = 0; i < frames.size(); ++i)
+            {
+                truth[i] = frames[i].depth_data_;
+                add_depth_noise(truth[i], frames[i].depth_data_, rng);
+            }
+            bench_denoise(frames, truth);
+        }
+        else if (cmd == "bench-segment" && argc == 3)
+        {
+            // The users of a recording move, so the recording itself shows the background.
+            auto const frames = load_frames(argv[2]);
+            bench_segment(frames, frames);
+        }
+        else if (cmd == "bench-segment" && argc == 2)
+            bench_segment(synthetic_frames(150), synthetic_frames(10, 0));
+        else if (cmd == "check-math" && argc == 3)
+            check_math(load_frames(argv[2]));
+        else if (cmd == "check-math" && argc == 2)
+            check_math(synthetic_frames(150));
+        else if (cmd == "frame-stats" && argc == 3)
+        {
+            ReplaySensor sensor(argv[2]);
+            frame_stats(sensor, 20.0f, 3.0);
+        }
+        else if (cmd == "frame-stats" && argc == 2)
+        {
+            SyntheticSensor sensor(SyntheticSensorOptions(1, 640, 480, 30.0f));
+            frame_stats(sensor, 20.0f, 3.0);
+        }
+        else if (cmd == "bench-volumes" && argc <= 4)
+            bench_volumes(argc >= 3 ? std::stoul(argv[2]) : 3, argc == 4 ? std::stoul(argv[3]) : 8);
+        else if (cmd == "bench-gestures" && argc <= 3)
+            bench_gestures(argc == 3 ? std::stoul(argv[2]) : 4, 120);
+        else if (cmd == "bench-clicks" && argc == 3)
+            bench_clicks(load_hands(argv[2]));
+        else if (cmd == "bench-clicks" && argc == 2)
+            bench_clicks(synthetic_hands(30*600));
+        else if (cmd == "bench-filter" && argc >= 3)
+        {
+            float noise = 0;
+            float predict = 0;
+            std::vector<std::string> specs;
+            for (int i = 3; i < argc; ++i)
+            {
+                if (std::string(argv[i]) == "--noise" && i+1 < argc)
+                    noise = std::stof(argv[++i]);
+                else if (std::string(argv[i]) == "--predict" && i+1 < argc)
+                    predict = std::stof(argv[++i]) / 1000.0f;
+                else
+                    specs.push_back(argv[i]);
+            }
+            if (specs.empty())
+                specs = {"none", "average:10", "one-euro", "kalman"};
+            bench_filter(load_trace(argv[2], XN_SKEL_RIGHT_HAND), noise, predict, specs);
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    catch (std::exception const & ex)
+    {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}